@@ -39,6 +39,7 @@
 #include "dev/cc2520_const.h"
 
 #include "net/packetbuf.h"
+#include "net/mac/frame802154.h"
 #include "net/rime/rimestats.h"
 #include "net/netstack.h"
 
@@ -49,6 +50,15 @@
 #define CC2520_CONF_AUTOACK 0
 #endif /* CC2520_CONF_AUTOACK */
 
+#ifndef CC2520_CONF_ASYNC_READ
+#define CC2520_CONF_ASYNC_READ 0
+#endif /* CC2520_CONF_ASYNC_READ */
+
+/* Number of received frames kept in RAM, a power of two. */
+#ifndef CC2520_CONF_RX_FRAMES
+#define CC2520_CONF_RX_FRAMES 4
+#endif /* CC2520_CONF_RX_FRAMES */
+
 #define WITH_SEND_CCA 1
 
 #define FOOTER_LEN 2
@@ -56,6 +66,32 @@
 #define FOOTER1_CRC_OK      0x80
 #define FOOTER1_CORRELATION 0x7f
 
+#if CC2520_CONF_AUTOACK
+/* An ACK frame holds the frame control field and the sequence number. */
+#define ACK_LEN             3
+#define FCF_TYPE_MASK       0x07
+#define FCF_TYPE_DATA       0x01
+#define FCF_TYPE_ACK        0x02
+#define FCF_TYPE_CMD        0x03
+#define FCF_FRAME_PENDING   (1 << 4)
+#define FCF_ACK_REQUEST     (1 << 5)
+/* Addressing modes, in the second byte of the frame control field. */
+#define FCF_DEST_MODE(b)    (((b) >> 2) & 3)
+#define FCF_SRC_MODE(b)     (((b) >> 6) & 3)
+#define FCF_MODE_NONE       0
+#define FCF_MODE_RESERVED   1
+/* The ACK is sent 12 symbols after the frame and lasts 22 symbols. */
+#define ACK_WAIT_TIME       (RTIMER_SECOND / 1000)
+
+/* Sequence number of the frame in the TX FIFO, if it requests an ACK. */
+static uint8_t ack_expected;
+static uint8_t ack_seqno;
+/* Node address the frame filter has been set up with. */
+static rimeaddr_t filter_addr;
+
+uint8_t cc2520_last_ack_pending;
+#endif /* CC2520_CONF_AUTOACK */
+
 #include <stdio.h>
 #define DEBUG 0
 #if DEBUG
@@ -134,6 +170,29 @@ const struct radio_driver cc2520_driver =
 
 static uint8_t receive_on;
 
+/* The FIFOP interrupt moves the received frames from the FIFO to a
+   ring, where the driver process picks them up. */
+struct rx_frame {
+  uint16_t timestamp;
+  uint8_t len;
+  uint8_t rssi;
+  uint8_t correlation;
+  uint8_t data[CC2520_MAX_PACKET_LEN];
+};
+static struct rx_frame rx_ring[CC2520_CONF_RX_FRAMES];
+/* Free running indexes of the ring. */
+static volatile uint8_t rx_put, rx_get;
+/* Length of the frame being read, footer included. */
+static uint8_t rx_len;
+#define RX_SLOT(i) (&rx_ring[(i) & (CC2520_CONF_RX_FRAMES - 1)])
+#define RX_QUEUED() ((uint8_t)(rx_put - rx_get))
+#if CC2520_CONF_ASYNC_READ
+static volatile uint8_t rx_active;
+#endif /* CC2520_CONF_ASYNC_READ */
+static void drain_fifo(void);
+static int check_length(uint8_t len);
+static void frame_done(void);
+
 static int channel;
 
 /*---------------------------------------------------------------------------*/
@@ -203,7 +262,28 @@ off(void)
   }
 }
 /*---------------------------------------------------------------------------*/
+#if CC2520_CONF_ASYNC_READ
+/* An asynchronous FIFO read holds the lock until it completes. The
+   test and the increment must not be split by the FIFOP interrupt,
+   which may start such a read. */
+static void
+GET_LOCK(void)
+{
+  int s;
+
+  while(1) {
+    s = splhigh();
+    if(!rx_active) {
+      locked++;
+      splx(s);
+      return;
+    }
+    splx(s);
+  }
+}
+#else
 #define GET_LOCK() locked++
+#endif /* CC2520_CONF_ASYNC_READ */
 static void RELEASE_LOCK(void) {
   if(locked == 1) {
     if(lock_on) {
@@ -240,6 +320,8 @@ set_txpower(uint8_t power)
 /*---------------------------------------------------------------------------*/
 #define AUTOCRC (1 << 6)
 #define AUTOACK (1 << 5)
+#define PENDING_OR (1 << 2)
+#define SET_RXENMASK_ON_TX (1 << 0)
 #define FRAME_MAX_VERSION ((1 << 3) | (1 << 2))
 #define FRAME_FILTER_ENABLE (1 << 0)
 #define CORR_THR(n) (((n) & 0x1f) << 6)
@@ -321,12 +403,19 @@ cc2520_init(void)
   /* Disable filter on @ (remove if you want to address specific wismote) */
   setreg(CC2520_FRMFILT0,    0x00);
 #endif /* CC2520_CONF_AUTOACK */
-  /* SET_RXENMASK_ON_TX */
-  setreg(CC2520_FRMCTRL1,          1);
+  setreg(CC2520_FRMCTRL1,    SET_RXENMASK_ON_TX);
   /* Set FIFOP threshold to maximum .*/
   setreg(CC2520_FIFOPCTRL,   FIFOP_THR(0x7F));
 
+#if CC2520_CONF_AUTOACK
+  /* The frame filter only accepts frames for our PAN and address. */
+  rimeaddr_copy(&filter_addr, &rimeaddr_node_addr);
+  cc2520_set_pan_addr(IEEE802154_PANID,
+                      (filter_addr.u8[0] << 8) + filter_addr.u8[1],
+                      RIMEADDR_SIZE == 8 ? filter_addr.u8 : NULL);
+#else
   cc2520_set_pan_addr(0xffff, 0x0000, NULL);
+#endif /* CC2520_CONF_AUTOACK */
   cc2520_set_channel(26);
 
   flushrx();
@@ -335,10 +424,112 @@ cc2520_init(void)
   return 1;
 }
 /*---------------------------------------------------------------------------*/
+#if CC2520_CONF_AUTOACK
+/* Only 802.15.4 data and command frames with a destination address
+   are acknowledged. The frame may come from another framer. */
+static int
+ack_requested(const uint8_t *frame, unsigned short len)
+{
+  uint8_t type;
+
+  if(len < ACK_LEN) {
+    return 0;
+  }
+  type = frame[0] & FCF_TYPE_MASK;
+  if(type != FCF_TYPE_DATA && type != FCF_TYPE_CMD) {
+    return 0;
+  }
+  if(FCF_DEST_MODE(frame[1]) == FCF_MODE_NONE ||
+     FCF_DEST_MODE(frame[1]) == FCF_MODE_RESERVED ||
+     FCF_SRC_MODE(frame[1]) == FCF_MODE_RESERVED) {
+    return 0;
+  }
+  return (frame[0] & FCF_ACK_REQUEST) != 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Move a frame that is not our ACK from the FIFO to the ring. */
+static void
+keep_frame(uint8_t len)
+{
+  uint8_t dummy;
+
+  if(RX_QUEUED() < CC2520_CONF_RX_FRAMES) {
+    rx_len = len;
+    getrxdata(RX_SLOT(rx_put)->data, len);
+    frame_done();
+  } else {
+    /* The ring is full: the frame is dropped, but the rest of the
+       FIFO is kept. */
+    while(len-- > 0) {
+      getrxbyte(&dummy);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+wait_ack(void)
+{
+  uint8_t ack[ACK_LEN + FOOTER_LEN];
+  uint8_t len;
+  rtimer_clock_t t0;
+  int ret;
+
+  /* SET_RXENMASK_ON_TX has turned the receiver on after the frame.
+     The ACK is read here, so it must not reach the driver process. */
+  CC2520_DISABLE_FIFOP_INT();
+
+  ret = RADIO_TX_NOACK;
+  t0 = RTIMER_NOW();
+  while(ret == RADIO_TX_NOACK) {
+    while(!CC2520_FIFOP_IS_1 &&
+          RTIMER_CLOCK_LT(RTIMER_NOW(), t0 + ACK_WAIT_TIME));
+    if(!CC2520_FIFOP_IS_1) {
+      break;
+    }
+    getrxbyte(&len);
+    if(len == ACK_LEN + FOOTER_LEN) {
+      getrxdata(ack, ACK_LEN + FOOTER_LEN);
+      if((ack[0] & FCF_TYPE_MASK) == FCF_TYPE_ACK && ack[2] == ack_seqno &&
+         (ack[ACK_LEN + 1] & FOOTER1_CRC_OK)) {
+        cc2520_last_ack_pending = (ack[0] & FCF_FRAME_PENDING) != 0;
+        ret = RADIO_TX_OK;
+      }
+    } else if(check_length(len)) {
+      /* A frame was received before the ACK, possibly before our
+         transmission. It is kept for the driver process. */
+      keep_frame(len);
+    } else {
+      /* check_length() has flushed the FIFO. */
+      break;
+    }
+  }
+
+  CC2520_CLEAR_FIFOP_INT();
+  if(receive_on) {
+    CC2520_ENABLE_FIFOP_INT();
+  }
+  if(RX_QUEUED() > 0 || (receive_on && CC2520_FIFOP_IS_1)) {
+    process_poll(&cc2520_process);
+  }
+  return ret;
+}
+/*---------------------------------------------------------------------------*/
+static void
+update_address_filter(void)
+{
+  if(!rimeaddr_cmp(&filter_addr, &rimeaddr_node_addr)) {
+    rimeaddr_copy(&filter_addr, &rimeaddr_node_addr);
+    cc2520_set_pan_addr(IEEE802154_PANID,
+                        (filter_addr.u8[0] << 8) + filter_addr.u8[1],
+                        RIMEADDR_SIZE == 8 ? filter_addr.u8 : NULL);
+  }
+}
+#endif /* CC2520_CONF_AUTOACK */
+/*---------------------------------------------------------------------------*/
 static int
 cc2520_transmit(unsigned short payload_len)
 {
-  int i, txpower;
+  int i, txpower, ret;
 
   GET_LOCK();
 
@@ -398,6 +589,13 @@ cc2520_transmit(unsigned short payload_len)
      //BUSYWAIT_UNTIL(getreg(CC2520_EXCFLAG0) & TX_FRM_DONE , RTIMER_SECOND / 100);
       BUSYWAIT_UNTIL(!(status() & BV(CC2520_TX_ACTIVE)), RTIMER_SECOND / 10);
 
+      ret = RADIO_TX_OK;
+#if CC2520_CONF_AUTOACK
+      if(ack_expected) {
+        ret = wait_ack();
+      }
+#endif /* CC2520_CONF_AUTOACK */
+
 #ifdef ENERGEST_CONF_LEVELDEVICE_LEVELS
       ENERGEST_OFF_LEVEL(ENERGEST_TYPE_TRANSMIT,cc2520_get_txpower());
 #endif
@@ -417,7 +615,7 @@ cc2520_transmit(unsigned short payload_len)
 
       RELEASE_LOCK();
 
-      return RADIO_TX_OK;
+      return ret;
     }
   }
 
@@ -448,6 +646,11 @@ cc2520_prepare(const void *payload, unsigned short payload_len)
   printf("\n");*/
   RIMESTATS_ADD(lltx);
 
+#if CC2520_CONF_AUTOACK
+  ack_expected = ack_requested(payload, payload_len);
+  ack_seqno = ack_expected ? ((uint8_t *)payload)[2] : 0;
+#endif /* CC2520_CONF_AUTOACK */
+
   /* Wait for any previous transmission to finish. */
   /*  while(status() & BV(CC2520_TX_ACTIVE));*/
 
@@ -511,6 +714,9 @@ cc2520_on(void)
   }
 
   GET_LOCK();
+#if CC2520_CONF_AUTOACK
+  update_address_filter();
+#endif /* CC2520_CONF_AUTOACK */
   on();
   RELEASE_LOCK();
   return 1;
@@ -602,7 +808,6 @@ int
 cc2520_interrupt(void)
 {
   CC2520_CLEAR_FIFOP_INT();
-  process_poll(&cc2520_process);
 #if CC2520_TIMETABLE_PROFILING
   timetable_clear(&cc2520_timetable);
   TIMETABLE_TIMESTAMP(cc2520_timetable, "interrupt");
@@ -610,12 +815,18 @@ cc2520_interrupt(void)
 
   last_packet_timestamp = cc2520_sfd_start_time;
   cc2520_packets_seen++;
+
+  /* Empty the FIFO right away, so that back-to-back frames do not
+     overflow it. */
+  drain_fifo();
+  process_poll(&cc2520_process);
   return 1;
 }
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(cc2520_process, ev, data)
 {
   int len;
+  uint8_t n;
   PROCESS_BEGIN();
 
   PRINTF("cc2520_process: started\n");
@@ -626,15 +837,25 @@ PROCESS_THREAD(cc2520_process, ev, data)
     TIMETABLE_TIMESTAMP(cc2520_timetable, "poll");
 #endif /* CC2520_TIMETABLE_PROFILING */
 
-    PRINTF("cc2520_process: calling receiver callback\n");
+    /* The FIFO is left alone by the interrupt when the driver is
+       locked or the ring is full. */
+    drain_fifo();
+
+    PRINTF("cc2520_process: %u frames\n", RX_QUEUED());
 
-    packetbuf_clear();
-    packetbuf_set_attr(PACKETBUF_ATTR_TIMESTAMP, last_packet_timestamp);
-    len = cc2520_read(packetbuf_dataptr(), PACKETBUF_SIZE);
-    packetbuf_set_datalen(len);
+    for(n = 0; n < CC2520_CONF_RX_FRAMES && RX_QUEUED() > 0; n++) {
+      packetbuf_clear();
+      len = cc2520_read(packetbuf_dataptr(), PACKETBUF_SIZE);
+      packetbuf_set_datalen(len);
 
-    NETSTACK_RDC.input();
-    /* flushrx(); */
+      NETSTACK_RDC.input();
+    }
+
+    /* Let the other processes run before the next batch. */
+    drain_fifo();
+    if(RX_QUEUED() > 0) {
+      process_poll(&cc2520_process);
+    }
 #if CC2520_TIMETABLE_PROFILING
     TIMETABLE_TIMESTAMP(cc2520_timetable, "end");
     timetable_aggregate_compute_detailed(&aggregate_time,
@@ -647,80 +868,159 @@ PROCESS_THREAD(cc2520_process, ev, data)
 }
 /*---------------------------------------------------------------------------*/
 static int
-cc2520_read(void *buf, unsigned short bufsize)
+check_length(uint8_t len)
 {
-  uint8_t footer[2];
-  uint8_t len;
-
-  if(!CC2520_FIFOP_IS_1) {
-    return 0;
-  }
-
-  GET_LOCK();
-
-  cc2520_packets_read++;
-
-  getrxbyte(&len);
-
   if(len > CC2520_MAX_PACKET_LEN) {
     /* Oops, we must be out of sync. */
     flushrx();
     RIMESTATS_ADD(badsynch);
-    RELEASE_LOCK();
     return 0;
   }
 
   if(len <= FOOTER_LEN) {
     flushrx();
     RIMESTATS_ADD(tooshort);
-    RELEASE_LOCK();
     return 0;
   }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Queue the frame that has been read in the next slot of the ring. */
+static void
+frame_done(void)
+{
+  struct rx_frame *f;
+  uint8_t *footer;
+
+  f = RX_SLOT(rx_put);
+  footer = &f->data[rx_len - FOOTER_LEN];
+  if(footer[1] & FOOTER1_CRC_OK) {
+    f->len = rx_len - FOOTER_LEN;
+    f->rssi = footer[0];
+    f->correlation = footer[1] & FOOTER1_CORRELATION;
+    f->timestamp = last_packet_timestamp;
+    rx_put++;
+  } else {
+    RIMESTATS_ADD(badcrc);
+  }
 
-  if(len - FOOTER_LEN > bufsize) {
+  if(CC2520_FIFOP_IS_1 && !CC2520_FIFO_IS_1) {
+    /* Clean up in case of FIFO overflow!  This happens for every
+     * full length frame and is signaled by FIFOP = 1 and FIFO =
+     * 0. */
     flushrx();
-    RIMESTATS_ADD(toolong);
+  }
+}
+/*---------------------------------------------------------------------------*/
+#if CC2520_CONF_ASYNC_READ
+static void read_frames(void);
+
+static void
+read_done(void *ptr)
+{
+  CC2520_SPI_DISABLE();
+  rx_active = 0;
+  frame_done();
+  read_frames();
+  if(!rx_active) {
     RELEASE_LOCK();
-    return 0;
   }
+  process_poll(&cc2520_process);
+}
+#endif /* CC2520_CONF_ASYNC_READ */
+/*---------------------------------------------------------------------------*/
+/* Move the complete frames from the FIFO to the ring, with the lock
+   held. With CC2520_CONF_ASYNC_READ, a frame is moved by the SPI layer:
+   we return once the transfer is started, and read_done() goes on with
+   the next frame. */
+static void
+read_frames(void)
+{
+  while(CC2520_FIFOP_IS_1 && RX_QUEUED() < CC2520_CONF_RX_FRAMES) {
+    getrxbyte(&rx_len);
+    if(!check_length(rx_len)) {
+      continue;
+    }
+    cc2520_packets_read++;
+#if CC2520_CONF_ASYNC_READ
+    CC2520_SPI_ENABLE();
+    SPI_WRITE(CC2520_INS_RXBUF);
+    rx_active = 1;
+    if(spi_transfer(NULL, RX_SLOT(rx_put)->data, rx_len, read_done, NULL)) {
+      return;
+    }
+    /* The bus is used by another device: drop the frame. */
+    rx_active = 0;
+    CC2520_SPI_DISABLE();
+    flushrx();
+    return;
+#else
+    getrxdata(RX_SLOT(rx_put)->data, rx_len);
+    frame_done();
+#endif /* CC2520_CONF_ASYNC_READ */
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+drain_fifo(void)
+{
+  int s;
 
-  getrxdata(buf, len - FOOTER_LEN);
-  getrxdata(footer, FOOTER_LEN);
+  s = splhigh();
+  if(locked) {
+    /* The driver process tries again when it is polled. */
+    splx(s);
+    return;
+  }
+  locked++;
+  splx(s);
+
+  read_frames();
+#if CC2520_CONF_ASYNC_READ
+  if(rx_active) {
+    /* read_done() releases the lock. */
+    return;
+  }
+#endif /* CC2520_CONF_ASYNC_READ */
+  RELEASE_LOCK();
+}
+/*---------------------------------------------------------------------------*/
+static int
+cc2520_read(void *buf, unsigned short bufsize)
+{
+  struct rx_frame *f;
+  uint8_t len;
 
-  if(footer[1] & FOOTER1_CRC_OK) {
-    cc2520_last_rssi = footer[0];
-    cc2520_last_correlation = footer[1] & FOOTER1_CORRELATION;
+  if(RX_QUEUED() == 0) {
+    /* A MAC protocol may be waiting for a frame, such as an ACK. */
+    drain_fifo();
+#if CC2520_CONF_ASYNC_READ
+    BUSYWAIT_UNTIL(!rx_active, RTIMER_SECOND / 500);
+#endif /* CC2520_CONF_ASYNC_READ */
+    if(RX_QUEUED() == 0) {
+      return 0;
+    }
+  }
 
+  f = RX_SLOT(rx_get);
+  len = f->len;
+  if(len > bufsize) {
+    RIMESTATS_ADD(toolong);
+    len = 0;
+  } else {
+    memcpy(buf, f->data, len);
+    cc2520_last_rssi = f->rssi;
+    cc2520_last_correlation = f->correlation;
 
+    packetbuf_set_attr(PACKETBUF_ATTR_TIMESTAMP, f->timestamp);
     packetbuf_set_attr(PACKETBUF_ATTR_RSSI, cc2520_last_rssi);
     packetbuf_set_attr(PACKETBUF_ATTR_LINK_QUALITY, cc2520_last_correlation);
 
     RIMESTATS_ADD(llrx);
-
-  } else {
-    RIMESTATS_ADD(badcrc);
-    len = FOOTER_LEN;
-  }
-
-  if(CC2520_FIFOP_IS_1) {
-    if(!CC2520_FIFO_IS_1) {
-      /* Clean up in case of FIFO overflow!  This happens for every
-       * full length frame and is signaled by FIFOP = 1 and FIFO =
-       * 0. */
-      flushrx();
-    } else {
-      /* Another packet has been received and needs attention. */
-      process_poll(&cc2520_process);
-    }
   }
+  rx_get++;
 
-  RELEASE_LOCK();
-
-  if(len < FOOTER_LEN) {
-    return 0;
-  }
-
-  return len - FOOTER_LEN;
+  return len;
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -838,7 +1138,31 @@ cc2520_receiving_packet(void)
 static int
 pending_packet(void)
 {
-  return CC2520_FIFOP_IS_1;
+  return CC2520_FIFOP_IS_1 || RX_QUEUED() > 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+cc2520_set_pending(int pending)
+{
+  GET_LOCK();
+  setreg(CC2520_FRMCTRL1, SET_RXENMASK_ON_TX | (pending ? PENDING_OR : 0));
+  RELEASE_LOCK();
+}
+/*---------------------------------------------------------------------------*/
+int
+cc2520_busy(void)
+{
+#if CC2520_CONF_ASYNC_READ
+  if(spi_busy) {
+    return 1;
+  }
+#endif /* CC2520_CONF_ASYNC_READ */
+#ifdef CC2520_SPI_IS_ENABLED
+  if(CC2520_SPI_IS_ENABLED()) {
+    return 1;
+  }
+#endif /* CC2520_SPI_IS_ENABLED */
+  return locked;
 }
 /*---------------------------------------------------------------------------*/
 void
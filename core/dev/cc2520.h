@@ -59,6 +59,22 @@ void cc2520_set_pan_addr(unsigned pan,
 extern signed char cc2520_last_rssi;
 extern uint8_t cc2520_last_correlation;
 
+/**
+ * With CC2520_CONF_AUTOACK, the chip filters the frames on their PAN
+ * and destination address, and acknowledges them. The transmit
+ * function then waits for the ACK and returns RADIO_TX_NOACK if none
+ * came. cc2520_last_ack_pending is the frame pending bit of the last
+ * ACK received. This requires 802.15.4 frames, as made by
+ * framer_802154.
+ */
+extern uint8_t cc2520_last_ack_pending;
+
+/**
+ * \param pending Non-zero to set the frame pending bit in all the
+ *                ACKs sent by the chip.
+ */
+void cc2520_set_pending(int pending);
+
 int cc2520_rssi(void);
 
 extern const struct radio_driver cc2520_driver;
@@ -87,6 +103,10 @@ int cc2520_off(void);
 
 void cc2520_set_cca_threshold(int value);
 
+/* Non-zero while the driver holds its lock or the SPI bus is in use.
+   Code that runs from an interrupt must then leave the radio alone. */
+int cc2520_busy(void);
+
 /************************************************************************/
 /* Additional SPI Macros for the CC2520 */
 /************************************************************************/
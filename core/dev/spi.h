@@ -53,10 +53,22 @@
 #define SPI_WAITFORTx_ENDED()
 #endif /* SPI_WAITFORTxREADY */
 
-extern unsigned char spi_busy;
+extern volatile unsigned char spi_busy;
 
 void spi_init(void);
 
+/* Asynchronous block transfers, on the platforms that provide them. The
+   callback is called from interrupt context when the last byte has been
+   received. A NULL tx buffer sends zeroes, a NULL rx buffer discards
+   the received bytes. */
+typedef void (* spi_callback_t)(void *ptr);
+
+int spi_transfer(const unsigned char *tx, unsigned char *rx,
+                 unsigned short len, spi_callback_t callback, void *ptr);
+
+/* Wait for the end of an asynchronous transfer */
+#define SPI_WAIT_TRANSFER() while(spi_busy)
+
 /* Write one character to SPI */
 #define SPI_WRITE(data)                         \
   do {                                          \
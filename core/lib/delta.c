@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2012, LCIS/CTSYS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+
+/**
+ * \file
+ *         Delta patch library implementation
+ */
+
+#include "lib/delta.h"
+#include "lib/crc16.h"
+#include "cfs/cfs.h"
+
+#include <string.h>
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+#define MAGIC0 'D'
+#define MAGIC1 'L'
+
+#define OP_COPY   0x80
+#define OP_FILL   0xc0
+#define OP_MASK   0xc0
+#define LEN_MASK  0x3f
+
+enum {
+  STATE_HEADER,
+  STATE_OP,
+  STATE_LEN,
+  STATE_OFFSET,
+  STATE_INSERT,
+  STATE_FILL,
+};
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+/*---------------------------------------------------------------------------*/
+static uint16_t
+get16(const uint8_t *p)
+{
+  return p[0] | ((uint16_t)p[1] << 8);
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+get32(const uint8_t *p)
+{
+  return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+/*---------------------------------------------------------------------------*/
+static int
+write_new(struct delta *d, const uint8_t *buf, int len)
+{
+  if(d->new_size - d->written < (uint32_t)len) {
+    return DELTA_ERR_FORMAT;
+  }
+  if(cfs_write(d->new_fd, buf, len) != len) {
+    return DELTA_ERR_IO;
+  }
+  d->crc = crc16_data(buf, len, d->crc);
+  d->written += len;
+  return DELTA_MORE;
+}
+/*---------------------------------------------------------------------------*/
+static int
+check_old(struct delta *d)
+{
+  uint8_t buf[DELTA_BUFFER];
+  uint32_t left;
+  uint16_t crc;
+  int n;
+
+  if(cfs_seek(d->old_fd, 0, CFS_SEEK_SET) != 0) {
+    return DELTA_ERR_IO;
+  }
+  crc = 0;
+  for(left = d->old_size; left > 0; left -= n) {
+    n = MIN(left, sizeof(buf));
+    if(cfs_read(d->old_fd, buf, n) != n) {
+      return DELTA_ERR_BASE;
+    }
+    crc = crc16_data(buf, n, crc);
+  }
+  return crc == get16(&d->hdr[6]) ? DELTA_MORE : DELTA_ERR_BASE;
+}
+/*---------------------------------------------------------------------------*/
+static int
+start(struct delta *d)
+{
+  if(d->hdr[0] != MAGIC0 || d->hdr[1] != MAGIC1) {
+    return DELTA_ERR_FORMAT;
+  }
+  d->old_size = get32(&d->hdr[2]);
+  d->new_size = get32(&d->hdr[8]);
+  d->new_crc = get16(&d->hdr[12]);
+  PRINTF("delta: %lu bytes from %lu bytes\n",
+         (unsigned long)d->new_size, (unsigned long)d->old_size);
+  return check_old(d);
+}
+/*---------------------------------------------------------------------------*/
+static int
+copy(struct delta *d)
+{
+  uint8_t buf[DELTA_BUFFER];
+  int n;
+  int r;
+
+  if(d->pos > d->old_size || d->old_size - d->pos < d->len) {
+    return DELTA_ERR_FORMAT;
+  }
+  if(cfs_seek(d->old_fd, d->pos, CFS_SEEK_SET) != (cfs_offset_t)d->pos) {
+    return DELTA_ERR_IO;
+  }
+  while(d->len > 0) {
+    n = MIN(d->len, sizeof(buf));
+    if(cfs_read(d->old_fd, buf, n) != n) {
+      return DELTA_ERR_IO;
+    }
+    r = write_new(d, buf, n);
+    if(r != DELTA_MORE) {
+      return r;
+    }
+    d->pos += n;
+    d->len -= n;
+  }
+  return DELTA_MORE;
+}
+/*---------------------------------------------------------------------------*/
+static int
+fill(struct delta *d, uint8_t b)
+{
+  uint8_t buf[DELTA_BUFFER];
+  int n;
+  int r;
+
+  memset(buf, b, MIN(d->len, sizeof(buf)));
+  while(d->len > 0) {
+    n = MIN(d->len, sizeof(buf));
+    r = write_new(d, buf, n);
+    if(r != DELTA_MORE) {
+      return r;
+    }
+    d->len -= n;
+  }
+  return DELTA_MORE;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+operand_state(struct delta *d)
+{
+  return (d->op & OP_MASK) == OP_FILL ? STATE_FILL : STATE_OFFSET;
+}
+/*---------------------------------------------------------------------------*/
+static int
+command(struct delta *d, uint8_t b)
+{
+  switch(d->state) {
+  case STATE_OP:
+    d->op = b;
+    if(b < OP_COPY) {
+      d->len = b + 1;
+      d->state = STATE_INSERT;
+      return DELTA_MORE;
+    }
+    d->len = b & LEN_MASK;
+    d->value = 0;
+    d->shift = 0;
+    d->state = d->len == 0 ? STATE_LEN : operand_state(d);
+    return DELTA_MORE;
+
+  case STATE_LEN:
+  case STATE_OFFSET:
+    if(d->shift > 28) {
+      return DELTA_ERR_FORMAT;
+    }
+    d->value |= (uint32_t)(b & 0x7f) << d->shift;
+    d->shift += 7;
+    if(b & 0x80) {
+      return DELTA_MORE;
+    }
+    if(d->state == STATE_LEN) {
+      d->len = d->value;
+      d->value = 0;
+      d->shift = 0;
+      d->state = operand_state(d);
+      return DELTA_MORE;
+    }
+    /* The offset is zigzag encoded: 0, -1, 1, -2... */
+    d->pos += (d->value >> 1) ^ -(d->value & 1);
+    d->state = STATE_OP;
+    return copy(d);
+
+  case STATE_FILL:
+    d->state = STATE_OP;
+    return fill(d, b);
+  }
+  return DELTA_ERR_FORMAT;
+}
+/*---------------------------------------------------------------------------*/
+void
+delta_init(struct delta *d, int old_fd, int new_fd)
+{
+  memset(d, 0, sizeof(*d));
+  d->old_fd = old_fd;
+  d->new_fd = new_fd;
+  d->state = STATE_HEADER;
+  d->result = DELTA_MORE;
+}
+/*---------------------------------------------------------------------------*/
+int
+delta_input(struct delta *d, const uint8_t *data, int len)
+{
+  int n;
+
+  while(len > 0 && d->result == DELTA_MORE) {
+    if(d->state == STATE_HEADER) {
+      n = MIN((uint32_t)len, DELTA_HEADER_LEN - d->len);
+      memcpy(&d->hdr[d->len], data, n);
+      d->len += n;
+      if(d->len == DELTA_HEADER_LEN) {
+        d->len = 0;
+        d->state = STATE_OP;
+        d->result = start(d);
+      }
+    } else if(d->state == STATE_INSERT) {
+      n = MIN((uint32_t)len, d->len);
+      d->result = write_new(d, data, n);
+      d->len -= n;
+      if(d->len == 0) {
+        d->state = STATE_OP;
+      }
+    } else {
+      n = 1;
+      d->result = command(d, *data);
+    }
+    data += n;
+    len -= n;
+
+    if(d->result == DELTA_MORE && d->state == STATE_OP &&
+       d->written == d->new_size) {
+      d->result = d->crc == d->new_crc ? DELTA_DONE : DELTA_ERR_CRC;
+      PRINTF("delta: done, result %d\n", d->result);
+    }
+  }
+  return d->result;
+}
+/*---------------------------------------------------------------------------*/
+long
+delta_new_size(const uint8_t *data, int len)
+{
+  if(len < DELTA_HEADER_LEN || data[0] != MAGIC0 || data[1] != MAGIC1) {
+    return -1;
+  }
+  return (long)get32(&data[8]);
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,158 @@
+/** \addtogroup lib
+ * @{ */
+
+/**
+ * \defgroup delta Delta patches
+ * @{
+ *
+ * The delta library rebuilds a file from an older version of it and a
+ * delta produced by tools/delta/mkdelta, so that only the changed
+ * parts of a module or firmware image are sent over the air. The delta
+ * can be applied while it is received in order, for example by the
+ * write_chunk callback of a rudolph2 connection with a window of one
+ * chunk. Otherwise, apply it from the stored delta once the last chunk
+ * has arrived. The new file is written sequentially,
+ * which suits Coffee: reserve the size given by delta_new_size() with
+ * cfs_coffee_reserve() before opening it for writing.
+ *
+ * A delta starts with a 14-byte header: the magic "DL", the size and
+ * CRC16 of the old file, and the size and CRC16 of the new file. Sizes
+ * are 32-bit and CRCs 16-bit, both little-endian. It is followed by
+ * commands:
+ *
+ * - 0x00 to 0x7f: insert the following op + 1 bytes.
+ * - 0x80 to 0xbf: copy len bytes of the old file, where len is the low
+ *   six bits of op, or a varint if they are zero. A zigzag varint
+ *   follows with the offset of the source, relative to the end of the
+ *   previous copy.
+ * - 0xc0 to 0xff: write len times the following byte, with len encoded
+ *   as for a copy.
+ *
+ * Varints are little-endian base 128, with the high bit of each byte
+ * set when more bytes follow.
+ */
+
+/*
+ * Copyright (c) 2012, LCIS/CTSYS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+
+/**
+ * \file
+ *         Header file for the delta patch library
+ */
+
+#ifndef __DELTA_H__
+#define __DELTA_H__
+
+#include "contiki-conf.h"
+
+/** Size of the buffer used to copy from the old file, on the stack. */
+#ifdef DELTA_CONF_BUFFER
+#define DELTA_BUFFER DELTA_CONF_BUFFER
+#else
+#define DELTA_BUFFER 32
+#endif
+
+#define DELTA_HEADER_LEN 14
+
+/** Return values of delta_input(). */
+enum {
+  DELTA_MORE,         /**< The delta is not complete yet. */
+  DELTA_DONE,         /**< The new file is complete and its CRC matches. */
+  DELTA_ERR_BASE,     /**< The old file is not the one of the delta. */
+  DELTA_ERR_FORMAT,   /**< The delta is malformed. */
+  DELTA_ERR_CRC,      /**< The new file does not match its CRC. */
+  DELTA_ERR_IO,       /**< A file could not be read or written. */
+};
+
+/**
+ * \brief      Structure that holds the state of a delta being applied.
+ */
+struct delta {
+  int old_fd;
+  int new_fd;
+  uint32_t old_size;
+  uint32_t new_size;
+  /* The number of bytes of the new file written so far. */
+  uint32_t written;
+  /* The offset in the old file following the previous copy. */
+  uint32_t pos;
+  /* The remaining length of the current command. */
+  uint32_t len;
+  uint32_t value;
+  uint16_t new_crc;
+  uint16_t crc;
+  uint8_t shift;
+  uint8_t state;
+  uint8_t op;
+  uint8_t result;
+  uint8_t hdr[DELTA_HEADER_LEN];
+};
+
+/**
+ * \brief      Start applying a delta
+ * \param d    A pointer to the delta state
+ * \param old_fd A file opened for reading with the old version
+ * \param new_fd A file opened for writing, at the offset of the new version
+ */
+void delta_init(struct delta *d, int old_fd, int new_fd);
+
+/**
+ * \brief      Apply the next part of a delta
+ * \param d    A pointer to the delta state
+ * \param data The next bytes of the delta
+ * \param len  The number of bytes
+ * \return     DELTA_MORE, DELTA_DONE or an error
+ *
+ *             The parts of the delta must be given in order, but may
+ *             be of any length. Once an error or DELTA_DONE has been
+ *             returned, the same value is returned for any further
+ *             input. The old file is checked against the header as
+ *             soon as the header is complete.
+ */
+int delta_input(struct delta *d, const uint8_t *data, int len);
+
+/**
+ * \brief      Get the size of the new file from the start of a delta
+ * \param data The first bytes of the delta
+ * \param len  The number of bytes
+ * \return     The size of the new file, or -1 if data does not start
+ *             with a complete header
+ *
+ *             This gives the size to reserve for the new file before
+ *             it is opened, for instance from the first chunk received.
+ */
+long delta_new_size(const uint8_t *data, int len);
+
+#endif /* __DELTA_H__ */
+
+/** @} */
+/** @} */
@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2012, LCIS/CTSYS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Trickle timer library implementation
+ */
+
+#include "lib/trickle-timer.h"
+#include "lib/random.h"
+#include <string.h>
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+enum {
+  STATE_STOPPED,
+  STATE_LISTENING,   /* Waiting for the transmission point t. */
+  STATE_TAIL,        /* Waiting for the end of the interval. */
+  STATE_DEFERRED,    /* Transmission point postponed by the user. */
+};
+
+static void handle_timer(void *ptr);
+/*---------------------------------------------------------------------------*/
+static void
+update_redundancy(struct trickle_timer *tt)
+{
+#if TRICKLE_TIMER_ADAPTIVE_K
+  uint8_t neighbors;
+  uint8_t k;
+
+  if(tt->k == TRICKLE_TIMER_INFINITE_REDUNDANCY || tt->density == 0 ||
+     tt->k <= TRICKLE_TIMER_K_MIN) {
+    tt->k_current = tt->k;
+    return;
+  }
+
+  /* A sparse neighborhood needs fewer transmissions per interval to
+     stay consistent; a dense one may use up to the configured value. */
+  neighbors = (tt->density + 2) >> 2;
+  k = (neighbors + TRICKLE_TIMER_DENSITY_RATIO - 1) /
+    TRICKLE_TIMER_DENSITY_RATIO;
+  if(k < TRICKLE_TIMER_K_MIN) {
+    k = TRICKLE_TIMER_K_MIN;
+  } else if(k > tt->k) {
+    k = tt->k;
+  }
+  tt->k_current = k;
+#else
+  tt->k_current = tt->k;
+#endif /* TRICKLE_TIMER_ADAPTIVE_K */
+}
+/*---------------------------------------------------------------------------*/
+static void
+new_interval(struct trickle_timer *tt)
+{
+  clock_time_t half;
+  clock_time_t t;
+
+  half = tt->interval[tt->level] >> 1;
+  /* Pick t in [I/2, I). */
+  t = half;
+  if(half > 0) {
+    t += (clock_time_t)random_rand() % half;
+  }
+
+  /* The intervals must be equally long among the nodes for Trickle to
+     operate efficiently, so we remember how much of the interval is
+     left after the transmission point. */
+  tt->remaining = tt->interval[tt->level] - t;
+  tt->c = 0;
+  tt->stats.intervals++;
+  update_redundancy(tt);
+
+  tt->state = STATE_LISTENING;
+  PRINTF("trickle-timer: interval %u ticks, t %u, k %u\n",
+         (unsigned)tt->interval[tt->level], (unsigned)t, tt->k_current);
+  ctimer_set(&tt->ct, t, handle_timer, tt);
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_timer(void *ptr)
+{
+  struct trickle_timer *tt = ptr;
+  uint8_t suppress;
+
+  if(tt->state == STATE_LISTENING || tt->state == STATE_DEFERRED) {
+    suppress = tt->k_current != TRICKLE_TIMER_INFINITE_REDUNDANCY &&
+      tt->c >= tt->k_current;
+    if(suppress) {
+      tt->stats.suppressed++;
+    } else {
+      tt->stats.sent++;
+    }
+    /* Schedule the end of the interval before calling back, so that the
+       callback may reset or stop the timer. */
+    tt->state = STATE_TAIL;
+    ctimer_set(&tt->ct, tt->remaining, handle_timer, tt);
+    tt->cb(tt->ptr, suppress);
+  } else if(tt->state == STATE_TAIL) {
+    if(tt->level < tt->doublings) {
+      tt->level++;
+    }
+    new_interval(tt);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+trickle_timer_config(struct trickle_timer *tt, clock_time_t imin,
+                     uint8_t doublings, uint8_t k)
+{
+  uint8_t i;
+
+  if(doublings > TRICKLE_TIMER_MAX_DOUBLINGS) {
+    doublings = TRICKLE_TIMER_MAX_DOUBLINGS;
+  }
+  if(imin == 0) {
+    imin = 1;
+  } else if(imin > TRICKLE_TIMER_MAX_INTERVAL) {
+    imin = TRICKLE_TIMER_MAX_INTERVAL;
+  }
+
+  tt->interval[0] = imin;
+  for(i = 1; i <= doublings; i++) {
+    if(tt->interval[i - 1] > (TRICKLE_TIMER_MAX_INTERVAL >> 1)) {
+      tt->interval[i] = TRICKLE_TIMER_MAX_INTERVAL;
+    } else {
+      tt->interval[i] = tt->interval[i - 1] << 1;
+    }
+  }
+
+  tt->doublings = doublings;
+  tt->level = 0;
+  tt->c = 0;
+  tt->density = 0;
+  tt->state = STATE_STOPPED;
+  memset(&tt->stats, 0, sizeof(tt->stats));
+  tt->k = k;
+  update_redundancy(tt);
+}
+/*---------------------------------------------------------------------------*/
+void
+trickle_timer_set(struct trickle_timer *tt, trickle_timer_cb_t cb, void *ptr)
+{
+  tt->cb = cb;
+  tt->ptr = ptr;
+  tt->level = 0;
+  new_interval(tt);
+}
+/*---------------------------------------------------------------------------*/
+void
+trickle_timer_defer(struct trickle_timer *tt, clock_time_t delay)
+{
+  /* Only the transmission point is moved; the end of the interval is
+     still tt->remaining ticks after it. */
+  tt->state = STATE_DEFERRED;
+  ctimer_set(&tt->ct, delay, handle_timer, tt);
+}
+/*---------------------------------------------------------------------------*/
+void
+trickle_timer_stop(struct trickle_timer *tt)
+{
+  ctimer_stop(&tt->ct);
+  tt->state = STATE_STOPPED;
+}
+/*---------------------------------------------------------------------------*/
+void
+trickle_timer_consistency(struct trickle_timer *tt)
+{
+  if(tt->c < 0xff) {
+    tt->c++;
+  }
+  tt->stats.received++;
+}
+/*---------------------------------------------------------------------------*/
+void
+trickle_timer_inconsistency(struct trickle_timer *tt)
+{
+  /* Do not reset if we are already on the minimum interval. */
+  if(tt->level > 0 && tt->state != STATE_STOPPED) {
+    trickle_timer_reset(tt);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+trickle_timer_reset(struct trickle_timer *tt)
+{
+  tt->level = 0;
+  tt->stats.resets++;
+  new_interval(tt);
+}
+/*---------------------------------------------------------------------------*/
+void
+trickle_timer_set_density(struct trickle_timer *tt, uint8_t neighbors)
+{
+  if(neighbors > 63) {
+    neighbors = 63;
+  }
+  tt->density = tt->density - (tt->density >> 2) + neighbors;
+}
+/*---------------------------------------------------------------------------*/
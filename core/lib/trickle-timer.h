@@ -0,0 +1,228 @@
+/** \addtogroup lib
+ * @{ */
+
+/**
+ * \defgroup trickle-timer Trickle timer library
+ * @{
+ *
+ * The Trickle timer library implements the Trickle algorithm (RFC
+ * 6206) as a reusable engine. It is shared by the RPL DIO timer and
+ * the Rime trickle module.
+ *
+ * The interval lengths are precomputed in clock ticks when the timer
+ * is configured, so that no division is needed on each interval. The
+ * redundancy constant can optionally be adapted to the neighborhood
+ * density reported by the user of the timer, and each timer keeps
+ * counters of the transmissions it has sent, suppressed and heard.
+ *
+ */
+/*
+ * Copyright (c) 2012, LCIS/CTSYS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Header file for the Trickle timer library
+ */
+
+#ifndef __TRICKLE_TIMER_H__
+#define __TRICKLE_TIMER_H__
+
+#include "contiki-conf.h"
+#include "sys/ctimer.h"
+
+/** Maximum number of interval doublings a timer can be configured with. */
+#ifdef TRICKLE_TIMER_CONF_MAX_DOUBLINGS
+#define TRICKLE_TIMER_MAX_DOUBLINGS TRICKLE_TIMER_CONF_MAX_DOUBLINGS
+#else
+#define TRICKLE_TIMER_MAX_DOUBLINGS 8
+#endif
+
+/** Enable adaptation of the redundancy constant to the density. */
+#ifdef TRICKLE_TIMER_CONF_ADAPTIVE_K
+#define TRICKLE_TIMER_ADAPTIVE_K TRICKLE_TIMER_CONF_ADAPTIVE_K
+#else
+#define TRICKLE_TIMER_ADAPTIVE_K 1
+#endif
+
+/** Lowest redundancy constant the adaptation may select. */
+#ifdef TRICKLE_TIMER_CONF_K_MIN
+#define TRICKLE_TIMER_K_MIN TRICKLE_TIMER_CONF_K_MIN
+#else
+#define TRICKLE_TIMER_K_MIN 2
+#endif
+
+/** Number of neighbors per unit of adapted redundancy. */
+#ifdef TRICKLE_TIMER_CONF_DENSITY_RATIO
+#define TRICKLE_TIMER_DENSITY_RATIO TRICKLE_TIMER_CONF_DENSITY_RATIO
+#else
+#define TRICKLE_TIMER_DENSITY_RATIO 3
+#endif
+
+/** The longest interval a ctimer can measure without wrapping. */
+#define TRICKLE_TIMER_MAX_INTERVAL ((clock_time_t)(~(clock_time_t)0) >> 1)
+
+/** Redundancy constant value that disables suppression. */
+#define TRICKLE_TIMER_INFINITE_REDUNDANCY 0
+
+/**
+ * \brief      Callback invoked at the transmission point of an interval
+ * \param ptr  The opaque pointer given to trickle_timer_set()
+ * \param suppress Non-zero if the transmission should be suppressed
+ */
+typedef void (* trickle_timer_cb_t)(void *ptr, uint8_t suppress);
+
+/**
+ * \brief      Counters kept by each Trickle timer.
+ */
+struct trickle_timer_stats {
+  uint16_t intervals;
+  uint16_t sent;
+  uint16_t suppressed;
+  uint16_t received;
+  uint16_t resets;
+};
+
+/**
+ * \brief      Structure that holds the state of a Trickle timer.
+ */
+struct trickle_timer {
+  struct ctimer ct;
+  trickle_timer_cb_t cb;
+  void *ptr;
+  /* Interval lengths in clock ticks, indexed by the doubling level. */
+  clock_time_t interval[TRICKLE_TIMER_MAX_DOUBLINGS + 1];
+  /* Ticks between the transmission point and the end of the interval. */
+  clock_time_t remaining;
+  uint8_t doublings;
+  uint8_t level;
+  uint8_t k;
+  uint8_t k_current;
+  uint8_t c;
+  /* Neighborhood density, scaled by four (EWMA with alpha = 1/4). */
+  uint8_t density;
+  uint8_t state;
+  struct trickle_timer_stats stats;
+};
+
+/**
+ * \brief      Configure a Trickle timer
+ * \param tt   A pointer to the timer
+ * \param imin The minimum interval length, in clock ticks
+ * \param doublings The maximum number of doublings of the interval
+ * \param k    The redundancy constant, or TRICKLE_TIMER_INFINITE_REDUNDANCY
+ *
+ *             This function precomputes the interval table. Intervals that
+ *             do not fit in a clock_time_t are clamped to the largest
+ *             interval a ctimer can measure. The timer is not started;
+ *             its level, counter, density and statistics are cleared,
+ *             so this must be called before any other function.
+ */
+void trickle_timer_config(struct trickle_timer *tt, clock_time_t imin,
+                          uint8_t doublings, uint8_t k);
+
+/**
+ * \brief      Start a Trickle timer at its minimum interval
+ * \param tt   A pointer to the timer
+ * \param cb   The function to call at each transmission point
+ * \param ptr  An opaque pointer passed to the callback
+ *
+ *             A timer that is already running is restarted.
+ */
+void trickle_timer_set(struct trickle_timer *tt, trickle_timer_cb_t cb,
+                       void *ptr);
+
+/**
+ * \brief      Postpone the current transmission point
+ * \param tt   A pointer to the timer
+ * \param delay The delay, in clock ticks
+ *
+ *             Meant to be called from the callback when it cannot
+ *             transmit yet. The callback is invoked again after delay
+ *             ticks, and the interval then ends as it would have.
+ */
+void trickle_timer_defer(struct trickle_timer *tt, clock_time_t delay);
+
+/**
+ * \brief      Stop a Trickle timer
+ * \param tt   A pointer to the timer
+ */
+void trickle_timer_stop(struct trickle_timer *tt);
+
+/**
+ * \brief      Report a consistent transmission heard from a neighbor
+ * \param tt   A pointer to the timer
+ */
+void trickle_timer_consistency(struct trickle_timer *tt);
+
+/**
+ * \brief      Report an inconsistency
+ * \param tt   A pointer to the timer
+ *
+ *             A running timer is reset to its minimum interval, unless
+ *             it already runs at the minimum interval. A stopped timer
+ *             is left stopped.
+ */
+void trickle_timer_inconsistency(struct trickle_timer *tt);
+
+/**
+ * \brief      Restart a Trickle timer at its minimum interval
+ * \param tt   A pointer to a timer started with trickle_timer_set()
+ */
+void trickle_timer_reset(struct trickle_timer *tt);
+
+/**
+ * \brief      Report the current number of neighbors
+ * \param tt   A pointer to the timer
+ * \param neighbors The number of neighbors in radio range
+ *
+ *             The value is smoothed and, when TRICKLE_TIMER_ADAPTIVE_K
+ *             is enabled, used to choose the redundancy constant of the
+ *             next interval. The configured redundancy constant is an
+ *             upper bound.
+ */
+void trickle_timer_set_density(struct trickle_timer *tt, uint8_t neighbors);
+
+/**
+ * \brief      Get the redundancy constant of the current interval
+ * \param tt   A pointer to the timer
+ */
+#define trickle_timer_redundancy(tt) ((tt)->k_current)
+
+/**
+ * \brief      Check if the timer runs at its minimum interval
+ * \param tt   A pointer to the timer
+ */
+#define trickle_timer_at_imin(tt) ((tt)->level == 0)
+
+#endif /* __TRICKLE_TIMER_H__ */
+
+/** @} */
+/** @} */
@@ -53,6 +53,21 @@
 
 #define EI_NIDENT 16
 
+/* The number of bytes each reader prefetches from the file. */
+#ifdef ELFLOADER_CONF_READ_BUFFER
+#define ELFLOADER_READ_BUFFER ELFLOADER_CONF_READ_BUFFER
+#else
+#define ELFLOADER_READ_BUFFER 64
+#endif
+
+/* The number of resolved symbols remembered while a module is
+   relocated. It must be a power of two; 0 disables the cache. */
+#ifdef ELFLOADER_CONF_SYMBOL_CACHE
+#define ELFLOADER_SYMBOL_CACHE ELFLOADER_CONF_SYMBOL_CACHE
+#else
+#define ELFLOADER_SYMBOL_CACHE 8
+#endif
+
 
 struct elf32_ehdr {
   unsigned char e_ident[EI_NIDENT];    /* ident bytes */
@@ -138,6 +153,31 @@ struct process * const * elfloader_autostart_processes;
 
 static struct relevant_section bss, data, rodata, text;
 
+/* A buffered reader for one region of the file. The relocations are
+   read in sequence, and the symbols they refer to are usually close
+   to each other, so each kind of data has its own reader. A reader
+   does not prefetch beyond its region, since the relocator writes
+   into the sections of the file. */
+struct elf_reader {
+  unsigned int start;  /* The file offset of buf. */
+  unsigned int end;    /* The end of the region. */
+  unsigned short len;  /* The number of valid bytes in buf. */
+  char buf[ELFLOADER_READ_BUFFER];
+};
+
+static struct elf_reader rel_reader, sym_reader, str_reader;
+
+#if ELFLOADER_SYMBOL_CACHE > 0
+/* The addresses of the last symbols resolved, by symbol index. A
+   module calls the same few system functions from many places, and
+   each miss costs a name read and a symbol table lookup. Index 0 is
+   the null symbol, which is never resolved, and marks a free slot. */
+static struct {
+  unsigned short index;
+  char *addr;
+} symbol_cache[ELFLOADER_SYMBOL_CACHE];
+#endif /* ELFLOADER_SYMBOL_CACHE > 0 */
+
 static const unsigned char elf_magic_header[] =
   {0x7f, 0x45, 0x4c, 0x46,  /* 0x7f, 'E', 'L', 'F' */
    0x01,                    /* Only 32-bit objects. */
@@ -164,6 +204,74 @@ seek_read(int fd, unsigned int offset, char *buf, int len)
 #endif /* DEBUG */
 }
 /*---------------------------------------------------------------------------*/
+static void
+reader_init(struct elf_reader *r, unsigned int offset, unsigned int size)
+{
+  r->start = offset;
+  r->end = offset + size;
+  r->len = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+reader_read(struct elf_reader *r, int fd, unsigned int offset,
+            char *buf, int len)
+{
+  if(offset < r->start || offset + len > r->start + r->len) {
+    if(len > sizeof(r->buf)) {
+      seek_read(fd, offset, buf, len);
+      return;
+    }
+    r->start = offset;
+    r->len = sizeof(r->buf);
+    if(r->end > offset && r->end - offset < r->len) {
+      r->len = r->end - offset;
+    }
+    if(r->len < len) {
+      r->len = len;
+    }
+    seek_read(fd, offset, r->buf, r->len);
+  }
+  memcpy(buf, &r->buf[offset - r->start], len);
+}
+/*---------------------------------------------------------------------------*/
+static struct relevant_section *
+find_section(elf32_half shndx)
+{
+  if(shndx == bss.number) {
+    return &bss;
+  } else if(shndx == data.number) {
+    return &data;
+  } else if(shndx == rodata.number) {
+    return &rodata;
+  } else if(shndx == text.number) {
+    return &text;
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+#if ELFLOADER_SYMBOL_CACHE > 0
+#define SYMBOL_CACHE_SLOT(index) ((index) & (ELFLOADER_SYMBOL_CACHE - 1))
+
+static char *
+cache_lookup(unsigned short index)
+{
+  if(symbol_cache[SYMBOL_CACHE_SLOT(index)].index == index) {
+    return symbol_cache[SYMBOL_CACHE_SLOT(index)].addr;
+  }
+  return NULL;
+}
+
+static void
+cache_add(unsigned short index, char *addr)
+{
+  symbol_cache[SYMBOL_CACHE_SLOT(index)].index = index;
+  symbol_cache[SYMBOL_CACHE_SLOT(index)].addr = addr;
+}
+#else /* ELFLOADER_SYMBOL_CACHE > 0 */
+#define cache_lookup(index) NULL
+#define cache_add(index, addr)
+#endif /* ELFLOADER_SYMBOL_CACHE > 0 */
+/*---------------------------------------------------------------------------*/
 /*
 static void
 seek_write(int fd, unsigned int offset, char *buf, int len)
@@ -184,10 +292,10 @@ find_local_symbol(int fd, const char *symbol,
   struct relevant_section *sect;
   
   for(a = symtab; a < symtab + symtabsize; a += sizeof(s)) {
-    seek_read(fd, a, (char *)&s, sizeof(s));
+    reader_read(&sym_reader, fd, a, (char *)&s, sizeof(s));
 
     if(s.st_name != 0) {
-      seek_read(fd, strtab + s.st_name, name, sizeof(name));
+      reader_read(&str_reader, fd, strtab + s.st_name, name, sizeof(name));
       if(strcmp(name, symbol) == 0) {
 	if(s.st_shndx == bss.number) {
 	  sect = &bss;
@@ -220,6 +328,7 @@ relocate_section(int fd,
   int rel_size = 0;
   struct elf32_sym s;
   unsigned int a;
+  unsigned short index;
   char name[30];
   char *addr;
   struct relevant_section *sect;
@@ -231,52 +340,38 @@ relocate_section(int fd,
     rel_size = sizeof(struct elf32_rel);
   }
   
+  reader_init(&rel_reader, section, size);
   for(a = section; a < section + size; a += rel_size) {
-    seek_read(fd, a, (char *)&rela, rel_size);
-    seek_read(fd,
-	      symtab + sizeof(struct elf32_sym) * ELF32_R_SYM(rela.r_info),
-	      (char *)&s, sizeof(s));
-    if(s.st_name != 0) {
-      seek_read(fd, strtab + s.st_name, name, sizeof(name));
-      PRINTF("name: %s\n", name);
-      addr = (char *)symtab_lookup(name);
-      /* ADDED */
-      if(addr == NULL) {
-	PRINTF("name not found in global: %s\n", name);
-	addr = find_local_symbol(fd, name, symtab, symtabsize, strtab);
-	PRINTF("found address %p\n", addr);
-      }
-      if(addr == NULL) {
-	if(s.st_shndx == bss.number) {
-	  sect = &bss;
-	} else if(s.st_shndx == data.number) {
-	  sect = &data;
-	} else if(s.st_shndx == rodata.number) {
-	  sect = &rodata;
-	} else if(s.st_shndx == text.number) {
-	  sect = &text;
-	} else {
-	  PRINTF("elfloader unknown name: '%30s'\n", name);
-	  memcpy(elfloader_unknown, name, sizeof(elfloader_unknown));
-	  elfloader_unknown[sizeof(elfloader_unknown) - 1] = 0;
-	  return ELFLOADER_SYMBOL_NOT_FOUND;
-	}
-	addr = sect->address;
-      }
-    } else {
-      if(s.st_shndx == bss.number) {
-	sect = &bss;
-      } else if(s.st_shndx == data.number) {
-	sect = &data;
-      } else if(s.st_shndx == rodata.number) {
-	sect = &rodata;
-      } else if(s.st_shndx == text.number) {
-	sect = &text;
+    reader_read(&rel_reader, fd, a, (char *)&rela, rel_size);
+    index = ELF32_R_SYM(rela.r_info);
+    addr = cache_lookup(index);
+    if(addr == NULL) {
+      reader_read(&sym_reader, fd,
+                  symtab + sizeof(struct elf32_sym) * index,
+                  (char *)&s, sizeof(s));
+      /* The symbol entry of the relocation tells where a symbol of the
+         module is defined, so only undefined symbols are looked up by
+         name, in the symbol table of the system. */
+      sect = find_section(s.st_shndx);
+      if(sect != NULL) {
+        addr = sect->address;
+        if(s.st_name != 0) {
+          addr += s.st_value;
+        }
+      } else if(s.st_name != 0) {
+        reader_read(&str_reader, fd, strtab + s.st_name, name, sizeof(name));
+        PRINTF("name: %s\n", name);
+        addr = (char *)symtab_lookup(name);
+        if(addr == NULL) {
+          PRINTF("elfloader unknown name: '%30s'\n", name);
+          memcpy(elfloader_unknown, name, sizeof(elfloader_unknown));
+          elfloader_unknown[sizeof(elfloader_unknown) - 1] = 0;
+          return ELFLOADER_SYMBOL_NOT_FOUND;
+        }
       } else {
-	return ELFLOADER_SEGMENT_NOT_FOUND;
+        return ELFLOADER_SEGMENT_NOT_FOUND;
       }
-      
-      addr = sect->address;
+      cache_add(index, addr);
     }
 
     if(!using_relas) {
@@ -299,10 +394,10 @@ find_program_processes(int fd,
   char name[30];
   
   for(a = symtab; a < symtab + size; a += sizeof(s)) {
-    seek_read(fd, a, (char *)&s, sizeof(s));
+    reader_read(&sym_reader, fd, a, (char *)&s, sizeof(s));
 
     if(s.st_name != 0) {
-      seek_read(fd, strtab + s.st_name, name, sizeof(name));
+      reader_read(&str_reader, fd, strtab + s.st_name, name, sizeof(name));
       if(strcmp(name, "autostart_processes") == 0) {
 	return &data.address[s.st_value];
       }
@@ -516,6 +611,12 @@ elfloader_load(int fd)
   PRINTF("text base address: text.address = 0x%08x\n", text.address);
   PRINTF("rodata base address: rodata.address = 0x%08x\n", rodata.address);
 
+  reader_init(&sym_reader, symtaboff, symtabsize);
+  reader_init(&str_reader, strtaboff, strtabsize);
+#if ELFLOADER_SYMBOL_CACHE > 0
+  memset(symbol_cache, 0, sizeof(symbol_cache));
+#endif /* ELFLOADER_SYMBOL_CACHE > 0 */
+
 
   /* If we have text segment relocations, we process them. */
   PRINTF("elfloader: relocate text\n");
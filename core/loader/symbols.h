@@ -42,4 +42,15 @@ extern const int symbols_nelts;
 
 extern const struct symbols symbols[/* symbols_nelts */];
 
+/*
+ * With SYMTAB_CONF_HASH, the generator sorts symbols[] by bucket,
+ * symtab_hash(name) % symbols_nbuckets, instead of by name. The
+ * entries of bucket b are symbols[symbols_buckets[b]] up to, but not
+ * including, symbols[symbols_buckets[b + 1]]. About one bucket per
+ * symbol keeps the buckets short.
+ */
+extern const unsigned short symbols_nbuckets;
+
+extern const unsigned short symbols_buckets[/* symbols_nbuckets + 1 */];
+
 #endif /* __SYMBOLS_H__ */
@@ -42,8 +42,44 @@
 #define SYMTAB_CONF_BINARY_SEARCH 1
 #endif
 
+/* The hashed lookup needs the bucket index of the symbol table
+   generator, see symbols.h. */
+#ifndef SYMTAB_CONF_HASH
+#define SYMTAB_CONF_HASH 0
+#endif
+
+/*---------------------------------------------------------------------------*/
+unsigned short
+symtab_hash(const char *name)
+{
+  unsigned short h;
+
+  h = 0;
+  while(*name != 0) {
+    h = h * 31 + (unsigned char)*name++;
+  }
+  return h;
+}
 /*---------------------------------------------------------------------------*/
-#if SYMTAB_CONF_BINARY_SEARCH
+#if SYMTAB_CONF_HASH
+void *
+symtab_lookup(const char *name)
+{
+  unsigned short b;
+  unsigned short i;
+
+  if(symbols_nbuckets == 0) {
+    return NULL;
+  }
+  b = symtab_hash(name) % symbols_nbuckets;
+  for(i = symbols_buckets[b]; i < symbols_buckets[b + 1]; ++i) {
+    if(strcmp(name, symbols[i].name) == 0) {
+      return symbols[i].value;
+    }
+  }
+  return NULL;
+}
+#elif SYMTAB_CONF_BINARY_SEARCH
 void *
 symtab_lookup(const char *name)
 {
@@ -79,5 +115,5 @@ symtab_lookup(const char *name)
   }
   return 0;
 }
-#endif /* SYMTAB_CONF_BINARY_SEARCH */
+#endif /* SYMTAB_CONF_HASH */
 /*---------------------------------------------------------------------------*/
@@ -35,4 +35,8 @@
 
 void *symtab_lookup(const char *name);
 
+/* The hash of a symbol name used by the hashed symbol table: h = h *
+   31 + c over the characters of the name, in 16 bits. */
+unsigned short symtab_hash(const char *name);
+
 #endif /* __SYMTAB_H__ */
@@ -0,0 +1,386 @@
+/*
+ * Copyright (c) 2012, LCIS/CTSYS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Shared link estimator
+ */
+
+#include "contiki.h"
+#include "net/link-estimator.h"
+#include "net/mac/mac.h"
+#include "net/packetbuf.h"
+#include "lib/list.h"
+
+#include <string.h>
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+#if (LINK_ESTIMATOR_HASH_SIZE & (LINK_ESTIMATOR_HASH_SIZE - 1)) != 0 || \
+    LINK_ESTIMATOR_HASH_SIZE <= LINK_ESTIMATOR_NEIGHBORS
+#error LINK_ESTIMATOR_HASH_SIZE must be a power of two larger than LINK_ESTIMATOR_NEIGHBORS
+#endif
+
+#define ETX_UNIT          LINK_ESTIMATOR_ETX_DIVISOR
+#define ETX_MAX           (LINK_ESTIMATOR_ETX_LIMIT * ETX_UNIT)
+
+/* The first samples are averaged with equal weights, so that a new
+   link converges after a few transmissions. Later samples are weighted
+   by 1/2^ALPHA_SHIFT. */
+#define FAST_SAMPLES      4
+#define ALPHA_SHIFT       3
+
+/* The ETX assumed for a link with bad signal quality, until the
+   transmission results take over. */
+#define QUALITY_ETX_MAX   (4 * ETX_UNIT)
+
+/* The ETX assumed for a link that nothing has been received on yet.
+   It is neither a good nor a bad link. */
+#define INITIAL_ETX       (2 * ETX_UNIT)
+
+/* Listeners are only notified of ETX changes of at least this size. */
+#define NOTIFY_THRESHOLD  (ETX_UNIT / 4)
+
+/* Index slots hold the position of a neighbor in the table plus one. */
+#define HASH_EMPTY        0
+
+struct neighbor {
+  rimeaddr_t addr;
+  /* EWMA of the transmission results. */
+  uint16_t etx;
+  /* The ETX listeners were last told about. */
+  uint16_t notified_etx;
+  /* Time of the last update, in seconds. */
+  uint16_t last_seen;
+  /* EWMAs of the signal quality, scaled by four. */
+  int16_t rssi;
+  uint16_t lqi;
+  uint8_t num_tx;
+  uint8_t num_rx;
+  uint8_t used;
+};
+
+static struct neighbor neighbors[LINK_ESTIMATOR_NEIGHBORS];
+/* Open-addressed index of the neighbor table. */
+static uint8_t hash_index[LINK_ESTIMATOR_HASH_SIZE];
+
+LIST(listeners);
+/*---------------------------------------------------------------------------*/
+static uint8_t
+hash(const rimeaddr_t *addr)
+{
+  uint8_t h;
+  uint8_t i;
+
+  h = 0;
+  for(i = 0; i < sizeof(rimeaddr_t); i++) {
+    h = h * 31 + addr->u8[i];
+  }
+  return h & (LINK_ESTIMATOR_HASH_SIZE - 1);
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+find_slot(const rimeaddr_t *addr)
+{
+  uint8_t slot;
+
+  /* The index is never full, so the probe ends on an empty slot. */
+  for(slot = hash(addr); hash_index[slot] != HASH_EMPTY;
+      slot = (slot + 1) & (LINK_ESTIMATOR_HASH_SIZE - 1)) {
+    if(rimeaddr_cmp(&neighbors[hash_index[slot] - 1].addr, addr)) {
+      break;
+    }
+  }
+  return slot;
+}
+/*---------------------------------------------------------------------------*/
+static struct neighbor *
+lookup(const rimeaddr_t *addr)
+{
+  uint8_t slot;
+
+  slot = find_slot(addr);
+  if(hash_index[slot] == HASH_EMPTY) {
+    return NULL;
+  }
+  return &neighbors[hash_index[slot] - 1];
+}
+/*---------------------------------------------------------------------------*/
+static void
+unindex(const rimeaddr_t *addr)
+{
+  uint8_t hole;
+  uint8_t slot;
+  uint8_t home;
+
+  hole = find_slot(addr);
+  if(hash_index[hole] == HASH_EMPTY) {
+    return;
+  }
+  hash_index[hole] = HASH_EMPTY;
+
+  /* Shift back the entries of the probe sequence that follows the hole,
+     so that lookups do not stop early. */
+  for(slot = (hole + 1) & (LINK_ESTIMATOR_HASH_SIZE - 1);
+      hash_index[slot] != HASH_EMPTY;
+      slot = (slot + 1) & (LINK_ESTIMATOR_HASH_SIZE - 1)) {
+    home = hash(&neighbors[hash_index[slot] - 1].addr);
+    if(((slot - home) & (LINK_ESTIMATOR_HASH_SIZE - 1)) >=
+       ((slot - hole) & (LINK_ESTIMATOR_HASH_SIZE - 1))) {
+      hash_index[hole] = hash_index[slot];
+      hash_index[slot] = HASH_EMPTY;
+      hole = slot;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_neighbor(struct neighbor *n)
+{
+  unindex(&n->addr);
+  n->used = 0;
+}
+/*---------------------------------------------------------------------------*/
+static struct neighbor *
+add_neighbor(const rimeaddr_t *addr)
+{
+  struct neighbor *n;
+  struct neighbor *oldest;
+  uint16_t now;
+
+  n = lookup(addr);
+  if(n != NULL) {
+    return n;
+  }
+
+  now = (uint16_t)clock_seconds();
+  oldest = NULL;
+  for(n = neighbors; n < neighbors + LINK_ESTIMATOR_NEIGHBORS; n++) {
+    if(!n->used) {
+      break;
+    }
+    if(oldest == NULL ||
+       (uint16_t)(now - n->last_seen) > (uint16_t)(now - oldest->last_seen)) {
+      oldest = n;
+    }
+  }
+  if(n == neighbors + LINK_ESTIMATOR_NEIGHBORS) {
+    /* Replace the neighbor that has been silent for the longest time. */
+    n = oldest;
+    remove_neighbor(n);
+  }
+
+  memset(n, 0, sizeof(*n));
+  rimeaddr_copy(&n->addr, addr);
+  n->etx = ETX_MAX;
+  n->notified_etx = ETX_MAX;
+  n->last_seen = now;
+  n->used = 1;
+  hash_index[find_slot(addr)] = n - neighbors + 1;
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+quality_etx(struct neighbor *n)
+{
+  uint16_t lqi;
+
+  if(n->num_rx == 0) {
+    return INITIAL_ETX;
+  }
+
+  lqi = n->lqi >> 2;
+  if(lqi >= LINK_ESTIMATOR_LQI_GOOD &&
+     (n->rssi >> 2) >= LINK_ESTIMATOR_RSSI_WEAK) {
+    return ETX_UNIT;
+  }
+  if(lqi <= LINK_ESTIMATOR_LQI_BAD ||
+     (n->rssi >> 2) < LINK_ESTIMATOR_RSSI_WEAK) {
+    return QUALITY_ETX_MAX;
+  }
+  /* Interpolate between the two LQI thresholds. */
+  return ETX_UNIT + (uint32_t)(QUALITY_ETX_MAX - ETX_UNIT) *
+    (LINK_ESTIMATOR_LQI_GOOD - lqi) /
+    (LINK_ESTIMATOR_LQI_GOOD - LINK_ESTIMATOR_LQI_BAD);
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+estimate(struct neighbor *n)
+{
+  if(n->num_tx >= FAST_SAMPLES) {
+    return n->etx;
+  }
+  if(n->num_tx == 0) {
+    return quality_etx(n);
+  }
+  /* Few transmissions have been made: weigh the signal quality
+     against the transmission results. */
+  return ((uint32_t)quality_etx(n) * (FAST_SAMPLES - n->num_tx) +
+          (uint32_t)n->etx * n->num_tx) / FAST_SAMPLES;
+}
+/*---------------------------------------------------------------------------*/
+static void
+update(struct neighbor *n)
+{
+  struct link_estimator_listener *l;
+  uint16_t etx;
+
+  n->last_seen = (uint16_t)clock_seconds();
+  etx = estimate(n);
+  if(etx >= n->notified_etx + NOTIFY_THRESHOLD ||
+     etx + NOTIFY_THRESHOLD <= n->notified_etx) {
+    PRINTF("link-estimator: ETX of %d.%d changed from %u to %u\n",
+           n->addr.u8[0], n->addr.u8[1],
+           n->notified_etx, etx);
+    n->notified_etx = etx;
+    for(l = list_head(listeners); l != NULL; l = list_item_next(l)) {
+      l->callback(&n->addr, etx);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+link_estimator_packet_sent(const rimeaddr_t *dest, int status, int numtx)
+{
+  struct neighbor *n;
+  uint16_t sample;
+
+  if(rimeaddr_cmp(dest, &rimeaddr_null) || numtx <= 0) {
+    return;
+  }
+
+  switch(status) {
+  case MAC_TX_OK:
+    sample = numtx;
+    break;
+  case MAC_TX_NOACK:
+    /* The packet may have needed more transmissions than the MAC was
+       allowed to make. */
+    sample = numtx * 2;
+    break;
+  default:
+    /* Do not penalize the link when collisions or transmission errors
+       occur. */
+    return;
+  }
+  if(sample > LINK_ESTIMATOR_ETX_LIMIT) {
+    sample = LINK_ESTIMATOR_ETX_LIMIT;
+  }
+  sample *= ETX_UNIT;
+
+  n = add_neighbor(dest);
+  if(n->num_tx < FAST_SAMPLES) {
+    /* Running mean of the first samples. */
+    n->etx = ((uint32_t)n->etx * n->num_tx + sample) / (n->num_tx + 1);
+  } else {
+    n->etx = n->etx - (n->etx >> ALPHA_SHIFT) + (sample >> ALPHA_SHIFT);
+  }
+  if(n->num_tx < 0xff) {
+    n->num_tx++;
+  }
+
+  update(n);
+}
+/*---------------------------------------------------------------------------*/
+void
+link_estimator_packet_received(const rimeaddr_t *src)
+{
+  struct neighbor *n;
+  int16_t rssi;
+  uint16_t lqi;
+
+  if(rimeaddr_cmp(src, &rimeaddr_null)) {
+    return;
+  }
+
+  rssi = (int8_t)packetbuf_attr(PACKETBUF_ATTR_RSSI);
+  lqi = packetbuf_attr(PACKETBUF_ATTR_LINK_QUALITY);
+
+  n = add_neighbor(src);
+  if(n->num_rx == 0) {
+    n->rssi = rssi << 2;
+    n->lqi = lqi << 2;
+  } else {
+    /* EWMA with alpha = 1/4. */
+    n->rssi += rssi - (n->rssi >> 2);
+    n->lqi += lqi - (n->lqi >> 2);
+  }
+  if(n->num_rx < 0xff) {
+    n->num_rx++;
+  }
+
+  update(n);
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+link_estimator_get_etx(const rimeaddr_t *addr)
+{
+  struct neighbor *n;
+
+  n = lookup(addr);
+  if(n == NULL) {
+    return ETX_MAX;
+  }
+  return estimate(n);
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+link_estimator_num_samples(const rimeaddr_t *addr)
+{
+  struct neighbor *n;
+
+  n = lookup(addr);
+  return n == NULL ? 0 : n->num_tx;
+}
+/*---------------------------------------------------------------------------*/
+void
+link_estimator_remove(const rimeaddr_t *addr)
+{
+  struct neighbor *n;
+
+  n = lookup(addr);
+  if(n != NULL) {
+    remove_neighbor(n);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+link_estimator_add_listener(struct link_estimator_listener *l)
+{
+  list_add(listeners, l);
+}
+/*---------------------------------------------------------------------------*/
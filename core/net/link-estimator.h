@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2012, LCIS/CTSYS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Header file for the shared link estimator
+ *
+ *         The link estimator keeps an estimate of the expected number
+ *         of transmissions (ETX) to each neighbor. The estimate is an
+ *         exponentially weighted moving average of the number of
+ *         transmissions reported by the MAC layer, fused with the RSSI
+ *         and LQI of the packets received from the neighbor while few
+ *         transmissions have been made. It is used by both the IPv6
+ *         neighbor information module and Rime collect.
+ */
+
+#ifndef __LINK_ESTIMATOR_H__
+#define __LINK_ESTIMATOR_H__
+
+#include "net/rime/rimeaddr.h"
+
+/** Number of neighbors the estimator can keep. */
+#ifdef LINK_ESTIMATOR_CONF_NEIGHBORS
+#define LINK_ESTIMATOR_NEIGHBORS LINK_ESTIMATOR_CONF_NEIGHBORS
+#else
+#define LINK_ESTIMATOR_NEIGHBORS 12
+#endif
+
+/** Size of the hash index of the neighbor table. Must be a power of
+    two larger than LINK_ESTIMATOR_NEIGHBORS. */
+#ifdef LINK_ESTIMATOR_CONF_HASH_SIZE
+#define LINK_ESTIMATOR_HASH_SIZE LINK_ESTIMATOR_CONF_HASH_SIZE
+#else
+#define LINK_ESTIMATOR_HASH_SIZE 32
+#endif
+
+/** LQI (correlation value) at or above which a link is considered
+    perfect before any transmission has been made. */
+#ifdef LINK_ESTIMATOR_CONF_LQI_GOOD
+#define LINK_ESTIMATOR_LQI_GOOD LINK_ESTIMATOR_CONF_LQI_GOOD
+#else
+#define LINK_ESTIMATOR_LQI_GOOD 105
+#endif
+
+/** LQI at or below which a link is considered as bad as possible
+    before any transmission has been made. */
+#ifdef LINK_ESTIMATOR_CONF_LQI_BAD
+#define LINK_ESTIMATOR_LQI_BAD LINK_ESTIMATOR_CONF_LQI_BAD
+#else
+#define LINK_ESTIMATOR_LQI_BAD 70
+#endif
+
+/** RSSI, as reported by the radio, below which a link is considered
+    as bad as possible before any transmission has been made. */
+#ifdef LINK_ESTIMATOR_CONF_RSSI_WEAK
+#define LINK_ESTIMATOR_RSSI_WEAK LINK_ESTIMATOR_CONF_RSSI_WEAK
+#else
+#define LINK_ESTIMATOR_RSSI_WEAK -15
+#endif
+
+/** The ETX is a fixed point value; divide by this to get an integer. */
+#define LINK_ESTIMATOR_ETX_DIVISOR 128
+
+/** Upper bound of the ETX, in transmissions. */
+#define LINK_ESTIMATOR_ETX_LIMIT   15
+
+/**
+ * \brief      A function called when the estimate of a link changes
+ * \param addr The address of the neighbor
+ * \param etx  The new ETX, in units of 1/LINK_ESTIMATOR_ETX_DIVISOR
+ */
+typedef void (* link_estimator_callback_t)(const rimeaddr_t *addr,
+                                           uint16_t etx);
+
+/**
+ * \brief      A listener of link estimate changes
+ */
+struct link_estimator_listener {
+  struct link_estimator_listener *next;
+  link_estimator_callback_t callback;
+};
+
+/**
+ * \brief      Register a listener of link estimate changes
+ * \param l    A pointer to a listener with its callback set
+ *
+ *             Listeners are called when the ETX of a neighbor has
+ *             changed by a quarter of a transmission or more.
+ */
+void link_estimator_add_listener(struct link_estimator_listener *l);
+
+/**
+ * \brief      Report the result of a unicast transmission
+ * \param dest The link-layer address of the receiver
+ * \param status The MAC status code of the transmission
+ * \param numtx The number of transmissions made
+ */
+void link_estimator_packet_sent(const rimeaddr_t *dest, int status,
+                                int numtx);
+
+/**
+ * \brief      Report a packet received from a neighbor
+ * \param src  The link-layer address of the sender
+ *
+ *             The RSSI and LQI of the packet are read from the packetbuf
+ *             attributes set by the radio driver.
+ */
+void link_estimator_packet_received(const rimeaddr_t *src);
+
+/**
+ * \brief      Get the ETX of the link to a neighbor
+ * \param addr The link-layer address of the neighbor
+ * \return     The ETX, in units of 1/LINK_ESTIMATOR_ETX_DIVISOR
+ *
+ *             The ETX limit is returned for unknown neighbors.
+ */
+uint16_t link_estimator_get_etx(const rimeaddr_t *addr);
+
+/**
+ * \brief      Get the number of transmissions the estimate is based on
+ * \param addr The link-layer address of the neighbor
+ * \return     The number of transmission results, saturated at 255
+ */
+uint8_t link_estimator_num_samples(const rimeaddr_t *addr);
+
+/**
+ * \brief      Remove a neighbor from the table
+ * \param addr The link-layer address of the neighbor
+ *
+ *             When the table is full, the neighbor that has been silent
+ *             for the longest time is replaced without notice.
+ */
+void link_estimator_remove(const rimeaddr_t *addr);
+
+#endif /* __LINK_ESTIMATOR_H__ */
@@ -45,6 +45,7 @@
 #include "dev/watchdog.h"
 #include "lib/random.h"
 #include "net/mac/contikimac.h"
+#include "net/mac/phase.h"
 #include "net/netstack.h"
 #include "net/rime.h"
 #include "sys/compower.h"
@@ -82,13 +83,19 @@
 #define RDC_CONF_MCU_SLEEP           0
 #endif
 
-#if NETSTACK_RDC_CHANNEL_CHECK_RATE >= 64
+/* Above 64 Hz, the phase of a neighbor cannot be predicted accurately
+   enough without drift compensation for phase optimization to pay off. */
+#if NETSTACK_RDC_CHANNEL_CHECK_RATE >= 64 && !PHASE_DRIFT_CORRECT
 #undef WITH_PHASE_OPTIMIZATION
 #define WITH_PHASE_OPTIMIZATION 0
 #endif
 
 #if WITH_CONTIKIMAC_HEADER
 #define CONTIKIMAC_ID 0x00
+/* In bulk mode, the id has the highest bit set and the number of
+   frames that will follow in its lower bits. */
+#define CONTIKIMAC_ID_BULK 0x80
+#define CONTIKIMAC_BULK_FRAMES_MAX 0x7f
 
 struct hdr {
   uint8_t id;
@@ -123,6 +130,25 @@ static int is_receiver_awake = 0;
    next packet of a burst when FRAME_PENDING is set. */
 #define INTER_PACKET_DEADLINE               CLOCK_SECOND / 32
 
+#if WITH_CONTIKIMAC_HEADER
+/* Are we in a bulk transfer with bulk_peer? Both radios then stay on
+   until the announced frames have been sent, or until no frame has
+   been exchanged for BULK_IDLE_TIME. */
+static uint8_t we_are_in_bulk = 0;
+static rimeaddr_t bulk_peer;
+/* Frames left to send in the bulk transfer we have started. */
+static uint8_t bulk_tx_frames = 0;
+static struct ctimer bulk_ctimer;
+
+#ifdef CONTIKIMAC_CONF_BULK_IDLE_TIME
+#define BULK_IDLE_TIME                      CONTIKIMAC_CONF_BULK_IDLE_TIME
+#else
+#define BULK_IDLE_TIME                      CLOCK_SECOND / 4
+#endif
+#else /* WITH_CONTIKIMAC_HEADER */
+#define we_are_in_bulk                      0
+#endif /* WITH_CONTIKIMAC_HEADER */
+
 /* ContikiMAC performs periodic channel checks. Each channel check
    consists of two or more CCA checks. CCA_COUNT_MAX is the number of
    CCAs to be done for each periodic channel check. The default is
@@ -187,8 +213,10 @@ static int is_receiver_awake = 0;
 #define AFTER_ACK_DETECTECT_WAIT_TIME      RTIMER_ARCH_SECOND / 1500
 
 /* MAX_PHASE_STROBE_TIME is the time that we transmit repeated packets
-   to a neighbor for which we have a phase lock. */
-#define MAX_PHASE_STROBE_TIME              RTIMER_ARCH_SECOND / 60
+   to a neighbor for which we have a phase lock. At high channel check
+   rates it is limited to half a cycle. */
+#define MAX_PHASE_STROBE_TIME              (CYCLE_TIME / 2 < RTIMER_ARCH_SECOND / 60 ? \
+                                            CYCLE_TIME / 2 : RTIMER_ARCH_SECOND / 60)
 
 
 /* SHORTEST_PACKET_SIZE is the shortest packet that ContikiMAC
@@ -233,8 +261,6 @@ static struct compower_activity current_packet;
 
 #if WITH_PHASE_OPTIMIZATION
 
-#include "net/mac/phase.h"
-
 #ifdef CONTIKIMAC_CONF_MAX_PHASE_NEIGHBORS
 #define MAX_PHASE_NEIGHBORS CONTIKIMAC_CONF_MAX_PHASE_NEIGHBORS
 #endif
@@ -337,7 +363,8 @@ powercycle_turn_radio_off(void)
   uint8_t was_on = radio_is_on;
 #endif /* CONTIKIMAC_CONF_COMPOWER */
   
-  if(we_are_sending == 0 && we_are_receiving_burst == 0) {
+  if(we_are_sending == 0 && we_are_receiving_burst == 0 &&
+     we_are_in_bulk == 0) {
     off();
 #if CONTIKIMAC_CONF_COMPOWER
     if(was_on && !radio_is_on) {
@@ -350,7 +377,8 @@ powercycle_turn_radio_off(void)
 static void
 powercycle_turn_radio_on(void)
 {
-  if(we_are_sending == 0 && we_are_receiving_burst == 0) {
+  if(we_are_sending == 0 && we_are_receiving_burst == 0 &&
+     we_are_in_bulk == 0) {
     on();
   }
 }
@@ -397,7 +425,8 @@ powercycle(struct rtimer *t, void *ptr)
 
     for(count = 0; count < CCA_COUNT_MAX; ++count) {
       t0 = RTIMER_NOW();
-      if(we_are_sending == 0 && we_are_receiving_burst == 0) {
+      if(we_are_sending == 0 && we_are_receiving_burst == 0 &&
+         we_are_in_bulk == 0) {
         powercycle_turn_radio_on();
         /* Check if a packet is seen in the air. If so, we keep the
              radio on for a while (LISTEN_TIME_AFTER_PACKET_DETECTED) to
@@ -497,6 +526,31 @@ powercycle(struct rtimer *t, void *ptr)
   PT_END(&pt);
 }
 /*---------------------------------------------------------------------------*/
+#if WITH_CONTIKIMAC_HEADER
+static void
+bulk_off(void *ptr)
+{
+  PRINTF("contikimac: bulk off\n");
+  we_are_in_bulk = 0;
+  ctimer_stop(&bulk_ctimer);
+  if(we_are_sending == 0) {
+    off();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+bulk_on(const rimeaddr_t *peer)
+{
+  if(!we_are_in_bulk || !rimeaddr_cmp(peer, &bulk_peer)) {
+    PRINTF("contikimac: bulk on with %d.%d\n", peer->u8[0], peer->u8[1]);
+    rimeaddr_copy(&bulk_peer, peer);
+    we_are_in_bulk = 1;
+  }
+  on();
+  ctimer_set(&bulk_ctimer, BULK_IDLE_TIME, bulk_off, NULL);
+}
+#endif /* WITH_CONTIKIMAC_HEADER */
+/*---------------------------------------------------------------------------*/
 static int
 broadcast_rate_drop(void)
 {
@@ -534,8 +588,10 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr, struct rdc_buf_
   int ret;
   uint8_t contikimac_was_on;
   uint8_t seqno;
+  uint8_t receiver_awake;
 #if WITH_CONTIKIMAC_HEADER
   struct hdr *chdr;
+  uint8_t is_bulk = 0;
 #endif /* WITH_CONTIKIMAC_HEADER */
 
  /* Exit if RDC and radio were explicitly turned off */
@@ -589,6 +645,13 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr, struct rdc_buf_
   chdr = packetbuf_hdrptr();
   chdr->id = CONTIKIMAC_ID;
   chdr->len = hdrlen;
+  if(!is_broadcast && bulk_tx_frames > 0 &&
+     rimeaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER), &bulk_peer)) {
+    /* Announce the frames that follow this one. */
+    is_bulk = 1;
+    chdr->id = CONTIKIMAC_ID_BULK |
+      MIN(bulk_tx_frames - 1, CONTIKIMAC_BULK_FRAMES_MAX);
+  }
   
   /* Create the MAC header for the data packet. */
   hdrlen = NETSTACK_FRAMER.create();
@@ -631,7 +694,16 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr, struct rdc_buf_
   /* Remove the MAC-layer header since it will be recreated next time around. */
   packetbuf_hdr_remove(hdrlen);
 
-  if(!is_broadcast && !is_receiver_awake) {
+  receiver_awake = is_receiver_awake;
+#if WITH_CONTIKIMAC_HEADER
+  /* A receiver in a bulk transfer with us keeps its radio on. */
+  if(we_are_in_bulk && !is_broadcast &&
+     rimeaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER), &bulk_peer)) {
+    receiver_awake = 1;
+  }
+#endif /* WITH_CONTIKIMAC_HEADER */
+
+  if(!is_broadcast && !receiver_awake) {
 #if WITH_PHASE_OPTIMIZATION
     ret = phase_wait(&phase_list, packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
                      CYCLE_TIME, GUARD_TIME,
@@ -684,7 +756,7 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr, struct rdc_buf_
 #if !RDC_CONF_HARDWARE_CSMA
     /* Check if there are any transmissions by others. */
     /* TODO: why does this give collisions before sending with the mc1322x? */
-  if(is_receiver_awake == 0) {
+  if(receiver_awake == 0) {
 	int i;
     for(i = 0; i < CCA_COUNT_MAX_TX; ++i) {
       t0 = RTIMER_NOW();
@@ -729,7 +801,7 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr, struct rdc_buf_
 
     watchdog_periodic();
 
-    if((is_receiver_awake || is_known_receiver) && !RTIMER_CLOCK_LT(RTIMER_NOW(), t0 + MAX_PHASE_STROBE_TIME)) {
+    if((receiver_awake || is_known_receiver) && !RTIMER_CLOCK_LT(RTIMER_NOW(), t0 + MAX_PHASE_STROBE_TIME)) {
       PRINTF("miss to %d\n", packetbuf_addr(PACKETBUF_ADDR_RECEIVER)->u8[0]);
       break;
     }
@@ -822,6 +894,27 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr, struct rdc_buf_
     ret = MAC_TX_OK;
   }
 
+#if WITH_CONTIKIMAC_HEADER
+  if(is_bulk) {
+    if(ret == MAC_TX_OK) {
+      /* The receiver has acknowledged the announcement, and keeps its
+         radio on until the last frame. */
+      bulk_tx_frames--;
+      if(bulk_tx_frames > 0) {
+        bulk_on(packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
+      } else {
+        bulk_off(NULL);
+      }
+    } else if(we_are_in_bulk) {
+      /* Fall back to duty cycling. The next frame wakes the receiver up
+         and announces the transfer again. */
+      bulk_off(NULL);
+    }
+  } else if(we_are_in_bulk) {
+    on();
+  }
+#endif /* WITH_CONTIKIMAC_HEADER */
+
 #if WITH_PHASE_OPTIMIZATION
 
   if(is_known_receiver && got_strobe_ack) {
@@ -830,7 +923,7 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr, struct rdc_buf_
   }
 
   if(!is_broadcast) {
-    if(collisions == 0 && is_receiver_awake == 0) {
+    if(collisions == 0 && receiver_awake == 0) {
       phase_update(&phase_list, packetbuf_addr(PACKETBUF_ADDR_RECEIVER), encounter_time,
                    ret);
     }
@@ -902,7 +995,9 @@ qsend_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
 static void
 recv_burst_off(void *ptr)
 {
-  off();
+  if(!we_are_in_bulk) {
+    off();
+  }
   we_are_receiving_burst = 0;
 }
 /*---------------------------------------------------------------------------*/
@@ -910,7 +1005,7 @@ static void
 input_packet(void)
 {
   static struct ctimer ct;
-  if(!we_are_receiving_burst) {
+  if(!we_are_receiving_burst && !we_are_in_bulk) {
     off();
   }
 
@@ -921,7 +1016,7 @@ input_packet(void)
 #if WITH_CONTIKIMAC_HEADER
     struct hdr *chdr;
     chdr = packetbuf_dataptr();
-    if(chdr->id != CONTIKIMAC_ID) {
+    if(chdr->id != CONTIKIMAC_ID && (chdr->id & CONTIKIMAC_ID_BULK) == 0) {
       PRINTF("contikimac: failed to parse hdr (%u)\n", packetbuf_totlen());
       return;
     }
@@ -938,6 +1033,21 @@ input_packet(void)
       /* This is a regular packet that is destined to us or to the
          broadcast address. */
 
+#if WITH_CONTIKIMAC_HEADER
+      /* A bulk frame tells how many frames follow. We stay on until
+         the last one, and refresh the idle timeout on each frame. */
+      if(chdr->id & CONTIKIMAC_ID_BULK) {
+        if((chdr->id & CONTIKIMAC_BULK_FRAMES_MAX) > 0) {
+          bulk_on(packetbuf_addr(PACKETBUF_ADDR_SENDER));
+        } else {
+          bulk_off(NULL);
+        }
+      } else if(we_are_in_bulk &&
+                rimeaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_SENDER), &bulk_peer)) {
+        bulk_on(&bulk_peer);
+      }
+#endif /* WITH_CONTIKIMAC_HEADER */
+
       /* If FRAME_PENDING is set, we are receiving a packets in a burst */
       we_are_receiving_burst = packetbuf_attr(PACKETBUF_ATTR_PENDING);
       if(we_are_receiving_burst) {
@@ -945,7 +1055,9 @@ input_packet(void)
         /* Set a timer to turn the radio off in case we do not receive a next packet */
         ctimer_set(&ct, INTER_PACKET_DEADLINE, recv_burst_off, NULL);
       } else {
-        off();
+        if(!we_are_in_bulk) {
+          off();
+        }
         ctimer_stop(&ct);
       }
 
@@ -1056,6 +1168,33 @@ const struct rdc_driver contikimac_driver = {
   duty_cycle,
 };
 /*---------------------------------------------------------------------------*/
+void
+contikimac_bulk_start(const rimeaddr_t *neighbor, uint8_t frames)
+{
+#if WITH_CONTIKIMAC_HEADER
+  if(frames == 0) {
+    contikimac_bulk_stop();
+    return;
+  }
+  if(we_are_in_bulk && !rimeaddr_cmp(neighbor, &bulk_peer)) {
+    bulk_off(NULL);
+  }
+  rimeaddr_copy(&bulk_peer, neighbor);
+  bulk_tx_frames = frames;
+#endif /* WITH_CONTIKIMAC_HEADER */
+}
+/*---------------------------------------------------------------------------*/
+void
+contikimac_bulk_stop(void)
+{
+#if WITH_CONTIKIMAC_HEADER
+  bulk_tx_frames = 0;
+  if(we_are_in_bulk) {
+    bulk_off(NULL);
+  }
+#endif /* WITH_CONTIKIMAC_HEADER */
+}
+/*---------------------------------------------------------------------------*/
 uint16_t
 contikimac_debug_print(void)
 {
@@ -44,7 +44,28 @@
 #include "sys/rtimer.h"
 #include "net/mac/rdc.h"
 #include "dev/radio.h"
+#include "net/rime/rimeaddr.h"
 
 extern const struct rdc_driver contikimac_driver;
 
+/**
+ * \brief      Start a bulk transfer to a neighbor
+ * \param neighbor The receiver of the transfer
+ * \param frames The number of unicast frames of the transfer
+ *
+ *             The next frames sent to the neighbor announce how many
+ *             frames follow. Once the first one is acknowledged, both
+ *             radios stay on and the next frames are sent without
+ *             waking the neighbor up. Duty cycling resumes after the
+ *             last frame, after a failed transmission, or when no
+ *             frame has been exchanged for CONTIKIMAC_CONF_BULK_IDLE_TIME.
+ *             This requires the ContikiMAC header on both nodes.
+ */
+void contikimac_bulk_start(const rimeaddr_t *neighbor, uint8_t frames);
+
+/**
+ * \brief      Stop the bulk transfer and resume duty cycling
+ */
+void contikimac_bulk_stop(void);
+
 #endif /* CONTIKIMAC_H */
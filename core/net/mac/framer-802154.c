@@ -87,42 +87,25 @@ is_broadcast_addr(uint8_t mode, uint8_t *addr)
   return 1;
 }
 /*---------------------------------------------------------------------------*/
-static int
-create(void)
+static void
+init_params(frame802154_t *params)
 {
-  frame802154_t params;
-  uint8_t len;
-
   /* init to zeros */
-  memset(&params, 0, sizeof(params));
-
-  if(!initialized) {
-    initialized = 1;
-    mac_dsn = random_rand() & 0xff;
-  }
+  memset(params, 0, sizeof(*params));
 
   /* Build the FCF. */
-  params.fcf.frame_type = FRAME802154_DATAFRAME;
-  params.fcf.security_enabled = 0;
-  params.fcf.frame_pending = packetbuf_attr(PACKETBUF_ATTR_PENDING);
+  params->fcf.frame_type = FRAME802154_DATAFRAME;
+  params->fcf.security_enabled = 0;
+  params->fcf.frame_pending = packetbuf_attr(PACKETBUF_ATTR_PENDING);
   if(rimeaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER), &rimeaddr_null)) {
-    params.fcf.ack_required = 0;
+    params->fcf.ack_required = 0;
   } else {
-    params.fcf.ack_required = packetbuf_attr(PACKETBUF_ATTR_MAC_ACK);
+    params->fcf.ack_required = packetbuf_attr(PACKETBUF_ATTR_MAC_ACK);
   }
-  params.fcf.panid_compression = 0;
+  params->fcf.panid_compression = 0;
 
   /* Insert IEEE 802.15.4 (2003) version bit. */
-  params.fcf.frame_version = FRAME802154_IEEE802154_2003;
-
-  /* Increment and set the data sequence number. */
-  if(packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO)) {
-    params.seq = packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO);
-  } else {
-    params.seq = mac_dsn++;
-    packetbuf_set_attr(PACKETBUF_ATTR_MAC_SEQNO, params.seq);
-  }
-/*   params.seq = packetbuf_attr(PACKETBUF_ATTR_PACKET_ID); */
+  params->fcf.frame_version = FRAME802154_IEEE802154_2003;
 
   /* Complete the addressing fields. */
   /**
@@ -131,11 +114,11 @@ create(void)
   */
   if(sizeof(rimeaddr_t) == 2) {
     /* Use short address mode if rimeaddr size is short. */
-    params.fcf.src_addr_mode = FRAME802154_SHORTADDRMODE;
+    params->fcf.src_addr_mode = FRAME802154_SHORTADDRMODE;
   } else {
-    params.fcf.src_addr_mode = FRAME802154_LONGADDRMODE;
+    params->fcf.src_addr_mode = FRAME802154_LONGADDRMODE;
   }
-  params.dest_pid = mac_dst_pan_id;
+  params->dest_pid = mac_dst_pan_id;
 
   /*
    *  If the output address is NULL in the Rime buf, then it is broadcast
@@ -143,29 +126,52 @@ create(void)
    */
   if(rimeaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER), &rimeaddr_null)) {
     /* Broadcast requires short address mode. */
-    params.fcf.dest_addr_mode = FRAME802154_SHORTADDRMODE;
-    params.dest_addr[0] = 0xFF;
-    params.dest_addr[1] = 0xFF;
+    params->fcf.dest_addr_mode = FRAME802154_SHORTADDRMODE;
+    params->dest_addr[0] = 0xFF;
+    params->dest_addr[1] = 0xFF;
 
   } else {
-    rimeaddr_copy((rimeaddr_t *)&params.dest_addr,
+    rimeaddr_copy((rimeaddr_t *)&params->dest_addr,
                   packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
     /* Use short address mode if rimeaddr size is small */
     if(sizeof(rimeaddr_t) == 2) {
-      params.fcf.dest_addr_mode = FRAME802154_SHORTADDRMODE;
+      params->fcf.dest_addr_mode = FRAME802154_SHORTADDRMODE;
     } else {
-      params.fcf.dest_addr_mode = FRAME802154_LONGADDRMODE;
+      params->fcf.dest_addr_mode = FRAME802154_LONGADDRMODE;
     }
   }
 
   /* Set the source PAN ID to the global variable. */
-  params.src_pid = mac_src_pan_id;
+  params->src_pid = mac_src_pan_id;
 
   /*
    * Set up the source address using only the long address mode for
    * phase 1.
    */
-  rimeaddr_copy((rimeaddr_t *)&params.src_addr, &rimeaddr_node_addr);
+  rimeaddr_copy((rimeaddr_t *)&params->src_addr, &rimeaddr_node_addr);
+}
+/*---------------------------------------------------------------------------*/
+static int
+create(void)
+{
+  frame802154_t params;
+  uint8_t len;
+
+  if(!initialized) {
+    initialized = 1;
+    mac_dsn = random_rand() & 0xff;
+  }
+
+  init_params(&params);
+
+  /* Increment and set the data sequence number. */
+  if(packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO)) {
+    params.seq = packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO);
+  } else {
+    params.seq = mac_dsn++;
+    packetbuf_set_attr(PACKETBUF_ATTR_MAC_SEQNO, params.seq);
+  }
+/*   params.seq = packetbuf_attr(PACKETBUF_ATTR_PACKET_ID); */
 
   params.payload = packetbuf_dataptr();
   params.payload_len = packetbuf_datalen();
@@ -185,6 +191,15 @@ create(void)
 }
 /*---------------------------------------------------------------------------*/
 static int
+length(void)
+{
+  frame802154_t params;
+
+  init_params(&params);
+  return frame802154_hdrlen(&params);
+}
+/*---------------------------------------------------------------------------*/
+static int
 parse(void)
 {
   frame802154_t frame;
@@ -219,5 +234,5 @@ parse(void)
 }
 /*---------------------------------------------------------------------------*/
 const struct framer framer_802154 = {
-  create, parse
+  create, parse, length
 };
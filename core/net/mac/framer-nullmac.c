@@ -91,6 +91,12 @@ parse(void)
   return FRAMER_FAILED;
 }
 /*---------------------------------------------------------------------------*/
+static int
+length(void)
+{
+  return sizeof(struct nullmac_hdr);
+}
+/*---------------------------------------------------------------------------*/
 const struct framer framer_nullmac = {
-  create, parse
+  create, parse, length
 };
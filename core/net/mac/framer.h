@@ -49,6 +49,10 @@ struct framer {
   int (* create)(void);
   int (* parse)(void);
 
+  /** Length of the header that create() would add for the packet in
+      the packetbuf, or FRAMER_FAILED. The packetbuf is not modified. */
+  int (* length)(void);
+
 };
 
 #endif /* __FRAMER_H__ */
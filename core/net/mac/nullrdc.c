@@ -43,6 +43,7 @@
 #include "net/packetbuf.h"
 #include "net/queuebuf.h"
 #include "net/netstack.h"
+#include "lib/list.h"
 #include <string.h>
 
 #define DEBUG 0
@@ -100,8 +101,8 @@ static struct seqno received_seqnos[MAX_SEQNOS];
 #endif /* NULLRDC_802154_AUTOACK || NULLRDC_802154_AUTOACK_HW */
 
 /*---------------------------------------------------------------------------*/
-static void
-send_packet(mac_callback_t sent, void *ptr)
+static int
+send_one_packet(void)
 {
   int ret;
   packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &rimeaddr_node_addr);
@@ -199,15 +200,36 @@ send_packet(mac_callback_t sent, void *ptr)
 
 #endif /* ! NULLRDC_802154_AUTOACK */
   }
-  mac_call_sent_callback(sent, ptr, ret, 1);
+  return ret;
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_packet(mac_callback_t sent, void *ptr)
+{
+  mac_call_sent_callback(sent, ptr, send_one_packet(), 1);
 }
 /*---------------------------------------------------------------------------*/
 static void
 send_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
 {
-  if(buf_list != NULL) {
+  struct rdc_buf_list *next;
+  int ret;
+
+  /* Stream the packets of the list, such as the fragments of a
+     datagram, until one of them fails. The callback may free the
+     packet that was just sent, so the next one is looked up first. */
+  while(buf_list != NULL) {
+    next = list_item_next(buf_list);
     queuebuf_to_packetbuf(buf_list->buf);
-    send_packet(sent, ptr);
+    if(next != NULL) {
+      packetbuf_set_attr(PACKETBUF_ATTR_PENDING, 1);
+    }
+    ret = send_one_packet();
+    mac_call_sent_callback(sent, ptr, ret, 1);
+    if(ret != MAC_TX_OK) {
+      break;
+    }
+    buf_list = next;
   }
 }
 /*---------------------------------------------------------------------------*/
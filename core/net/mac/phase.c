@@ -46,6 +46,8 @@
 #include "dev/watchdog.h"
 #include "dev/leds.h"
 
+#include <string.h>
+
 struct phase_queueitem {
   struct ctimer timer;
   mac_callback_t mac_callback;
@@ -72,12 +74,42 @@ MEMB(queued_packets_memb, struct phase_queueitem, PHASE_QUEUESIZE);
 #define PRINTF(...)
 #define PRINTDEBUG(...)
 #endif
+#if PHASE_DRIFT_CORRECT
+/* The drift is estimated in rtimer ticks per DRIFT_UNIT clock ticks,
+   scaled by DRIFT_SCALE. Samples older than DRIFT_MAX_AGE units, or
+   more than DRIFT_MAX_JUMP rtimer ticks off the newest sample, are
+   dropped: the neighbor has probably rebooted. These bounds keep the
+   least-squares sums within 32 bits. */
+#if CLOCK_SECOND >= 8
+#define DRIFT_UNIT            (CLOCK_SECOND / 8)
+#else
+#define DRIFT_UNIT            1
+#endif
+#define DRIFT_SCALE           32
+#define DRIFT_MAX_AGE         1024
+#define DRIFT_MAX_JUMP        (RTIMER_ARCH_SECOND / 128 < 256 ? \
+                               RTIMER_ARCH_SECOND / 128 : 256)
+#define DRIFT_UNKNOWN         0x7fff
+#endif /* PHASE_DRIFT_CORRECT */
+/*---------------------------------------------------------------------------*/
+static uint8_t
+hash(const rimeaddr_t *addr)
+{
+  uint8_t h;
+  uint8_t i;
+
+  h = 0;
+  for(i = 0; i < sizeof(rimeaddr_t); i++) {
+    h ^= addr->u8[i];
+  }
+  return h & (PHASE_HASH_SIZE - 1);
+}
 /*---------------------------------------------------------------------------*/
 struct phase *
 find_neighbor(const struct phase_list *list, const rimeaddr_t *addr)
 {
   struct phase *e;
-  for(e = list_head(*list->list); e != NULL; e = list_item_next(e)) {
+  for(e = list->index[hash(addr)]; e != NULL; e = e->hash_next) {
     if(rimeaddr_cmp(addr, &e->neighbor)) {
       return e;
     }
@@ -85,13 +117,109 @@ find_neighbor(const struct phase_list *list, const rimeaddr_t *addr)
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
+static void
+unlink_neighbor(const struct phase_list *list, struct phase *e)
+{
+  struct phase **p;
+
+  for(p = &list->index[hash(&e->neighbor)]; *p != NULL; p = &(*p)->hash_next) {
+    if(*p == e) {
+      *p = e->hash_next;
+      break;
+    }
+  }
+  list_remove(*list->list, e);
+}
+/*---------------------------------------------------------------------------*/
+#if PHASE_DRIFT_CORRECT
+static void
+add_sample(struct phase *e, rtimer_clock_t time)
+{
+  e->sample_time[e->sample_next] = clock_time();
+  e->sample_phase[e->sample_next] = time;
+  e->sample_next = (e->sample_next + 1) % PHASE_DRIFT_SAMPLES;
+  if(e->samples < PHASE_DRIFT_SAMPLES) {
+    e->samples++;
+  }
+  e->drift = DRIFT_UNKNOWN;
+}
+/*---------------------------------------------------------------------------*/
+static int16_t
+phase_offset(rtimer_clock_t diff, rtimer_clock_t cycle_time)
+{
+  diff %= cycle_time;
+  if(diff > cycle_time / 2) {
+    return (int16_t)diff - (int16_t)cycle_time;
+  }
+  return diff;
+}
+/*---------------------------------------------------------------------------*/
+static void
+estimate_drift(struct phase *e, rtimer_clock_t cycle_time)
+{
+  int32_t sx, sy, sxx, sxy;
+  int32_t num, den;
+  clock_time_t age;
+  int16_t x, y;
+  uint8_t newest, i, n;
+
+  /* Walk the samples from the newest one. The x axis is the time
+     relative to the newest sample, and the y axis the phase relative
+     to it: the slope is the drift of the neighbor. */
+  newest = (e->sample_next + PHASE_DRIFT_SAMPLES - 1) % PHASE_DRIFT_SAMPLES;
+  sx = sy = sxx = sxy = 0;
+  for(n = 0; n < e->samples; n++) {
+    i = (newest + PHASE_DRIFT_SAMPLES - n) % PHASE_DRIFT_SAMPLES;
+    age = (e->sample_time[newest] - e->sample_time[i]) / DRIFT_UNIT;
+    y = phase_offset(e->sample_phase[i] - e->sample_phase[newest], cycle_time);
+    if(age > DRIFT_MAX_AGE || y > DRIFT_MAX_JUMP || y < -DRIFT_MAX_JUMP) {
+      break;
+    }
+    x = -(int16_t)age;
+    sx += x;
+    sy += y;
+    sxx += (int32_t)x * x;
+    sxy += (int32_t)x * y;
+  }
+  /* Older samples are no longer consistent with the newest ones. */
+  e->samples = n;
+
+  den = n * sxx - sx * sx;
+  if(n < 2 || den == 0) {
+    e->drift = 0;
+    return;
+  }
+  num = n * sxy - sx * sy;
+  e->drift = num * DRIFT_SCALE / den;
+  PRINTF("phase drift %d/%d per %u ticks from %u samples\n",
+         e->drift, DRIFT_SCALE, (unsigned)DRIFT_UNIT, n);
+}
+/*---------------------------------------------------------------------------*/
+static rtimer_clock_t
+predict_phase(struct phase *e, rtimer_clock_t cycle_time)
+{
+  clock_time_t elapsed;
+
+  if(e->drift == DRIFT_UNKNOWN) {
+    estimate_drift(e, cycle_time);
+  }
+  elapsed = (clock_time() -
+             e->sample_time[(e->sample_next + PHASE_DRIFT_SAMPLES - 1) %
+                            PHASE_DRIFT_SAMPLES]) / DRIFT_UNIT;
+  if(elapsed > DRIFT_MAX_AGE) {
+    elapsed = DRIFT_MAX_AGE;
+  }
+  return e->time + (int32_t)e->drift * (int16_t)elapsed / DRIFT_SCALE;
+}
+#endif /* PHASE_DRIFT_CORRECT */
+/*---------------------------------------------------------------------------*/
 void
 phase_remove(const struct phase_list *list, const rimeaddr_t *neighbor)
 {
   struct phase *e;
   e = find_neighbor(list, neighbor);
   if(e != NULL) {
-    list_remove(*list->list, e);
+    unlink_neighbor(list, e);
     memb_free(list->memb, e);
   }
 }
@@ -108,7 +236,7 @@ phase_update(const struct phase_list *list,
   if(e != NULL) {
     if(mac_status == MAC_TX_OK) {
 #if PHASE_DRIFT_CORRECT
-      e->drift = time-e->time;
+      add_sample(e, time);
 #endif
       e->time = time;
     }
@@ -123,7 +251,7 @@ phase_update(const struct phase_list *list,
       }
       if(e->noacks >= MAX_NOACKS || timer_expired(&e->noacks_timer)) {
         PRINTF("drop %d\n", neighbor->u8[0]);
-        list_remove(*list->list, e);
+        unlink_neighbor(list, e);
         memb_free(list->memb, e);
         return;
       }
@@ -138,15 +266,20 @@ phase_update(const struct phase_list *list,
         PRINTF("phase alloc NULL\n");
         /* We could not allocate memory for this phase, so we drop
            the last item on the list and reuse it for our phase. */
-        e = list_chop(*list->list);
+        e = list_tail(*list->list);
+        unlink_neighbor(list, e);
       }
       rimeaddr_copy(&e->neighbor, neighbor);
       e->time = time;
 #if PHASE_DRIFT_CORRECT
-      e->drift = 0;
+      e->samples = 0;
+      e->sample_next = 0;
+      add_sample(e, time);
 #endif
       e->noacks = 0;
       list_push(*list->list, e);
+      e->hash_next = list->index[hash(neighbor)];
+      list->index[hash(neighbor)] = e;
     }
   }
 }
@@ -204,14 +337,9 @@ phase_wait(struct phase_list *list,
     sync = (e == NULL) ? now : e->time;
 
 #if PHASE_DRIFT_CORRECT
-    {
-      int32_t s;
-      if(e->drift > cycle_time) {
-        s = e->drift % cycle_time / (e->drift / cycle_time);  /* drift per cycle */
-        s = s * (now - sync) / cycle_time;                    /* estimated drift to now */
-        sync += s;                                            /* add it in */
-      }
-    }
+    /* Move the last observed phase by the drift of the neighbor since
+       then. */
+    sync = predict_phase(e, cycle_time);
 #endif
 
     /* Check if cycle_time is a power of two */
@@ -263,6 +391,7 @@ phase_init(struct phase_list *list)
 {
   list_init(*list->list);
   memb_init(list->memb);
+  memset(list->index, 0, PHASE_HASH_SIZE * sizeof(struct phase *));
   memb_init(&queued_packets_memb);
 }
 /*---------------------------------------------------------------------------*/
@@ -47,18 +47,42 @@
 #include "lib/memb.h"
 #include "net/netstack.h"
 
-#if PHASE_CONF_DRIFT_CORRECT
+#ifdef PHASE_CONF_DRIFT_CORRECT
 #define PHASE_DRIFT_CORRECT PHASE_CONF_DRIFT_CORRECT
 #else
-#define PHASE_DRIFT_CORRECT 0
+#define PHASE_DRIFT_CORRECT 1
+#endif
+
+/* Number of phase observations the clock drift of a neighbor is
+   estimated from, at most 8. */
+#ifdef PHASE_CONF_DRIFT_SAMPLES
+#define PHASE_DRIFT_SAMPLES PHASE_CONF_DRIFT_SAMPLES
+#else
+#define PHASE_DRIFT_SAMPLES 4
+#endif
+
+/* Number of buckets of the neighbor index, a power of two. */
+#ifdef PHASE_CONF_HASH_SIZE
+#define PHASE_HASH_SIZE PHASE_CONF_HASH_SIZE
+#else
+#define PHASE_HASH_SIZE 16
 #endif
 
 struct phase {
   struct phase *next;
+  struct phase *hash_next;
   rimeaddr_t neighbor;
   rtimer_clock_t time;
 #if PHASE_DRIFT_CORRECT
-  rtimer_clock_t drift;
+  /* Phase observations, in clock ticks and rtimer ticks. The newest
+     one is the same as time. */
+  clock_time_t sample_time[PHASE_DRIFT_SAMPLES];
+  rtimer_clock_t sample_phase[PHASE_DRIFT_SAMPLES];
+  uint8_t samples;
+  uint8_t sample_next;
+  /* Least-squares drift of the samples, computed on the next
+     transmission after a new sample. */
+  int16_t drift;
 #endif
   uint8_t noacks;
   struct timer noacks_timer;
@@ -67,6 +91,7 @@ struct phase {
 struct phase_list {
   list_t *list;
   struct memb *memb;
+  struct phase **index;
 };
 
 typedef enum {
@@ -78,7 +103,9 @@ typedef enum {
 
 #define PHASE_LIST(name, num) LIST(phase_list_list);                              \
                               MEMB(phase_list_memb, struct phase, num);           \
-                              struct phase_list name = { &phase_list_list, &phase_list_memb }
+                              static struct phase *phase_list_index[PHASE_HASH_SIZE]; \
+                              struct phase_list name = { &phase_list_list, &phase_list_memb, \
+                                                         phase_list_index }
 
 void phase_init(struct phase_list *list);
 phase_status_t phase_wait(struct phase_list *list,  const rimeaddr_t *neighbor,
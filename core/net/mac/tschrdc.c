@@ -0,0 +1,841 @@
+/*
+ * Copyright (c) 2012, LCIS/CTSYS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         A time-slotted channel hopping RDC, with a schedule computed
+ *         from the node addresses
+ */
+
+#include "contiki.h"
+#include "net/mac/tschrdc.h"
+#include "net/packetbuf.h"
+#include "net/queuebuf.h"
+#include "net/netstack.h"
+#include "net/rime/rimeaddr.h"
+#include "lib/random.h"
+#include "sys/pt.h"
+#include "sys/rtimer.h"
+#include <string.h>
+
+#ifdef TSCHRDC_CONF_RADIO_H
+#include TSCHRDC_CONF_RADIO_H
+#endif /* TSCHRDC_CONF_RADIO_H */
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+#define US_TO_RTIMER(us) ((rtimer_clock_t)(((uint32_t)(us) * RTIMER_SECOND) / 1000000UL))
+
+/* Length of a slot, in rtimer ticks. */
+#ifdef TSCHRDC_CONF_SLOT_LENGTH
+#define SLOT_LENGTH TSCHRDC_CONF_SLOT_LENGTH
+#else
+#define SLOT_LENGTH US_TO_RTIMER(10000)
+#endif
+
+/* Number of slots of the slotframe. A slotframe must last less than
+   half the rtimer period. */
+#ifdef TSCHRDC_CONF_SLOTFRAME_LENGTH
+#define SLOTFRAME_LENGTH TSCHRDC_CONF_SLOTFRAME_LENGTH
+#else
+#define SLOTFRAME_LENGTH 11
+#endif
+
+#ifdef TSCHRDC_CONF_HOPPING_SEQUENCE
+static const uint8_t hopping_sequence[] = TSCHRDC_CONF_HOPPING_SEQUENCE;
+#else
+/* The 802.15.4 channels that do not overlap Wi-Fi channels 1, 6 and
+   11. */
+static const uint8_t hopping_sequence[] = { 15, 25, 20, 26 };
+#endif
+#define HOPPING_SEQUENCE_LENGTH sizeof(hopping_sequence)
+
+/* Number of frames waiting for their cell. */
+#ifdef TSCHRDC_CONF_QUEUE_SIZE
+#define QUEUE_SIZE TSCHRDC_CONF_QUEUE_SIZE
+#else
+#define QUEUE_SIZE 4
+#endif
+
+/* Mean time between two beacons. */
+#ifdef TSCHRDC_CONF_EB_PERIOD
+#define EB_PERIOD TSCHRDC_CONF_EB_PERIOD
+#else
+#define EB_PERIOD (4 * CLOCK_SECOND)
+#endif
+
+/* Transmissions in the shared cell wait a random number of shared
+   slots, below this window, so that neighbors do not collide. */
+#ifdef TSCHRDC_CONF_SHARED_BACKOFF
+#define SHARED_BACKOFF TSCHRDC_CONF_SHARED_BACKOFF
+#else
+#define SHARED_BACKOFF 4
+#endif
+
+/* The node leaves the network when it has not heard from its time
+   source for this long. */
+#ifdef TSCHRDC_CONF_DESYNC_TIMEOUT
+#define DESYNC_TIMEOUT TSCHRDC_CONF_DESYNC_TIMEOUT
+#else
+#define DESYNC_TIMEOUT (20 * CLOCK_SECOND)
+#endif
+
+/* Time from the call to transmit() to the SFD timestamp of the
+   receivers, with the radio off before the transmission. */
+#ifdef TSCHRDC_CONF_SFD_DELAY
+#define SFD_DELAY TSCHRDC_CONF_SFD_DELAY
+#else
+#define SFD_DELAY US_TO_RTIMER(700)
+#endif
+
+#ifdef TSCHRDC_CONF_SET_CHANNEL
+#define SET_CHANNEL(c) TSCHRDC_CONF_SET_CHANNEL(c)
+#else
+#define SET_CHANNEL(c) ((void)(c))
+#endif
+
+/* The slots are run from the rtimer interrupt, which must not use the
+   radio while a process or another interrupt is using it. The check
+   is made before each access, as the radio may be taken between two
+   parts of a slot. */
+#ifdef TSCHRDC_CONF_RADIO_BUSY
+#define RADIO_BUSY() TSCHRDC_CONF_RADIO_BUSY()
+#else
+#define RADIO_BUSY() 0
+#endif
+
+/* Timing of a slot, from the start of the slot. */
+#define TX_OFFSET      US_TO_RTIMER(2120)
+#define GUARD_TIME     US_TO_RTIMER(1100)
+#define MAX_FRAME_TIME US_TO_RTIMER(4256)
+#define ACK_TIME       US_TO_RTIMER(1400)
+
+#define MAX_FRAME_LEN 127
+
+#define ID_DATA 0x20
+#define ID_EB   0x21
+
+struct hdr {
+  uint8_t id;
+};
+
+struct eb {
+  uint8_t id;
+  uint8_t join_priority;
+  /* ASN of the slot of the beacon, least significant byte first. */
+  uint8_t asn[4];
+};
+
+#define JOIN_PRIORITY_UNKNOWN 0xff
+
+enum {
+  FRAME_FREE,
+  FRAME_QUEUED,
+  FRAME_SENT,
+};
+
+struct tx_frame {
+  mac_callback_t sent;
+  void *ptr;
+  /* The state is changed last, as it hands the frame over between the
+     processes and the slots. */
+  volatile uint8_t state;
+  uint8_t status;
+  /* Shared slots to let go by before sending. */
+  uint8_t backoff;
+  uint8_t timeslot;
+  uint8_t channel_offset;
+  uint8_t len;
+  uint8_t data[MAX_FRAME_LEN];
+};
+
+static struct tx_frame queue[QUEUE_SIZE];
+
+static uint8_t eb_frame[32];
+static uint8_t eb_len;
+static volatile uint8_t eb_pending;
+static uint8_t eb_backoff;
+
+static volatile uint8_t synchronized;
+static volatile uint8_t slots_running;
+static uint8_t is_coordinator;
+static uint8_t join_priority = JOIN_PRIORITY_UNKNOWN;
+static rimeaddr_t time_source;
+static clock_time_t last_sync;
+static uint8_t tsch_is_on;
+static uint8_t keep_radio_on;
+
+/* The next slot to run, and when it starts. */
+static volatile uint32_t asn;
+static uint8_t timeslot;
+static rtimer_clock_t slot_start;
+/* Correction of the slot start, applied at the next slot. */
+static volatile int16_t drift_correction;
+
+/* Our dedicated cell, where we receive unicast frames. */
+static uint8_t rx_timeslot;
+static uint8_t rx_channel_offset;
+
+static struct rtimer rt;
+static struct pt pt;
+
+#ifdef NETSTACK_CONF_MAC_SEQNO_HISTORY
+#define MAX_SEQNOS NETSTACK_CONF_MAC_SEQNO_HISTORY
+#else /* NETSTACK_CONF_MAC_SEQNO_HISTORY */
+#define MAX_SEQNOS 8
+#endif /* NETSTACK_CONF_MAC_SEQNO_HISTORY */
+
+struct seqno {
+  rimeaddr_t sender;
+  uint8_t seqno;
+};
+static struct seqno received_seqnos[MAX_SEQNOS];
+
+PROCESS(tschrdc_process, "TSCH RDC");
+/*---------------------------------------------------------------------------*/
+static void
+dedicated_cell(const rimeaddr_t *addr, uint8_t *ts, uint8_t *channel_offset)
+{
+  uint16_t h;
+  uint8_t i;
+
+  h = 0;
+  for(i = 0; i < sizeof(rimeaddr_t); i++) {
+    h = h * 31 + addr->u8[i];
+  }
+  /* Slot 0 is the shared cell. */
+  *ts = 1 + h % (SLOTFRAME_LENGTH - 1);
+  *channel_offset = (h >> 8) % HOPPING_SEQUENCE_LENGTH;
+}
+/*---------------------------------------------------------------------------*/
+static struct tx_frame *
+frame_for_cell(uint8_t ts)
+{
+  uint8_t i;
+
+  for(i = 0; i < QUEUE_SIZE; i++) {
+    if(queue[i].state == FRAME_QUEUED && queue[i].timeslot == ts) {
+      return &queue[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static int
+is_active(uint8_t ts)
+{
+  return ts == 0 || ts == rx_timeslot || frame_for_cell(ts) != NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Move to the next slot in which we send or listen. */
+static void
+next_slot(void)
+{
+  uint8_t n;
+
+  slot_start += drift_correction;
+  drift_correction = 0;
+
+  n = 0;
+  do {
+    n++;
+    if(++timeslot == SLOTFRAME_LENGTH) {
+      timeslot = 0;
+    }
+  } while(!is_active(timeslot));
+
+  asn += n;
+  slot_start += n * SLOT_LENGTH;
+}
+/*---------------------------------------------------------------------------*/
+static char slot_operation(struct rtimer *t, void *ptr);
+
+static void
+schedule(struct rtimer *t, rtimer_clock_t time)
+{
+  if(RTIMER_CLOCK_LT(time, RTIMER_NOW() + 2)) {
+    time = RTIMER_NOW() + 2;
+  }
+  if(rtimer_set(t, time, 1,
+                (void (*)(struct rtimer *, void *))slot_operation, NULL)
+     != RTIMER_OK) {
+    PRINTF("tschrdc: could not set rtimer\n");
+  }
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+mac_status(int ret)
+{
+  switch(ret) {
+  case RADIO_TX_OK:
+    return MAC_TX_OK;
+  case RADIO_TX_COLLISION:
+    return MAC_TX_COLLISION;
+  case RADIO_TX_NOACK:
+    return MAC_TX_NOACK;
+  default:
+    return MAC_TX_ERR;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static char
+slot_operation(struct rtimer *t, void *ptr)
+{
+  static struct tx_frame *f;
+  static uint8_t send_eb;
+  static uint8_t channel_offset;
+  int ret;
+
+  PT_BEGIN(&pt);
+
+  while(synchronized) {
+    if(tsch_is_on && !RADIO_BUSY()) {
+      send_eb = 0;
+      f = frame_for_cell(timeslot);
+      if(timeslot == 0) {
+        if(eb_pending) {
+          if(eb_backoff > 0) {
+            eb_backoff--;
+          } else {
+            send_eb = 1;
+          }
+        }
+        if(f != NULL && f->backoff > 0) {
+          f->backoff--;
+          f = NULL;
+        }
+        if(send_eb) {
+          f = NULL;
+        }
+      }
+      if(f != NULL) {
+        channel_offset = f->channel_offset;
+      } else if(timeslot == 0) {
+        channel_offset = 0;
+      } else {
+        channel_offset = rx_channel_offset;
+      }
+      SET_CHANNEL(hopping_sequence[(asn + channel_offset) %
+                                   HOPPING_SEQUENCE_LENGTH]);
+
+      if(send_eb || f != NULL) {
+        if(send_eb) {
+          eb_frame[eb_len - 4] = asn & 0xff;
+          eb_frame[eb_len - 3] = (asn >> 8) & 0xff;
+          eb_frame[eb_len - 2] = (asn >> 16) & 0xff;
+          eb_frame[eb_len - 1] = (asn >> 24) & 0xff;
+          NETSTACK_RADIO.prepare(eb_frame, eb_len);
+        } else {
+          NETSTACK_RADIO.prepare(f->data, f->len);
+        }
+
+        schedule(t, slot_start + TX_OFFSET);
+        PT_YIELD(&pt);
+
+        if(!synchronized) {
+          /* We have left the network during the slot; desync() has
+             already failed the frame. */
+        } else if(RADIO_BUSY()) {
+          /* The radio has been taken since the start of the slot: the
+             frame stays queued for its next cell. */
+          PRINTF("tschrdc: radio busy, frame deferred\n");
+        } else if(send_eb) {
+          NETSTACK_RADIO.transmit(eb_len);
+          eb_pending = 0;
+        } else {
+          ret = NETSTACK_RADIO.transmit(f->len);
+          f->status = mac_status(ret);
+          f->state = FRAME_SENT;
+          process_poll(&tschrdc_process);
+        }
+      } else {
+        schedule(t, slot_start + TX_OFFSET - GUARD_TIME);
+        PT_YIELD(&pt);
+
+        NETSTACK_RADIO.on();
+
+        schedule(t, slot_start + TX_OFFSET + GUARD_TIME);
+        PT_YIELD(&pt);
+
+        if(NETSTACK_RADIO.receiving_packet()) {
+          /* Wait for the end of the frame and of our ACK. */
+          schedule(t, slot_start + TX_OFFSET + GUARD_TIME +
+                   MAX_FRAME_TIME + ACK_TIME);
+          PT_YIELD(&pt);
+        }
+
+        if(!keep_radio_on) {
+          NETSTACK_RADIO.off();
+        }
+      }
+    }
+
+    /* Skip the slots that have gone by while we were late. */
+    do {
+      next_slot();
+    } while(RTIMER_CLOCK_LT(slot_start, RTIMER_NOW() + 2));
+
+    schedule(t, slot_start);
+    PT_YIELD(&pt);
+  }
+
+  /* We have left the network: listen for beacons. */
+  slots_running = 0;
+  NETSTACK_RADIO.on();
+
+  PT_END(&pt);
+}
+/*---------------------------------------------------------------------------*/
+static void
+start_slots(void)
+{
+  dedicated_cell(&rimeaddr_node_addr, &rx_timeslot, &rx_channel_offset);
+  drift_correction = 0;
+
+  /* The first slot must not have started yet. */
+  while(RTIMER_CLOCK_LT(slot_start, RTIMER_NOW() + GUARD_TIME)) {
+    next_slot();
+  }
+
+  last_sync = clock_time();
+  synchronized = 1;
+  slots_running = 1;
+  if(!keep_radio_on) {
+    NETSTACK_RADIO.off();
+  }
+
+  PRINTF("tschrdc: synchronized, join priority %u, rx cell %u/%u\n",
+         join_priority, rx_timeslot, rx_channel_offset);
+
+  PT_INIT(&pt);
+  schedule(&rt, slot_start);
+}
+/*---------------------------------------------------------------------------*/
+static void
+resync(rtimer_clock_t sfd_time)
+{
+  int16_t d;
+
+  /* The frame was sent TX_OFFSET after the start of a slot, which is a
+     whole number of slots away from slot_start. */
+  d = (int16_t)(sfd_time - SFD_DELAY - TX_OFFSET - slot_start) %
+    (int16_t)SLOT_LENGTH;
+  if(d > (int16_t)(SLOT_LENGTH / 2)) {
+    d -= SLOT_LENGTH;
+  } else if(d < -(int16_t)(SLOT_LENGTH / 2)) {
+    d += SLOT_LENGTH;
+  }
+
+  if(d > -(int16_t)GUARD_TIME && d < (int16_t)GUARD_TIME) {
+    drift_correction = d;
+    last_sync = clock_time();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+eb_input(const struct eb *eb, rtimer_clock_t sfd_time)
+{
+  const rimeaddr_t *from;
+  uint32_t eb_asn;
+
+  if(is_coordinator || eb->join_priority == JOIN_PRIORITY_UNKNOWN) {
+    return;
+  }
+  from = packetbuf_addr(PACKETBUF_ADDR_SENDER);
+
+  if(!synchronized) {
+    if(slots_running) {
+      /* The slots of the previous network are not over yet. */
+      return;
+    }
+    eb_asn = eb->asn[0] | ((uint32_t)eb->asn[1] << 8) |
+      ((uint32_t)eb->asn[2] << 16) | ((uint32_t)eb->asn[3] << 24);
+    rimeaddr_copy(&time_source, from);
+    join_priority = eb->join_priority + 1;
+    asn = eb_asn;
+    timeslot = eb_asn % SLOTFRAME_LENGTH;
+    slot_start = sfd_time - SFD_DELAY - TX_OFFSET;
+    start_slots();
+  } else if(rimeaddr_cmp(from, &time_source)) {
+    join_priority = eb->join_priority + 1;
+    resync(sfd_time);
+  } else if(eb->join_priority + 1 < join_priority) {
+    /* A neighbor closer to the coordinator. */
+    rimeaddr_copy(&time_source, from);
+    join_priority = eb->join_priority + 1;
+    resync(sfd_time);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+prepare_eb(void)
+{
+  struct eb *eb;
+
+  if(eb_pending) {
+    /* The last one has not been sent yet. */
+    return;
+  }
+
+  packetbuf_clear();
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &rimeaddr_node_addr);
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &rimeaddr_null);
+  eb = packetbuf_dataptr();
+  eb->id = ID_EB;
+  eb->join_priority = join_priority;
+  memset(eb->asn, 0, sizeof(eb->asn));
+  packetbuf_set_datalen(sizeof(struct eb));
+
+  if(NETSTACK_FRAMER.create() < 0 || packetbuf_totlen() > sizeof(eb_frame)) {
+    PRINTF("tschrdc: could not create beacon\n");
+    return;
+  }
+  packetbuf_compact();
+  memcpy(eb_frame, packetbuf_hdrptr(), packetbuf_totlen());
+  eb_len = packetbuf_totlen();
+  eb_backoff = random_rand() % SHARED_BACKOFF;
+  eb_pending = 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+call_sent_callbacks(void)
+{
+  struct tx_frame *f;
+  mac_callback_t sent;
+  void *ptr;
+  uint8_t i;
+
+  for(i = 0; i < QUEUE_SIZE; i++) {
+    f = &queue[i];
+    if(f->state == FRAME_SENT) {
+      /* The callback may queue the next frame. */
+      sent = f->sent;
+      ptr = f->ptr;
+      f->state = FRAME_FREE;
+      mac_call_sent_callback(sent, ptr, f->status, 1);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+desync(void)
+{
+  uint8_t i;
+
+  PRINTF("tschrdc: lost time source\n");
+  synchronized = 0;
+  join_priority = JOIN_PRIORITY_UNKNOWN;
+  eb_pending = 0;
+
+  /* The slots stop, so the queued frames will not be sent: report
+     them as failed, so that the MAC layer does not wait for them. A
+     slot that resumes after this does not transmit, as it checks that
+     we are still synchronized. */
+  for(i = 0; i < QUEUE_SIZE; i++) {
+    if(queue[i].state == FRAME_QUEUED) {
+      queue[i].status = MAC_TX_ERR;
+      queue[i].state = FRAME_SENT;
+    }
+  }
+  call_sent_callbacks();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(tschrdc_process, ev, data)
+{
+  static struct etimer et;
+  static uint8_t scan_channel;
+
+  PROCESS_BEGIN();
+
+  etimer_set(&et, EB_PERIOD / 2 + random_rand() % EB_PERIOD);
+  while(1) {
+    PROCESS_WAIT_EVENT();
+
+    if(ev == PROCESS_EVENT_POLL) {
+      call_sent_callbacks();
+    } else if(ev == PROCESS_EVENT_TIMER && data == &et) {
+      if(synchronized) {
+        if(!is_coordinator &&
+           (clock_time_t)(clock_time() - last_sync) > DESYNC_TIMEOUT) {
+          desync();
+        } else {
+          prepare_eb();
+        }
+      } else if(!slots_running) {
+        /* Beacons hop over all channels, but some channels may be
+           jammed: listen to each of them in turn. */
+        scan_channel = (scan_channel + 1) % HOPPING_SEQUENCE_LENGTH;
+        SET_CHANNEL(hopping_sequence[scan_channel]);
+      }
+      etimer_set(&et, EB_PERIOD / 2 + random_rand() % EB_PERIOD);
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+static int
+queue_frame(mac_callback_t sent, void *ptr)
+{
+  struct tx_frame *f;
+  struct hdr *hdr;
+  const rimeaddr_t *receiver;
+  int hdrlen;
+  uint8_t i;
+
+  if(!synchronized) {
+    return MAC_TX_COLLISION;
+  }
+
+  f = NULL;
+  for(i = 0; i < QUEUE_SIZE; i++) {
+    if(queue[i].state == FRAME_FREE) {
+      f = &queue[i];
+      break;
+    }
+  }
+  if(f == NULL) {
+    PRINTF("tschrdc: queue full\n");
+    return MAC_TX_COLLISION;
+  }
+
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &rimeaddr_node_addr);
+  receiver = packetbuf_addr(PACKETBUF_ADDR_RECEIVER);
+  f->backoff = 0;
+  if(rimeaddr_cmp(receiver, &rimeaddr_null)) {
+    f->timeslot = 0;
+    f->channel_offset = 0;
+    f->backoff = random_rand() % SHARED_BACKOFF;
+  } else {
+    packetbuf_set_attr(PACKETBUF_ATTR_MAC_ACK, 1);
+    dedicated_cell(receiver, &f->timeslot, &f->channel_offset);
+  }
+
+  if(packetbuf_hdralloc(sizeof(struct hdr)) == 0) {
+    PRINTF("tschrdc: send failed, too large header\n");
+    return MAC_TX_ERR_FATAL;
+  }
+  hdr = packetbuf_hdrptr();
+  hdr->id = ID_DATA;
+
+  hdrlen = NETSTACK_FRAMER.create();
+  if(hdrlen < 0 || packetbuf_totlen() > MAX_FRAME_LEN) {
+    PRINTF("tschrdc: send failed, too large header\n");
+    packetbuf_hdr_remove(sizeof(struct hdr));
+    return MAC_TX_ERR_FATAL;
+  }
+  hdrlen += sizeof(struct hdr);
+
+  packetbuf_compact();
+  memcpy(f->data, packetbuf_hdrptr(), packetbuf_totlen());
+  f->len = packetbuf_totlen();
+
+  /* Remove the headers, which will be recreated for a retransmission. */
+  packetbuf_hdr_remove(hdrlen);
+
+  f->sent = sent;
+  f->ptr = ptr;
+  f->state = FRAME_QUEUED;
+  return MAC_TX_DEFERRED;
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_packet(mac_callback_t sent, void *ptr)
+{
+  int ret;
+
+  ret = queue_frame(sent, ptr);
+  if(ret != MAC_TX_DEFERRED) {
+    mac_call_sent_callback(sent, ptr, ret, 1);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
+{
+  /* Only the first frame is queued: the MAC sends the next one once
+     it has been told the outcome of this one. */
+  if(buf_list != NULL) {
+    queuebuf_to_packetbuf(buf_list->buf);
+    send_packet(sent, ptr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+packet_input(void)
+{
+  struct hdr *hdr;
+  rtimer_clock_t sfd_time;
+  int i;
+
+  if(NETSTACK_FRAMER.parse() < 0 ||
+     packetbuf_datalen() < sizeof(struct hdr)) {
+    PRINTF("tschrdc: failed to parse %u\n", packetbuf_datalen());
+    return;
+  }
+
+  hdr = packetbuf_dataptr();
+  sfd_time = packetbuf_attr(PACKETBUF_ATTR_TIMESTAMP);
+
+  if(hdr->id == ID_EB) {
+    if(packetbuf_datalen() >= sizeof(struct eb)) {
+      eb_input(packetbuf_dataptr(), sfd_time);
+    }
+    return;
+  }
+  if(hdr->id != ID_DATA) {
+    PRINTF("tschrdc: unknown frame id %u\n", hdr->id);
+    return;
+  }
+
+  if(synchronized &&
+     rimeaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_SENDER), &time_source)) {
+    resync(sfd_time);
+  }
+
+  if(!rimeaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
+                   &rimeaddr_node_addr) &&
+     !rimeaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
+                   &rimeaddr_null)) {
+    PRINTF("tschrdc: not for us\n");
+    return;
+  }
+
+  /* A frame is sent again when its ACK is lost. */
+  for(i = 0; i < MAX_SEQNOS; ++i) {
+    if(packetbuf_attr(PACKETBUF_ATTR_PACKET_ID) == received_seqnos[i].seqno &&
+       rimeaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_SENDER),
+                    &received_seqnos[i].sender)) {
+      PRINTF("tschrdc: drop duplicate link layer packet %u\n",
+             packetbuf_attr(PACKETBUF_ATTR_PACKET_ID));
+      return;
+    }
+  }
+  for(i = MAX_SEQNOS - 1; i > 0; --i) {
+    memcpy(&received_seqnos[i], &received_seqnos[i - 1],
+           sizeof(struct seqno));
+  }
+  received_seqnos[0].seqno = packetbuf_attr(PACKETBUF_ATTR_PACKET_ID);
+  rimeaddr_copy(&received_seqnos[0].sender,
+                packetbuf_addr(PACKETBUF_ADDR_SENDER));
+
+  packetbuf_hdrreduce(sizeof(struct hdr));
+  NETSTACK_MAC.input();
+}
+/*---------------------------------------------------------------------------*/
+static int
+on(void)
+{
+  tsch_is_on = 1;
+  keep_radio_on = 0;
+  if(!synchronized) {
+    return NETSTACK_RADIO.on();
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+off(int keep_radio_on_arg)
+{
+  tsch_is_on = 0;
+  keep_radio_on = keep_radio_on_arg;
+  if(keep_radio_on) {
+    return NETSTACK_RADIO.on();
+  } else {
+    return NETSTACK_RADIO.off();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+channel_check_interval(void)
+{
+  return (SLOTFRAME_LENGTH * (uint32_t)SLOT_LENGTH * CLOCK_SECOND) /
+    RTIMER_SECOND;
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+  tsch_is_on = 1;
+  SET_CHANNEL(hopping_sequence[0]);
+  NETSTACK_RADIO.on();
+  process_start(&tschrdc_process, NULL);
+}
+/*---------------------------------------------------------------------------*/
+void
+tschrdc_set_coordinator(void)
+{
+  if(synchronized || slots_running) {
+    return;
+  }
+  is_coordinator = 1;
+  join_priority = 0;
+  asn = 0;
+  timeslot = 0;
+  slot_start = RTIMER_NOW() + SLOT_LENGTH;
+  start_slots();
+}
+/*---------------------------------------------------------------------------*/
+int
+tschrdc_is_synchronized(void)
+{
+  return synchronized;
+}
+/*---------------------------------------------------------------------------*/
+uint32_t
+tschrdc_asn(void)
+{
+  uint32_t a;
+
+  /* The slots may update the ASN while we read it. */
+  do {
+    a = asn;
+  } while(a != asn);
+  return a;
+}
+/*---------------------------------------------------------------------------*/
+const struct rdc_driver tschrdc_driver = {
+  "tschrdc",
+  init,
+  send_packet,
+  send_list,
+  packet_input,
+  on,
+  off,
+  channel_check_interval,
+};
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2012, LCIS/CTSYS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Header file for the time-slotted channel hopping RDC
+ *
+ *         Time is divided in slots of TSCHRDC_CONF_SLOT_LENGTH, grouped
+ *         in slotframes of TSCHRDC_CONF_SLOTFRAME_LENGTH slots. The
+ *         channel of a cell changes with the absolute slot number
+ *         (ASN), following TSCHRDC_CONF_HOPPING_SEQUENCE. The first
+ *         slot of the slotframe is a shared cell, used for broadcasts
+ *         and beacons. Each node also listens in a dedicated cell,
+ *         derived from its address, where its neighbors send it their
+ *         unicast frames. No negotiation is needed to build this
+ *         schedule.
+ *
+ *         As with timesynch, the nodes synchronize to a neighbor with a
+ *         lower join priority, starting from the coordinator. The
+ *         beacons carry the ASN, and each frame received from the time
+ *         source corrects the start of the slots.
+ *
+ *         The radio driver must wait for the ACKs itself
+ *         (RDC_CONF_HARDWARE_ACK), and the platform must give the
+ *         function that changes the channel in
+ *         TSCHRDC_CONF_SET_CHANNEL.
+ */
+
+#ifndef __TSCHRDC_H__
+#define __TSCHRDC_H__
+
+#include "net/mac/rdc.h"
+#include "dev/radio.h"
+
+extern const struct rdc_driver tschrdc_driver;
+
+/**
+ * \brief      Start a network as its coordinator
+ *
+ *             The node keeps the time of the network and has the join
+ *             priority 0.
+ */
+void tschrdc_set_coordinator(void);
+
+/**
+ * \brief      Check if the node is synchronized to a network
+ */
+int tschrdc_is_synchronized(void);
+
+/**
+ * \brief      Get the absolute slot number of the next active slot
+ */
+uint32_t tschrdc_asn(void);
+
+#endif /* __TSCHRDC_H__ */
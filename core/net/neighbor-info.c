@@ -39,54 +39,29 @@
 
 #include "net/neighbor-info.h"
 #include "net/neighbor-attr.h"
+#include "net/link-estimator.h"
 #include "net/uip-ds6.h"
 #include "net/uip-nd6.h"
 
 #define DEBUG DEBUG_NONE
 #include "net/uip-debug.h"
 
-#define ETX_LIMIT		15
-#define ETX_SCALE		100
-#define ETX_ALPHA		90
-#define ETX_NOACK_PENALTY       ETX_LIMIT
+/* Link metrics are kept by the shared link estimator, with a finer
+   fixed point representation. */
+#define ETX2METRIC(etx) \
+  ((etx) / (LINK_ESTIMATOR_ETX_DIVISOR / NEIGHBOR_INFO_ETX_DIVISOR))
 /*---------------------------------------------------------------------------*/
-NEIGHBOR_ATTRIBUTE_GLOBAL(link_metric_t, attr_etx, NULL);
-NEIGHBOR_ATTRIBUTE_GLOBAL(unsigned long, attr_timestamp, NULL);
-
 static neighbor_info_subscriber_t subscriber_callback;
+static struct link_estimator_listener listener;
 /*---------------------------------------------------------------------------*/
 static void
-update_metric(const rimeaddr_t *dest, int packet_metric)
+etx_changed(const rimeaddr_t *addr, uint16_t etx)
 {
-  link_metric_t *metricp;
-  link_metric_t recorded_metric, new_metric;
-  unsigned long time;
-
-  metricp = (link_metric_t *)neighbor_attr_get_data(&attr_etx, dest);
-  packet_metric = NEIGHBOR_INFO_ETX2FIX(packet_metric);
-  if(metricp == NULL || *metricp == 0) {
-    recorded_metric = NEIGHBOR_INFO_ETX2FIX(ETX_LIMIT);
-    new_metric = packet_metric;
-  } else {
-    recorded_metric = *metricp;
-    /* Update the EWMA of the ETX for the neighbor. */
-    new_metric = ((uint16_t)recorded_metric * ETX_ALPHA +
-               (uint16_t)packet_metric * (ETX_SCALE - ETX_ALPHA)) / ETX_SCALE;
-  }
+  PRINTF("neighbor-info: ETX of %d changed to %d\n",
+         addr->u8[7], NEIGHBOR_INFO_FIX2ETX(ETX2METRIC(etx)));
 
-  PRINTF("neighbor-info: ETX changed from %d to %d (packet ETX = %d) %d\n",
-	 NEIGHBOR_INFO_FIX2ETX(recorded_metric),
-	 NEIGHBOR_INFO_FIX2ETX(new_metric),
-	 NEIGHBOR_INFO_FIX2ETX(packet_metric),
-         dest->u8[7]);
-
-  if(neighbor_attr_has_neighbor(dest)) {
-    time = clock_seconds();
-    neighbor_attr_set_data(&attr_etx, dest, &new_metric);
-    neighbor_attr_set_data(&attr_timestamp, dest, &time);
-    if(new_metric != recorded_metric && subscriber_callback != NULL) {
-      subscriber_callback(dest, 1, new_metric);
-    }
+  if(neighbor_attr_has_neighbor(addr) && subscriber_callback != NULL) {
+    subscriber_callback(addr, 1, ETX2METRIC(etx));
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -109,7 +84,6 @@ void
 neighbor_info_packet_sent(int status, int numtx)
 {
   const rimeaddr_t *dest;
-  link_metric_t packet_metric;
 #if UIP_DS6_LL_NUD
   uip_ds6_nbr_t *nbr;
 #endif /* UIP_DS6_LL_NUD */
@@ -119,14 +93,11 @@ neighbor_info_packet_sent(int status, int numtx)
     return;
   }
 
-  packet_metric = numtx;
-
-  PRINTF("neighbor-info: packet sent to %d.%d, status=%d, metric=%u\n",
+  PRINTF("neighbor-info: packet sent to %d.%d, status=%d, numtx=%d\n",
 	dest->u8[sizeof(*dest) - 2], dest->u8[sizeof(*dest) - 1],
-	status, (unsigned)packet_metric);
+	status, numtx);
 
-  switch(status) {
-  case MAC_TX_OK:
+  if(status == MAC_TX_OK) {
     add_neighbor(dest);
 #if UIP_DS6_LL_NUD
     nbr = uip_ds6_nbr_ll_lookup((uip_lladdr_t *)dest);
@@ -139,17 +110,9 @@ neighbor_info_packet_sent(int status, int numtx)
       PRINTF(" is reachable.\n");
     }
 #endif /* UIP_DS6_LL_NUD */
-    break;
-  case MAC_TX_NOACK:
-    packet_metric = ETX_NOACK_PENALTY;
-    break;
-  default:
-    /* Do not penalize the ETX when collisions or transmission
-       errors occur. */
-    return;
   }
 
-  update_metric(dest, packet_metric);
+  link_estimator_packet_sent(dest, status, numtx);
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -166,14 +129,15 @@ neighbor_info_packet_received(void)
 	src->u8[sizeof(*src) - 2], src->u8[sizeof(*src) - 1]);
 
   add_neighbor(src);
+  link_estimator_packet_received(src);
 }
 /*---------------------------------------------------------------------------*/
 int
 neighbor_info_subscribe(neighbor_info_subscriber_t s)
 {
   if(subscriber_callback == NULL) {
-    neighbor_attr_register(&attr_etx);
-    neighbor_attr_register(&attr_timestamp);
+    listener.callback = etx_changed;
+    link_estimator_add_listener(&listener);
     subscriber_callback = s;
     return 1;
   }
@@ -184,9 +148,9 @@ neighbor_info_subscribe(neighbor_info_subscriber_t s)
 link_metric_t
 neighbor_info_get_metric(const rimeaddr_t *addr)
 {
-  link_metric_t *metricp;
+  uint16_t metric;
 
-  metricp = (link_metric_t *)neighbor_attr_get_data(&attr_etx, addr);
-  return metricp == NULL ? ETX_LIMIT : *metricp;
+  metric = ETX2METRIC(link_estimator_get_etx(addr));
+  return metric > 0xff ? 0xff : metric;
 }
 /*---------------------------------------------------------------------------*/
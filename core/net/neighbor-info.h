@@ -55,9 +55,6 @@
 typedef void (*neighbor_info_subscriber_t)(const rimeaddr_t *, int known, int etx);
 typedef uint8_t link_metric_t;
 
-NEIGHBOR_ATTRIBUTE_DECLARE(attr_etx);
-NEIGHBOR_ATTRIBUTE_DECLARE(attr_timestamp);
-
 /**
  * Notify the neighbor information module about the status of
  * a packet transmission.
@@ -88,7 +85,8 @@ int neighbor_info_subscribe(neighbor_info_subscriber_t);
 /**
  * Get link metric value for a specific neighbor.
  *
- * \return Returns link metric if the neighbor exists, and 0 if not.
+ * \return Returns the link metric kept by the link estimator, which
+ *         is its ETX limit if the neighbor is unknown.
  */
 link_metric_t neighbor_info_get_metric(const rimeaddr_t *addr);
 
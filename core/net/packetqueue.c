@@ -129,6 +129,12 @@ packetqueue_len(struct packetqueue *q)
   return list_length(*q->list);
 }
 /*---------------------------------------------------------------------------*/
+void
+packetqueue_remove(struct packetqueue_item *i)
+{
+  remove_queued_packet(i);
+}
+/*---------------------------------------------------------------------------*/
 struct queuebuf *
 packetqueue_queuebuf(struct packetqueue_item *i)
 {
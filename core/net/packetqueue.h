@@ -190,6 +190,16 @@ void packetqueue_dequeue(struct packetqueue *q);
  */
 int packetqueue_len(struct packetqueue *q);
 
+/**
+ * \brief      Remove an item from its packet queue.
+ * \param i    A packet queue item.
+ *
+ *             This function removes an item anywhere in its packet
+ *             queue and frees its queuebuf, as if its lifetime had
+ *             expired.
+ */
+void packetqueue_remove(struct packetqueue_item *i);
+
 /**
  * @}
  */
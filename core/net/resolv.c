@@ -71,34 +71,24 @@
 #define NULL (void *)0
 #endif /* NULL */
 
-#if UIP_CONF_IPV6
-
-/* Currently this implementation only supports IPv4 DNS lookups.
-   Until support for IPv6 is added, dummy functions are used to
-   enable compilation with IPv6.
-*/
-
-process_event_t resolv_event_found;
-
-PROCESS(resolv_process, "DNS resolver");
-
-void resolv_conf(const uip_ipaddr_t *dnsserver) { }
-uip_ipaddr_t *resolv_getserver(void) { return NULL; }
-uip_ipaddr_t *resolv_lookup(const char *name) { return NULL; }
-void resolv_query(const char *name) { }
-
-PROCESS_THREAD(resolv_process, ev, data)
-{
-  PROCESS_BEGIN();
-  resolv_event_found = process_alloc_event();
-  PROCESS_END();
-}
-
-#else /* UIP_CONF_IPV6 */
-
 /** \internal The maximum number of retries when asking for a name. */
 #define MAX_RETRIES 8
 
+/** \internal The longest time an answer is cached, in seconds. */
+#ifdef UIP_CONF_RESOLV_MAX_TTL
+#define RESOLV_MAX_TTL UIP_CONF_RESOLV_MAX_TTL
+#else /* UIP_CONF_RESOLV_MAX_TTL */
+#define RESOLV_MAX_TTL (24UL * 60 * 60)
+#endif /* UIP_CONF_RESOLV_MAX_TTL */
+
+/** \internal How long a name that does not exist is cached, in
+    seconds. */
+#ifdef UIP_CONF_RESOLV_NEGATIVE_TTL
+#define RESOLV_NEGATIVE_TTL UIP_CONF_RESOLV_NEGATIVE_TTL
+#else /* UIP_CONF_RESOLV_NEGATIVE_TTL */
+#define RESOLV_NEGATIVE_TTL 60
+#endif /* UIP_CONF_RESOLV_NEGATIVE_TTL */
+
 /** \internal The DNS message header. */
 struct dns_hdr {
   uint16_t id;
@@ -120,17 +110,23 @@ struct dns_hdr {
   uint16_t numextrarr;
 };
 
-/** \internal The DNS answer message structure. */
+/** \internal The fixed part of a DNS answer record, which follows
+    the name of the record. The record may not be aligned, so it is
+    copied before being read. */
 struct dns_answer {
-  /* DNS answer record starts with either a domain name or a pointer
-     to a name already present somewhere in the packet. */
   uint16_t type;
   uint16_t class;
   uint16_t ttl[2];
   uint16_t len;
-  uint8_t ipaddr[4];
 };
 
+/** \internal The record type of the addresses we ask for. */
+#if UIP_CONF_IPV6
+#define DNS_TYPE_HOST 28 /* AAAA */
+#else /* UIP_CONF_IPV6 */
+#define DNS_TYPE_HOST 1  /* A */
+#endif /* UIP_CONF_IPV6 */
+
 struct namemap {
 #define STATE_UNUSED 0
 #define STATE_NEW    1
@@ -142,6 +138,12 @@ struct namemap {
   uint8_t retries;
   uint8_t seqno;
   uint8_t err;
+  uint8_t hash;
+  /* The ID of the query: the seqno in the high byte, and the index
+     of the entry in the low byte. */
+  uint16_t id;
+  /* The answer, or the absence of the name, is valid until then. */
+  unsigned long expiration;
   char name[32];
   uip_ipaddr_t ipaddr;
 };
@@ -197,9 +199,180 @@ parse_name(unsigned char *query)
   return query + 1;
 }
 /*-----------------------------------------------------------------------------------*/
+/** \internal
+ * Check that a compact encoded DNS name is the name of an entry.
+ */
+/*-----------------------------------------------------------------------------------*/
+static uint8_t
+name_matches(unsigned char *query, const char *name)
+{
+  unsigned char n;
+
+  while((n = *query++) != 0) {
+    while(n > 0) {
+      if(*query != *name) {
+        return 0;
+      }
+      ++query;
+      ++name;
+      --n;
+    }
+    /* Labels are separated by dots in the hostname. */
+    if(*query != 0) {
+      if(*name != '.') {
+        return 0;
+      }
+      ++name;
+    }
+  }
+  return *name == 0;
+}
+/*-----------------------------------------------------------------------------------*/
+/** \internal
+ * Hash a hostname, so that most entries are skipped without a
+ * string comparison.
+ */
+/*-----------------------------------------------------------------------------------*/
+static uint8_t
+name_hash(const char *name)
+{
+  uint8_t h;
+
+  h = 0;
+  while(*name != 0) {
+    h = ((h << 1) | (h >> 7)) ^ (uint8_t)*name++;
+  }
+  return h;
+}
+/*-----------------------------------------------------------------------------------*/
+static uint8_t
+expired(struct namemap *namemapptr)
+{
+  return (long)(clock_seconds() - namemapptr->expiration) > 0;
+}
+/*-----------------------------------------------------------------------------------*/
+/** \internal
+ * Find the entry of a hostname.
+ */
+/*-----------------------------------------------------------------------------------*/
+static struct namemap *
+find_entry(const char *name)
+{
+  uint8_t i;
+  uint8_t hash;
+  struct namemap *namemapptr;
+
+  hash = name_hash(name);
+  for(i = 0; i < RESOLV_ENTRIES; ++i) {
+    namemapptr = &names[i];
+    if(namemapptr->state != STATE_UNUSED &&
+       namemapptr->hash == hash &&
+       strcmp(name, namemapptr->name) == 0) {
+      return namemapptr;
+    }
+  }
+  return NULL;
+}
+/*-----------------------------------------------------------------------------------*/
+/** \internal
+ * Get an entry for a new hostname. Unused and expired entries are
+ * taken first, then the oldest answered one, then the oldest one.
+ */
+/*-----------------------------------------------------------------------------------*/
+static struct namemap *
+new_entry(const char *name)
+{
+  uint8_t i;
+  uint8_t lseq, lseqi;
+  uint8_t answered;
+  struct namemap *namemapptr;
+
+  lseq = lseqi = 0;
+  answered = 0;
+  for(i = 0; i < RESOLV_ENTRIES; ++i) {
+    namemapptr = &names[i];
+    if(namemapptr->state == STATE_UNUSED) {
+      break;
+    }
+    if(namemapptr->state == STATE_DONE || namemapptr->state == STATE_ERROR) {
+      if(expired(namemapptr)) {
+        break;
+      }
+      if(!answered || (uint8_t)(seqno - namemapptr->seqno) > lseq) {
+        answered = 1;
+        lseq = seqno - namemapptr->seqno;
+        lseqi = i;
+      }
+    } else if(!answered && (uint8_t)(seqno - namemapptr->seqno) > lseq) {
+      lseq = seqno - namemapptr->seqno;
+      lseqi = i;
+    }
+  }
+
+  if(i == RESOLV_ENTRIES) {
+    i = lseqi;
+  }
+  namemapptr = &names[i];
+
+  strncpy(namemapptr->name, name, sizeof(namemapptr->name) - 1);
+  namemapptr->name[sizeof(namemapptr->name) - 1] = 0;
+  namemapptr->hash = name_hash(namemapptr->name);
+  return namemapptr;
+}
+/*-----------------------------------------------------------------------------------*/
+/** \internal
+ * Mark an entry as the most recently used one, and give it a new
+ * query ID so that answers to its previous queries are ignored.
+ */
+/*-----------------------------------------------------------------------------------*/
+static void
+stamp_entry(struct namemap *namemapptr)
+{
+  namemapptr->seqno = seqno;
+  namemapptr->id = ((uint16_t)seqno << 8) | (uint8_t)(namemapptr - names);
+  ++seqno;
+}
+/*-----------------------------------------------------------------------------------*/
+/** \internal
+ * Count down the retransmission timers of the outstanding queries.
+ *
+ * \return Non-zero if a query must be sent.
+ */
+/*-----------------------------------------------------------------------------------*/
+static uint8_t
+tick(void)
+{
+  uint8_t i;
+  uint8_t due;
+  register struct namemap *namemapptr;
+
+  due = 0;
+  for(i = 0; i < RESOLV_ENTRIES; ++i) {
+    namemapptr = &names[i];
+    if(namemapptr->state == STATE_NEW) {
+      due = 1;
+    } else if(namemapptr->state == STATE_ASKING && namemapptr->tmr > 0) {
+      if(--namemapptr->tmr == 0) {
+        if(++namemapptr->retries == MAX_RETRIES) {
+          /* A timeout is not cached, so the name can be asked for
+             again right away. */
+          namemapptr->state = STATE_ERROR;
+          namemapptr->expiration = clock_seconds() - 1;
+          resolv_found(namemapptr->name, NULL);
+          continue;
+        }
+        due = 1;
+      }
+    }
+  }
+  return due;
+}
+/*-----------------------------------------------------------------------------------*/
 /** \internal
  * Runs through the list of names to see if there are any that have
- * not yet been queried and, if so, sends out a query.
+ * not yet been queried, or whose query must be retransmitted, and if
+ * so sends out a query. Several queries may be outstanding, so we ask
+ * to be polled again as long as there are queries to send.
  */
 /*-----------------------------------------------------------------------------------*/
 static void
@@ -214,30 +387,20 @@ check_entries(void)
   for(i = 0; i < RESOLV_ENTRIES; ++i) {
     namemapptr = &names[i];
     if(namemapptr->state == STATE_NEW ||
-       namemapptr->state == STATE_ASKING) {
-      etimer_set(&retry, CLOCK_SECOND);
+       (namemapptr->state == STATE_ASKING && namemapptr->tmr == 0)) {
+      if(etimer_expired(&retry)) {
+        etimer_set(&retry, CLOCK_SECOND);
+      }
       if(namemapptr->state == STATE_ASKING) {
-	if(--namemapptr->tmr == 0) {
-	  if(++namemapptr->retries == MAX_RETRIES) {
-	    namemapptr->state = STATE_ERROR;
-	    resolv_found(namemapptr->name, NULL);
-	    continue;
-	  }
-	  namemapptr->tmr = namemapptr->retries;
-	} else {
-	  /*	  printf("Timer %d\n", namemapptr->tmr);*/
-	  /* Its timer has not run out, so we move on to next
-	     entry. */
-	  continue;
-	}
+        namemapptr->tmr = namemapptr->retries;
       } else {
-	namemapptr->state = STATE_ASKING;
-	namemapptr->tmr = 1;
-	namemapptr->retries = 0;
+        namemapptr->state = STATE_ASKING;
+        namemapptr->tmr = 1;
+        namemapptr->retries = 0;
       }
       hdr = (struct dns_hdr *)uip_appdata;
       memset(hdr, 0, sizeof(struct dns_hdr));
-      hdr->id = uip_htons(i);
+      hdr->id = uip_htons(namemapptr->id);
       hdr->flags1 = DNS_FLAG1_RD;
       hdr->numquestions = UIP_HTONS(1);
       query = (char *)uip_appdata + 12;
@@ -257,13 +420,22 @@ check_entries(void)
       } while(*nameptr != 0);
       {
 	static unsigned char endquery[] =
-	  {0,0,1,0,1};
+	  {0, 0, DNS_TYPE_HOST, 0, 1};
 	memcpy(query, endquery, 5);
       }
       uip_udp_send((unsigned char)(query + 5 - (char *)uip_appdata));
       break;
     }
   }
+
+  /* Send the other queries in the next polls. */
+  for(++i; i < RESOLV_ENTRIES; ++i) {
+    if(names[i].state == STATE_NEW ||
+       (names[i].state == STATE_ASKING && names[i].tmr == 0)) {
+      tcpip_poll_udp(resolv_conn);
+      break;
+    }
+  }
 }
 /*-----------------------------------------------------------------------------------*/
 /** \internal
@@ -274,92 +446,101 @@ static void
 newdata(void)
 {
   unsigned char *nameptr;
-  struct dns_answer *ans;
+  unsigned char *end;
+  struct dns_answer ans;
   struct dns_hdr *hdr;
-  static uint8_t nquestions, nanswers;
+  static uint8_t nanswers;
   static uint8_t i;
+  static unsigned long ttl;
   register struct namemap *namemapptr;
   
   hdr = (struct dns_hdr *)uip_appdata;
-  /*  printf("ID %d\n", uip_htons(hdr->id));
-  printf("Query %d\n", hdr->flags1 & DNS_FLAG1_RESPONSE);
-  printf("Error %d\n", hdr->flags2 & DNS_FLAG2_ERR_MASK);
-  printf("Num questions %d, answers %d, authrr %d, extrarr %d\n",
-	 uip_htons(hdr->numquestions),
-	 uip_htons(hdr->numanswers),
-	 uip_htons(hdr->numauthrr),
-	 uip_htons(hdr->numextrarr));
-  */
-
-  /* The ID in the DNS header should be our entry into the name
-     table. */
+  end = (unsigned char *)uip_appdata + uip_datalen();
+
+  if(uip_datalen() < sizeof(struct dns_hdr) ||
+     (hdr->flags1 & DNS_FLAG1_RESPONSE) == 0) {
+    return;
+  }
+
+  /* The low byte of the ID in the DNS header should be our entry into
+     the name table, and the whole ID must match the query of that
+     entry. */
   i = (uint8_t)uip_htons(hdr->id);
+  if(i >= RESOLV_ENTRIES) {
+    return;
+  }
   namemapptr = &names[i];
-  if(i < RESOLV_ENTRIES &&
-     namemapptr->state == STATE_ASKING) {
+  if(namemapptr->state != STATE_ASKING ||
+     namemapptr->id != uip_htons(hdr->id) ||
+     hdr->numquestions != UIP_HTONS(1) ||
+     !name_matches((uint8_t *)uip_appdata + 12, namemapptr->name)) {
+    return;
+  }
 
-    /* This entry is now finished. */
-    namemapptr->state = STATE_DONE;
-    namemapptr->err = hdr->flags2 & DNS_FLAG2_ERR_MASK;
+  /* This entry is now finished. */
+  namemapptr->state = STATE_ERROR;
+  namemapptr->err = hdr->flags2 & DNS_FLAG2_ERR_MASK;
+  namemapptr->expiration = clock_seconds() - 1;
 
-    /* Check for error. If so, call callback to inform. */
-    if(namemapptr->err != 0) {
-      namemapptr->state = STATE_ERROR;
-      resolv_found(namemapptr->name, NULL);
-      return;
+  /* Check for error. If so, call callback to inform. A name that does
+     not exist is remembered, other errors are not. */
+  if(namemapptr->err != 0) {
+    if(namemapptr->err == DNS_FLAG2_ERR_NAME) {
+      namemapptr->expiration = clock_seconds() + RESOLV_NEGATIVE_TTL;
     }
+    resolv_found(namemapptr->name, NULL);
+    return;
+  }
 
-    /* We only care about the question(s) and the answers. The authrr
-       and the extrarr are simply discarded. */
-    nquestions = (uint8_t)uip_htons(hdr->numquestions);
-    nanswers = (uint8_t)uip_htons(hdr->numanswers);
-
-    /* Skip the name in the question. XXX: This should really be
-       checked agains the name in the question, to be sure that they
-       match. */
-    nameptr = parse_name((uint8_t *)uip_appdata + 12) + 4;
-
-    while(nanswers > 0) {
-      /* The first byte in the answer resource record determines if it
-	 is a compressed record or a normal one. */
-      if(*nameptr & 0xc0) {
-	/* Compressed name. */
-	nameptr +=2;
-	/*	printf("Compressed anwser\n");*/
-      } else {
-	/* Not compressed name. */
-	nameptr = parse_name((uint8_t *)nameptr);
-      }
+  /* We only care about the question and the answers. The authrr and
+     the extrarr are simply discarded. */
+  nanswers = (uint8_t)uip_htons(hdr->numanswers);
+
+  /* Skip the name in the question, which we have checked above. */
+  nameptr = parse_name((uint8_t *)uip_appdata + 12) + 4;
+
+  while(nanswers > 0) {
+    /* The first byte in the answer resource record determines if it
+       is a compressed record or a normal one. */
+    if(*nameptr & 0xc0) {
+      /* Compressed name. */
+      nameptr += 2;
+    } else {
+      /* Not compressed name. */
+      nameptr = parse_name((uint8_t *)nameptr);
+    }
+    if(nameptr + sizeof(ans) > end) {
+      break;
+    }
 
-      ans = (struct dns_answer *)nameptr;
-      /*      printf("Answer: type %x, class %x, ttl %x, length %x\n",
-	     uip_htons(ans->type), uip_htons(ans->class), (uip_htons(ans->ttl[0])
-	     << 16) | uip_htons(ans->ttl[1]), uip_htons(ans->len));*/
-
-      /* Check for IP address type and Internet class. Others are
-	 discarded. */
-      if(ans->type == UIP_HTONS(1) &&
-	 ans->class == UIP_HTONS(1) &&
-	 ans->len == UIP_HTONS(4)) {
-	/*	printf("IP address %d.%d.%d.%d\n",
-	       ans->ipaddr[0],
-	       ans->ipaddr[1],
-	       ans->ipaddr[2],
-	       ans->ipaddr[3]);*/
-	/* XXX: we should really check that this IP address is the one
-	   we want. */
-        for(i = 0; i < 4; i++) {
-          namemapptr->ipaddr.u8[i] = ans->ipaddr[i];
-        }
-	
-	resolv_found(namemapptr->name, &namemapptr->ipaddr);
-	return;
-      } else {
-	nameptr = nameptr + 10 + uip_htons(ans->len);
+    memcpy(&ans, nameptr, sizeof(ans));
+    nameptr += sizeof(ans);
+
+    /* Check for IP address type and Internet class. Others, such as
+       the CNAME records that precede the address, are skipped. */
+    if(ans.type == UIP_HTONS(DNS_TYPE_HOST) &&
+       ans.class == UIP_HTONS(1) &&
+       ans.len == UIP_HTONS(sizeof(uip_ipaddr_t)) &&
+       nameptr + sizeof(uip_ipaddr_t) <= end) {
+      memcpy(&namemapptr->ipaddr, nameptr, sizeof(uip_ipaddr_t));
+
+      ttl = ((unsigned long)uip_htons(ans.ttl[0]) << 16) |
+        uip_htons(ans.ttl[1]);
+      if(ttl > RESOLV_MAX_TTL) {
+        ttl = RESOLV_MAX_TTL;
       }
-      --nanswers;
+      namemapptr->state = STATE_DONE;
+      namemapptr->expiration = clock_seconds() + ttl;
+      resolv_found(namemapptr->name, &namemapptr->ipaddr);
+      return;
     }
+    nameptr += uip_htons(ans.len);
+    --nanswers;
   }
+
+  /* The name exists, but has no address. */
+  namemapptr->expiration = clock_seconds() + RESOLV_NEGATIVE_TTL;
+  resolv_found(namemapptr->name, NULL);
 }
 /*-----------------------------------------------------------------------------------*/
 /** \internal
@@ -383,9 +564,15 @@ PROCESS_THREAD(resolv_process, ev, data)
     PROCESS_WAIT_EVENT();
     
     if(ev == PROCESS_EVENT_TIMER) {
-      if(resolv_conn != NULL) {
+      if(tick() && resolv_conn != NULL) {
         tcpip_poll_udp(resolv_conn);
       }
+      for(i = 0; i < RESOLV_ENTRIES; ++i) {
+        if(names[i].state == STATE_ASKING) {
+          etimer_reset(&retry);
+          break;
+        }
+      }
 
     } else if(ev == EVENT_NEW_SERVER) {
       if(resolv_conn != NULL) {
@@ -394,7 +581,7 @@ PROCESS_THREAD(resolv_process, ev, data)
       resolv_conn = udp_new((uip_ipaddr_t *)data, UIP_HTONS(53), NULL);
       
     } else if(ev == tcpip_event) {
-      if(uip_udp_conn->rport == UIP_HTONS(53)) {
+      if(uip_udp_conn == resolv_conn) {
 	if(uip_poll()) {
 	  check_entries();
 	}
@@ -411,39 +598,35 @@ PROCESS_THREAD(resolv_process, ev, data)
 /**
  * Queues a name so that a question for the name will be sent out.
  *
+ * If the name is already cached, the resolv_event_found event is
+ * posted right away instead. A name that does not exist is cached for
+ * UIP_CONF_RESOLV_NEGATIVE_TTL seconds.
+ *
  * \param name The hostname that is to be queried.
  */
 /*-----------------------------------------------------------------------------------*/
 void
 resolv_query(const char *name)
 {
-  static uint8_t i;
-  static uint8_t lseq, lseqi;
   register struct namemap *nameptr;
-      
-  lseq = lseqi = 0;
-  nameptr = 0;                //compiler warning if not initialized
-  
-  for(i = 0; i < RESOLV_ENTRIES; ++i) {
-    nameptr = &names[i];
-    if(nameptr->state == STATE_UNUSED) {
-      break;
+
+  nameptr = find_entry(name);
+  if(nameptr != NULL) {
+    if(nameptr->state == STATE_NEW || nameptr->state == STATE_ASKING) {
+      /* The query is already outstanding. */
+      return;
     }
-    if(seqno - nameptr->seqno > lseq) {
-      lseq = seqno - nameptr->seqno;
-      lseqi = i;
+    if(!expired(nameptr)) {
+      resolv_found(nameptr->name, nameptr->state == STATE_DONE ?
+                   &nameptr->ipaddr : NULL);
+      return;
     }
+  } else {
+    nameptr = new_entry(name);
   }
 
-  if(i == RESOLV_ENTRIES) {
-    i = lseqi;
-    nameptr = &names[i];
-  }
-
-  strncpy(nameptr->name, name, sizeof(nameptr->name));
+  stamp_entry(nameptr);
   nameptr->state = STATE_NEW;
-  nameptr->seqno = seqno;
-  ++seqno;
 
   if(resolv_conn != NULL) {
     tcpip_poll_udp(resolv_conn);
@@ -458,29 +641,52 @@ resolv_query(const char *name)
  * was found. The function resolv_query() can be used to send a query
  * for a hostname.
  *
- * \return A pointer to a 4-byte representation of the hostname's IP
+ * \return A pointer to a representation of the hostname's IP
  * address, or NULL if the hostname was not found in the array of
- * hostnames.
+ * hostnames or its answer has expired.
  */
 /*-----------------------------------------------------------------------------------*/
 uip_ipaddr_t *
 resolv_lookup(const char *name)
 {
-  static uint8_t i;
   struct namemap *nameptr;
   
-  /* Walk through the list to see if the name is in there. If it is
-     not, we return NULL. */
-  for(i = 0; i < RESOLV_ENTRIES; ++i) {
-    nameptr = &names[i];
-    if(nameptr->state == STATE_DONE &&
-       strcmp(name, nameptr->name) == 0) {
+  nameptr = find_entry(name);
+  if(nameptr != NULL && nameptr->state == STATE_DONE) {
+    if(!expired(nameptr)) {
       return &nameptr->ipaddr;
     }
+    nameptr->state = STATE_UNUSED;
   }
   return NULL;
 }
 /*-----------------------------------------------------------------------------------*/
+/**
+ * Add a hostname to the array of known hostnames.
+ *
+ * This pre-warms the cache with addresses that are known in advance,
+ * so that they need no query until they expire.
+ *
+ * \param name The hostname.
+ * \param ipaddr The address of the host.
+ * \param ttl How long the address is valid, in seconds.
+ */
+/*-----------------------------------------------------------------------------------*/
+void
+resolv_add(const char *name, const uip_ipaddr_t *ipaddr, unsigned long ttl)
+{
+  struct namemap *nameptr;
+
+  nameptr = find_entry(name);
+  if(nameptr == NULL) {
+    nameptr = new_entry(name);
+  }
+  stamp_entry(nameptr);
+  uip_ipaddr_copy(&nameptr->ipaddr, ipaddr);
+  nameptr->state = STATE_DONE;
+  nameptr->expiration = clock_seconds() + ttl;
+}
+/*-----------------------------------------------------------------------------------*/
 /**
  * Obtain the currently configured DNS server.
  *
@@ -530,7 +736,6 @@ resolv_found(char *name, uip_ipaddr_t *ipaddr)
   process_post(PROCESS_BROADCAST, resolv_event_found, name);
 }
 /*-----------------------------------------------------------------------------------*/
-#endif /* UIP_CONF_IPV6 */
 #endif /* UIP_UDP */
 
 /** @} */
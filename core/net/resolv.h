@@ -52,6 +52,8 @@ CCIF void resolv_conf(const uip_ipaddr_t *dnsserver);
 CCIF uip_ipaddr_t *resolv_getserver(void);
 CCIF uip_ipaddr_t *resolv_lookup(const char *name);
 CCIF void resolv_query(const char *name);
+CCIF void resolv_add(const char *name, const uip_ipaddr_t *ipaddr,
+                     unsigned long ttl);
 
 PROCESS_NAME(resolv_process);
 
@@ -44,11 +44,11 @@
 
 #include "net/rime/collect.h"
 #include "net/rime/collect-link-estimate.h"
+#include "net/link-estimator.h"
+#include "net/mac/mac.h"
 
 #define INITIAL_LINK_ESTIMATE 16
 
-#define COLLECT_LINK_ESTIMATE_ALPHA ((3 * (COLLECT_LINK_ESTIMATE_UNIT)) / 8)
-
 #define MAX_ESTIMATES 255
 
 #define DEBUG 0
@@ -59,12 +59,17 @@
 #define PRINTF(...)
 #endif
 
+/* The estimates are kept by the shared link estimator. This module
+   only counts the transmissions made since collect last reset the
+   estimate of a neighbor. */
+
 /*---------------------------------------------------------------------------*/
 void
-collect_link_estimate_new(struct collect_link_estimate *le)
+collect_link_estimate_new(struct collect_link_estimate *le,
+                          const rimeaddr_t *addr)
 {
+  rimeaddr_copy(&le->addr, addr);
   le->num_estimates = 0;
-  le->etx_accumulator = COLLECT_LINK_ESTIMATE_UNIT;
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -75,20 +80,10 @@ collect_link_estimate_update_tx(struct collect_link_estimate *le, uint8_t tx)
     return;
   }
   if(le != NULL) {
-    if(le->num_estimates == 0) {
-      le->etx_accumulator = tx * COLLECT_LINK_ESTIMATE_UNIT;
-    }
-
     if(le->num_estimates < MAX_ESTIMATES) {
       le->num_estimates++;
     }
-
-    le->etx_accumulator = (((uint32_t)tx * COLLECT_LINK_ESTIMATE_UNIT) *
-                           COLLECT_LINK_ESTIMATE_ALPHA +
-                           le->etx_accumulator * (COLLECT_LINK_ESTIMATE_UNIT -
-                                                  COLLECT_LINK_ESTIMATE_ALPHA)) /
-      COLLECT_LINK_ESTIMATE_UNIT;
-
+    link_estimator_packet_sent(&le->addr, MAC_TX_OK, tx);
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -96,13 +91,23 @@ void
 collect_link_estimate_update_tx_fail(struct collect_link_estimate *le,
                                      uint8_t tx)
 {
-  collect_link_estimate_update_tx(le, tx * 2);
+  if(tx == 0) {
+    return;
+  }
+  if(le != NULL) {
+    if(le->num_estimates < MAX_ESTIMATES) {
+      le->num_estimates++;
+    }
+    link_estimator_packet_sent(&le->addr, MAC_TX_NOACK, tx);
+  }
 }
 /*---------------------------------------------------------------------------*/
 void
-collect_link_estimate_update_rx(struct collect_link_estimate *n)
+collect_link_estimate_update_rx(struct collect_link_estimate *le)
 {
-
+  if(le != NULL) {
+    link_estimator_packet_received(&le->addr);
+  }
 }
 /*---------------------------------------------------------------------------*/
 uint16_t
@@ -112,7 +117,8 @@ collect_link_estimate(struct collect_link_estimate *le)
     return INITIAL_LINK_ESTIMATE * COLLECT_LINK_ESTIMATE_UNIT;
   }
 
-  return le->etx_accumulator;
+  return ((uint32_t)link_estimator_get_etx(&le->addr) *
+          COLLECT_LINK_ESTIMATE_UNIT) / LINK_ESTIMATOR_ETX_DIVISOR;
 }
 /*---------------------------------------------------------------------------*/
 int
@@ -55,22 +55,29 @@
 #ifndef COLLECT_LINK_ESTIMATE_H
 #define COLLECT_LINK_ESTIMATE_H
 
+#include "net/rime/rimeaddr.h"
+
 #define COLLECT_LINK_ESTIMATE_UNIT           8
 
 
 
 struct collect_link_estimate {
-  uint32_t etx_accumulator;
+  rimeaddr_t addr;
   uint8_t num_estimates;
 };
 
 /**
  * \brief      Initialize a new link estimate
  * \param le   A pointer to a link estimate structure
+ * \param addr The address of the neighbor
  *
- *             This function initializes a link estimate.
+ *             This function initializes a link estimate. The
+ *             estimate itself is kept by the shared link estimator,
+ *             and is only used by collect once a transmission has
+ *             been made to the neighbor after this call.
  */
-void collect_link_estimate_new(struct collect_link_estimate *le);
+void collect_link_estimate_new(struct collect_link_estimate *le,
+                               const rimeaddr_t *addr);
 
 /**
  * \brief      Update a link estimate when a packet has been sent.
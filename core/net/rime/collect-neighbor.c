@@ -94,7 +94,7 @@ periodic(void *ptr)
   }
   for(n = list_head(neighbor_list->list); n != NULL; n = list_item_next(n)) {
     if(n->le_age == MAX_LE_AGE) {
-      collect_link_estimate_new(&n->le);
+      collect_link_estimate_new(&n->le, &n->addr);
       n->le_age = 0;
     }
     if(n->age == MAX_AGE) {
@@ -210,7 +210,7 @@ collect_neighbor_list_add(struct collect_neighbor_list *neighbors_list,
     n->age = 0;
     rimeaddr_copy(&n->addr, addr);
     n->rtmetric = nrtmetric;
-    collect_link_estimate_new(&n->le);
+    collect_link_estimate_new(&n->le, &n->addr);
     n->le_age = 0;
     return 1;
   }
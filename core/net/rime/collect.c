@@ -66,31 +66,90 @@ static const struct packetbuf_attrlist attributes[] =
   };
 
 
-/* The recent_packets list holds the sequence number, the originator,
-   and the connection for packets that have been recently
-   forwarded. This list is maintained to avoid forwarding duplicate
-   packets. */
-#define NUM_RECENT_PACKETS 16
+/* The recent_packets table holds the sequence number, the
+   originator, and the connection for packets that have been recently
+   forwarded. This table is maintained to avoid forwarding duplicate
+   packets. It is a hash table where a packet may be stored in any of
+   RECENT_PACKET_PROBES slots from its hash, so that a busy originator
+   does not push the packets of the others out. Entries expire after
+   RECENT_PACKET_LIFETIME, before the 8-bit sequence numbers of an
+   originator wrap around. NUM_RECENT_PACKETS must be a power of
+   two. */
+#ifdef COLLECT_CONF_RECENT_PACKETS
+#define NUM_RECENT_PACKETS COLLECT_CONF_RECENT_PACKETS
+#else
+#define NUM_RECENT_PACKETS 32
+#endif
+
+#ifdef COLLECT_CONF_RECENT_PACKET_LIFETIME
+#define RECENT_PACKET_LIFETIME COLLECT_CONF_RECENT_PACKET_LIFETIME
+#else
+#define RECENT_PACKET_LIFETIME (CLOCK_SECOND * 120)
+#endif
+
+#define RECENT_PACKET_PROBES 4
 
 struct recent_packet {
   struct collect_conn *conn;
+  clock_time_t time;
   rimeaddr_t originator;
   uint8_t eseqno;
 };
 
 static struct recent_packet recent_packets[NUM_RECENT_PACKETS];
-static uint8_t recent_packet_ptr;
 
 
 /* This is the header of data packets. The header comtains the routing
    metric of the last hop sender. This is used to avoid routing loops:
    if a node receives a packet with a lower routing metric than its
-   own, it drops the packet. */
+   own, it drops the packet. The header also carries the priority
+   class of the packet, which is kept from hop to hop. */
 struct data_msg_hdr {
-  uint8_t flags, dummy;
+  uint8_t flags, priority;
   uint16_t rtmetric;
 };
 
+#define DATA_FLAGS_AGGREGATE            0x01
+
+#if COLLECT_AGGREGATION
+/* An aggregate is a data packet with the DATA_FLAGS_AGGREGATE flag
+   set. After the data header, it carries one aggregate_record and
+   the payload of every packet merged into it. The record holds the
+   packet attributes that would otherwise be in the Rime header. */
+struct aggregate_record {
+  rimeaddr_t originator;
+  uint8_t eseqno, hops, ttl, max_rexmit, priority, len;
+};
+
+/* AGGREGATION_DELAY is the longest time a packet waits at each hop
+   for other packets to be merged with. AGGREGATION_MAX_LEN is the
+   largest aggregate, data header included, which must leave room for
+   the MAC and Rime headers in a frame. */
+#ifdef COLLECT_CONF_AGGREGATION_DELAY
+#define AGGREGATION_DELAY COLLECT_CONF_AGGREGATION_DELAY
+#else
+#define AGGREGATION_DELAY (CLOCK_SECOND / 4)
+#endif
+
+#ifdef COLLECT_CONF_AGGREGATION_MAX_LEN
+#define AGGREGATION_MAX_LEN COLLECT_CONF_AGGREGATION_MAX_LEN
+#else
+#define AGGREGATION_MAX_LEN 80
+#endif
+
+#ifdef COLLECT_CONF_AGGREGATION_MAX_PACKETS
+#define AGGREGATION_MAX_PACKETS COLLECT_CONF_AGGREGATION_MAX_PACKETS
+#else
+#define AGGREGATION_MAX_PACKETS 6
+#endif
+
+enum {
+  AGGREGATION_IDLE,
+  AGGREGATION_WAITING,
+  AGGREGATION_EXPIRED,
+};
+#endif /* COLLECT_AGGREGATION */
+
 
 /* This is the header of ACK packets. It contains a flags field that
    indicates if the node is congested (ACK_FLAGS_CONGESTED), if the
@@ -189,6 +248,10 @@ struct {
   uint32_t ttldrop;
   uint32_t ackdrop;
   uint32_t timedout;
+
+  uint32_t aggsent;
+  uint32_t aggmerged;
+  uint32_t aggrecv;
 } stats;
 
 /* Debug definition: draw routing tree in Cooja. */
@@ -443,6 +506,125 @@ update_rtmetric(struct collect_conn *tc)
   }
 }
 /*---------------------------------------------------------------------------*/
+static void
+set_data_header(uint8_t priority)
+{
+  struct data_msg_hdr hdr;
+
+  /* Allocate space for the header. The rtmetric is filled in when
+     the packet is sent. */
+  packetbuf_hdralloc(sizeof(struct data_msg_hdr));
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.priority = priority;
+  memcpy(packetbuf_hdrptr(), &hdr, sizeof(struct data_msg_hdr));
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+queued_priority(struct packetqueue_item *i)
+{
+  uint8_t *data;
+
+  data = queuebuf_dataptr(packetqueue_queuebuf(i));
+  return data[offsetof(struct data_msg_hdr, priority)];
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * The number of packets from the originator and of the priority of
+ * item that are queued between first and item. The queue is sorted
+ * by this round within each priority class.
+ */
+static int
+queued_round(struct packetqueue_item *first, struct packetqueue_item *item,
+             const rimeaddr_t *originator, uint8_t priority)
+{
+  struct packetqueue_item *i;
+  int round;
+
+  round = 0;
+  for(i = first; i != item; i = list_item_next(i)) {
+    if(queued_priority(i) == priority &&
+       rimeaddr_cmp(queuebuf_addr(packetqueue_queuebuf(i),
+                                  PACKETBUF_ADDR_ESENDER), originator)) {
+      round++;
+    }
+  }
+  return round;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Enqueue the packet in the packetbuf if the send queue has fewer
+ * than limit packets, or if a packet of a lower priority can be
+ * dropped to make room. The packet is placed after the packets of a
+ * higher priority and, among those of its own priority, after the
+ * packets of the same round, so that the originators are served in
+ * turn. The packet that is being sent always stays first.
+ */
+static int
+enqueue_packet(struct collect_conn *c, uint8_t priority, int limit)
+{
+  struct packetqueue_item *first, *prev, *i, *item;
+  rimeaddr_t originator;
+  rimeaddr_t queued;
+  uint8_t p;
+  int round;
+
+  first = packetqueue_first(&c->send_queue);
+  prev = NULL;
+  if(c->sending && first != NULL) {
+    prev = first;
+    first = list_item_next(first);
+  }
+
+  if(packetqueue_len(&c->send_queue) >= limit) {
+    /* Drop the last packet of the lowest priority below ours. */
+    item = NULL;
+    for(i = first; i != NULL; i = list_item_next(i)) {
+      if(queued_priority(i) < priority &&
+         (item == NULL || queued_priority(i) <= queued_priority(item))) {
+        item = i;
+      }
+    }
+    if(item == NULL) {
+      return 0;
+    }
+    PRINTF("%d.%d: dropping queued packet of priority %d for %d\n",
+           rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
+           queued_priority(item), priority);
+    if(item == first) {
+      first = list_item_next(first);
+    }
+    packetqueue_remove(item);
+    stats.qdrop++;
+  }
+
+  rimeaddr_copy(&originator, packetbuf_addr(PACKETBUF_ADDR_ESENDER));
+  if(!packetqueue_enqueue_packetbuf(&c->send_queue,
+                                    FORWARD_PACKET_LIFETIME_BASE *
+                                    packetbuf_attr(PACKETBUF_ATTR_MAX_REXMIT),
+                                    c)) {
+    return 0;
+  }
+  item = list_tail(c->send_queue_list);
+  list_remove(c->send_queue_list, item);
+
+  round = queued_round(first, NULL, &originator, priority);
+  for(i = first; i != NULL; prev = i, i = list_item_next(i)) {
+    p = queued_priority(i);
+    if(p < priority) {
+      break;
+    }
+    if(p == priority) {
+      rimeaddr_copy(&queued, queuebuf_addr(packetqueue_queuebuf(i),
+                                           PACKETBUF_ADDR_ESENDER));
+      if(queued_round(first, i, &queued, p) > round) {
+        break;
+      }
+    }
+  }
+  list_insert(c->send_queue_list, prev, item);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
 static int
 enqueue_dummy_packet(struct collect_conn *c, int rexmits)
 {
@@ -460,8 +642,7 @@ enqueue_dummy_packet(struct collect_conn *c, int rexmits)
          packetbuf_attr(PACKETBUF_ATTR_EPACKET_ID),
          packetbuf_attr(PACKETBUF_ATTR_MAX_REXMIT));
 
-  /* Allocate space for the header. */
-  packetbuf_hdralloc(sizeof(struct data_msg_hdr));
+  set_data_header(COLLECT_PRIORITY_NORMAL);
 
   n = collect_neighbor_list_find(&c->neighbor_list, &c->parent);
   if(n != NULL) {
@@ -541,6 +722,163 @@ proactive_probing_callback(void *ptr)
   }
 }
 /*---------------------------------------------------------------------------*/
+#if COLLECT_AGGREGATION
+/**
+ * The room that the queued packet takes in an aggregate, or zero if
+ * it must be sent on its own. Keepalives, aggregates and urgent
+ * packets are not merged.
+ */
+static int
+aggregate_record_len(struct packetqueue_item *i)
+{
+  struct queuebuf *q;
+  uint8_t *data;
+  int len;
+
+  q = packetqueue_queuebuf(i);
+  data = queuebuf_dataptr(q);
+  len = queuebuf_datalen(q) - (int)sizeof(struct data_msg_hdr);
+  if(len <= 0 ||
+     (data[offsetof(struct data_msg_hdr, flags)] & DATA_FLAGS_AGGREGATE) ||
+     data[offsetof(struct data_msg_hdr, priority)] >= COLLECT_PRIORITY_URGENT) {
+    return 0;
+  }
+  len += sizeof(struct aggregate_record);
+  if(len > AGGREGATION_MAX_LEN - (int)sizeof(struct data_msg_hdr)) {
+    return 0;
+  }
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+aggregation_timeout(void *ptr)
+{
+  struct collect_conn *c = ptr;
+
+  c->aggregation_state = AGGREGATION_EXPIRED;
+  send_queued_packet(c);
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Merge the small packets of the send queue into an aggregate that
+ * replaces them at the head of the queue. The head waits up to
+ * AGGREGATION_DELAY for other packets, unless the aggregate is full
+ * before. Returns zero if the head should not be sent yet.
+ */
+static int
+aggregate_queued_packets(struct collect_conn *c)
+{
+  struct packetqueue_item *items[AGGREGATION_MAX_PACKETS];
+  struct packetqueue_item *i;
+  struct aggregate_record r;
+  struct data_msg_hdr hdr;
+  struct queuebuf *q;
+  uint8_t *ptr;
+  uint8_t max_rexmit;
+  int len, rlen, n, k, full;
+
+  i = packetqueue_first(&c->send_queue);
+  if(i == NULL || aggregate_record_len(i) == 0) {
+    /* A wait started for an earlier head no longer applies. */
+    ctimer_stop(&c->aggregation_timer);
+    c->aggregation_state = AGGREGATION_IDLE;
+    return 1;
+  }
+
+  /* The queue is sorted by priority, so the head has the highest
+     priority of the aggregate. */
+  n = 0;
+  full = 0;
+  len = sizeof(struct data_msg_hdr);
+  for(; i != NULL; i = list_item_next(i)) {
+    rlen = aggregate_record_len(i);
+    if(rlen > 0) {
+      if(n == AGGREGATION_MAX_PACKETS || len + rlen > AGGREGATION_MAX_LEN) {
+        full = 1;
+      } else {
+        items[n++] = i;
+        len += rlen;
+      }
+    }
+  }
+
+  if(!full && n < AGGREGATION_MAX_PACKETS &&
+     c->aggregation_state != AGGREGATION_EXPIRED) {
+    if(c->aggregation_state == AGGREGATION_IDLE) {
+      c->aggregation_state = AGGREGATION_WAITING;
+      ctimer_set(&c->aggregation_timer, AGGREGATION_DELAY,
+                 aggregation_timeout, c);
+    }
+    return 0;
+  }
+  ctimer_stop(&c->aggregation_timer);
+  c->aggregation_state = AGGREGATION_IDLE;
+
+  if(n < 2) {
+    return 1;
+  }
+
+  packetbuf_clear();
+  ptr = (uint8_t *)packetbuf_dataptr() + sizeof(struct data_msg_hdr);
+  max_rexmit = 0;
+  for(k = 0; k < n; k++) {
+    q = packetqueue_queuebuf(items[k]);
+    rimeaddr_copy(&r.originator, queuebuf_addr(q, PACKETBUF_ADDR_ESENDER));
+    r.eseqno = queuebuf_attr(q, PACKETBUF_ATTR_EPACKET_ID);
+    r.hops = queuebuf_attr(q, PACKETBUF_ATTR_HOPS);
+    r.ttl = queuebuf_attr(q, PACKETBUF_ATTR_TTL);
+    r.max_rexmit = queuebuf_attr(q, PACKETBUF_ATTR_MAX_REXMIT);
+    r.priority = queued_priority(items[k]);
+    r.len = queuebuf_datalen(q) - sizeof(struct data_msg_hdr);
+    memcpy(ptr, &r, sizeof(struct aggregate_record));
+    ptr += sizeof(struct aggregate_record);
+    memcpy(ptr, (uint8_t *)queuebuf_dataptr(q) + sizeof(struct data_msg_hdr),
+           r.len);
+    ptr += r.len;
+    if(r.max_rexmit > max_rexmit) {
+      max_rexmit = r.max_rexmit;
+    }
+  }
+  packetbuf_set_datalen(ptr - (uint8_t *)packetbuf_dataptr());
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.flags = DATA_FLAGS_AGGREGATE;
+  hdr.priority = queued_priority(items[0]);
+  memcpy(packetbuf_dataptr(), &hdr, sizeof(struct data_msg_hdr));
+
+  /* The attributes of the aggregate itself are only used for the
+     hop to the parent, which checks the merged packets one by one. */
+  packetbuf_set_addr(PACKETBUF_ADDR_ESENDER, &rimeaddr_node_addr);
+  packetbuf_set_attr(PACKETBUF_ATTR_EPACKET_ID, c->eseqno - 1);
+  packetbuf_set_attr(PACKETBUF_ATTR_HOPS, 1);
+  packetbuf_set_attr(PACKETBUF_ATTR_TTL, 1);
+  packetbuf_set_attr(PACKETBUF_ATTR_MAX_REXMIT, max_rexmit);
+
+  PRINTF("%d.%d: merging %d packets into %d bytes\n",
+         rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
+         n, packetbuf_datalen());
+
+  /* Free the merged packets first, so that there is room for the
+     aggregate. */
+  for(k = 0; k < n; k++) {
+    packetqueue_remove(items[k]);
+  }
+  if(!packetqueue_enqueue_packetbuf(&c->send_queue,
+                                    FORWARD_PACKET_LIFETIME_BASE * max_rexmit,
+                                    c)) {
+    stats.qdrop += n;
+    return 1;
+  }
+  i = list_tail(c->send_queue_list);
+  list_remove(c->send_queue_list, i);
+  list_push(c->send_queue_list, i);
+
+  stats.aggsent++;
+  stats.aggmerged += n;
+  return 1;
+}
+#endif /* COLLECT_AGGREGATION */
+/*---------------------------------------------------------------------------*/
 /**
  * This function is called when a queued packet should be sent
  * out. The function takes the first packet on the output queue, adds
@@ -565,6 +903,12 @@ send_queued_packet(struct collect_conn *c)
     return;
   }
 
+#if COLLECT_AGGREGATION
+  /* Merge the small packets that are queued, or wait for more. */
+  if(!aggregate_queued_packets(c)) {
+    return;
+  }
+#endif /* COLLECT_AGGREGATION */
 
   /* Grab the first packet on the send queue. */
   i = packetqueue_first(&c->send_queue);
@@ -625,8 +969,10 @@ send_queued_packet(struct collect_conn *c)
       stats.datasent++;
 
       /* Copy our rtmetric into the packet header of the outgoing
-         packet. */
-      memset(&hdr, 0, sizeof(hdr));
+         packet. The priority and the aggregate flag are left as they
+         were queued. */
+      memcpy(&hdr, packetbuf_dataptr(), sizeof(struct data_msg_hdr));
+      hdr.flags &= DATA_FLAGS_AGGREGATE;
       hdr.rtmetric = c->rtmetric;
       memcpy(packetbuf_dataptr(), &hdr, sizeof(struct data_msg_hdr));
 
@@ -724,8 +1070,10 @@ retransmit_current_packet(struct collect_conn *c)
       packetbuf_set_attr(PACKETBUF_ATTR_PACKET_ID, c->seqno);
 
       /* Copy our rtmetric into the packet header of the outgoing
-         packet. */
-      memset(&hdr, 0, sizeof(hdr));
+         packet. The priority and the aggregate flag are left as they
+         were queued. */
+      memcpy(&hdr, packetbuf_dataptr(), sizeof(struct data_msg_hdr));
+      hdr.flags &= DATA_FLAGS_AGGREGATE;
       hdr.rtmetric = c->rtmetric;
       memcpy(packetbuf_dataptr(), &hdr, sizeof(struct data_msg_hdr));
 
@@ -882,29 +1230,172 @@ send_ack(struct collect_conn *tc, const rimeaddr_t *to, int flags)
   stats.acksent++;
 }
 /*---------------------------------------------------------------------------*/
+static int
+recent_packet_hash(const rimeaddr_t *originator, uint8_t eseqno)
+{
+  uint16_t h;
+  int i;
+
+  h = eseqno;
+  for(i = 0; i < RIMEADDR_SIZE; i++) {
+    h = h * 31 + originator->u8[i];
+  }
+  return h & (NUM_RECENT_PACKETS - 1);
+}
+/*---------------------------------------------------------------------------*/
+static int
+recent_packet_expired(struct recent_packet *r)
+{
+  return r->conn == NULL ||
+    (clock_time_t)(clock_time() - r->time) >=
+    (clock_time_t)RECENT_PACKET_LIFETIME;
+}
+/*---------------------------------------------------------------------------*/
+static struct recent_packet *
+find_recent_packet(struct collect_conn *tc)
+{
+  struct recent_packet *r;
+  const rimeaddr_t *originator;
+  uint8_t eseqno;
+  int h;
+  int i;
+
+  originator = packetbuf_addr(PACKETBUF_ADDR_ESENDER);
+  eseqno = packetbuf_attr(PACKETBUF_ATTR_EPACKET_ID);
+  h = recent_packet_hash(originator, eseqno);
+  for(i = 0; i < RECENT_PACKET_PROBES; i++) {
+    r = &recent_packets[(h + i) & (NUM_RECENT_PACKETS - 1)];
+    if(r->conn == tc && r->eseqno == eseqno &&
+       rimeaddr_cmp(&r->originator, originator) &&
+       !recent_packet_expired(r)) {
+      return r;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
 static void
 add_packet_to_recent_packets(struct collect_conn *tc)
 {
+  struct recent_packet *r;
+  struct recent_packet *oldest;
+  int h;
+  int i;
+
   /* Remember that we have seen this packet for later, but only if
      it has a length that is larger than zero. Packets with size
      zero are keepalive or proactive link estimate probes, so we do
      not record them in our history. */
   if(packetbuf_datalen() > sizeof(struct data_msg_hdr)) {
-    recent_packets[recent_packet_ptr].eseqno =
-      packetbuf_attr(PACKETBUF_ATTR_EPACKET_ID);
-    rimeaddr_copy(&recent_packets[recent_packet_ptr].originator,
+    /* Use a free or expired slot, or replace the oldest entry. */
+    h = recent_packet_hash(packetbuf_addr(PACKETBUF_ADDR_ESENDER),
+                           packetbuf_attr(PACKETBUF_ATTR_EPACKET_ID));
+    oldest = NULL;
+    for(i = 0; i < RECENT_PACKET_PROBES; i++) {
+      r = &recent_packets[(h + i) & (NUM_RECENT_PACKETS - 1)];
+      if(recent_packet_expired(r)) {
+        oldest = r;
+        break;
+      }
+      if(oldest == NULL ||
+         clock_time() - r->time > clock_time() - oldest->time) {
+        oldest = r;
+      }
+    }
+    oldest->eseqno = packetbuf_attr(PACKETBUF_ATTR_EPACKET_ID);
+    rimeaddr_copy(&oldest->originator,
                   packetbuf_addr(PACKETBUF_ADDR_ESENDER));
-    recent_packets[recent_packet_ptr].conn = tc;
-    recent_packet_ptr = (recent_packet_ptr + 1) % NUM_RECENT_PACKETS;
+    oldest->conn = tc;
+    oldest->time = clock_time();
   }
 }
 /*---------------------------------------------------------------------------*/
+#if COLLECT_AGGREGATION
+/**
+ * Split the aggregate in the packetbuf into its packets, and deliver
+ * or enqueue each of them as if it had been received on its own. The
+ * packets are checked for duplicates one by one, since some of them
+ * may have been enqueued before the aggregate was retransmitted.
+ * Returns the flags to add to the ACK of the aggregate.
+ */
+static uint8_t
+unpack_aggregate(struct collect_conn *tc)
+{
+  struct aggregate_record r;
+  struct data_msg_hdr hdr;
+  struct queuebuf *q;
+  uint8_t *data;
+  uint8_t ackflags;
+  int len, offset;
+
+  q = queuebuf_new_from_packetbuf();
+  if(q == NULL) {
+    stats.qdrop++;
+    return ACK_FLAGS_DROPPED | ACK_FLAGS_CONGESTED;
+  }
+
+  ackflags = 0;
+  len = queuebuf_datalen(q);
+  offset = sizeof(struct data_msg_hdr);
+  while(offset + (int)sizeof(struct aggregate_record) <= len) {
+    memcpy(&r, (uint8_t *)queuebuf_dataptr(q) + offset,
+           sizeof(struct aggregate_record));
+    offset += sizeof(struct aggregate_record);
+    if(r.len == 0 || offset + r.len > len) {
+      break;
+    }
+
+    packetbuf_clear();
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.priority = r.priority;
+    data = packetbuf_dataptr();
+    memcpy(data, &hdr, sizeof(struct data_msg_hdr));
+    memcpy(data + sizeof(struct data_msg_hdr),
+           (uint8_t *)queuebuf_dataptr(q) + offset, r.len);
+    packetbuf_set_datalen(sizeof(struct data_msg_hdr) + r.len);
+    offset += r.len;
+
+    packetbuf_set_addr(PACKETBUF_ADDR_ESENDER, &r.originator);
+    packetbuf_set_attr(PACKETBUF_ATTR_EPACKET_ID, r.eseqno);
+    packetbuf_set_attr(PACKETBUF_ATTR_HOPS, r.hops);
+    packetbuf_set_attr(PACKETBUF_ATTR_TTL, r.ttl);
+    packetbuf_set_attr(PACKETBUF_ATTR_MAX_REXMIT, r.max_rexmit);
+
+    if(find_recent_packet(tc) != NULL) {
+      stats.duprecv++;
+    } else if(tc->rtmetric == RTMETRIC_SINK) {
+      add_packet_to_recent_packets(tc);
+      packetbuf_hdrreduce(sizeof(struct data_msg_hdr));
+      if(tc->cb->recv != NULL) {
+        tc->cb->recv(&r.originator, r.eseqno, r.hops);
+      }
+    } else if(r.ttl <= 1) {
+      /* Retransmitting the aggregate would not help this packet, so
+         it is dropped without telling the sender. */
+      stats.ttldrop++;
+    } else {
+      packetbuf_set_attr(PACKETBUF_ATTR_HOPS, r.hops + 1);
+      packetbuf_set_attr(PACKETBUF_ATTR_TTL, r.ttl - 1);
+      if(enqueue_packet(tc, r.priority,
+                        MAX_SENDING_QUEUE - MIN_AVAILABLE_QUEUE_ENTRIES + 1)) {
+        add_packet_to_recent_packets(tc);
+      } else {
+        ackflags |= ACK_FLAGS_DROPPED | ACK_FLAGS_CONGESTED;
+        stats.qdrop++;
+      }
+    }
+  }
+
+  queuebuf_free(q);
+  return ackflags;
+}
+#endif /* COLLECT_AGGREGATION */
+/*---------------------------------------------------------------------------*/
 static void
 node_packet_received(struct unicast_conn *c, const rimeaddr_t *from)
 {
   struct collect_conn *tc = (struct collect_conn *)
     ((char *)c - offsetof(struct collect_conn, unicast_conn));
-  int i;
   struct data_msg_hdr hdr;
   uint8_t ackflags = 0;
   struct collect_neighbor *n;
@@ -918,6 +1409,7 @@ node_packet_received(struct unicast_conn *c, const rimeaddr_t *from)
   n = collect_neighbor_list_find(&tc->neighbor_list,
                                  packetbuf_addr(PACKETBUF_ADDR_SENDER));
   if(n != NULL) {
+    collect_neighbor_rx(n);
     collect_neighbor_update_rtmetric(n, hdr.rtmetric);
     update_rtmetric(tc);
   }
@@ -947,23 +1439,44 @@ node_packet_received(struct unicast_conn *c, const rimeaddr_t *from)
       ackflags |= ACK_FLAGS_CONGESTED;
     }
 
-    for(i = 0; i < NUM_RECENT_PACKETS; i++) {
-      if(recent_packets[i].conn == tc &&
-         recent_packets[i].eseqno == packetbuf_attr(PACKETBUF_ATTR_EPACKET_ID) &&
-         rimeaddr_cmp(&recent_packets[i].originator,
-                      packetbuf_addr(PACKETBUF_ADDR_ESENDER))) {
-        /* This is a duplicate of a packet we recently received, so we
-           just send an ACK. */
-        PRINTF("%d.%d: found duplicate packet from %d.%d with seqno %d, via %d.%d\n",
-               rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
-               recent_packets[i].originator.u8[0], recent_packets[i].originator.u8[1],
-               packetbuf_attr(PACKETBUF_ATTR_EPACKET_ID),
-               packetbuf_addr(PACKETBUF_ADDR_SENDER)->u8[0],
-               packetbuf_addr(PACKETBUF_ADDR_SENDER)->u8[1]);
-        send_ack(tc, &ack_to, ackflags);
-        stats.duprecv++;
-        return;
+#if COLLECT_AGGREGATION
+    if(hdr.flags & DATA_FLAGS_AGGREGATE) {
+      /* Without a route, we do not ACK the aggregate, as for a single
+         packet, so that the sender tries again. */
+      if(tc->rtmetric != RTMETRIC_SINK) {
+        if(tc->rtmetric == RTMETRIC_MAX) {
+          return;
+        }
+        if(hdr.rtmetric <= tc->rtmetric) {
+          ackflags |= ACK_FLAGS_RTMETRIC_NEEDS_UPDATE;
+        }
       }
+      stats.aggrecv++;
+      ackflags |= unpack_aggregate(tc);
+
+      /* The packetbuf has been reused, so we restore the packet id
+         that the ACK refers to. */
+      packetbuf_clear();
+      packetbuf_set_attr(PACKETBUF_ATTR_PACKET_ID, packet_seqno);
+      send_ack(tc, &ack_to, ackflags);
+      send_queued_packet(tc);
+      return;
+    }
+#endif /* COLLECT_AGGREGATION */
+
+    if(find_recent_packet(tc) != NULL) {
+      /* This is a duplicate of a packet we recently received, so we
+         just send an ACK. */
+      PRINTF("%d.%d: found duplicate packet from %d.%d with seqno %d, via %d.%d\n",
+             rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
+             packetbuf_addr(PACKETBUF_ADDR_ESENDER)->u8[0],
+             packetbuf_addr(PACKETBUF_ADDR_ESENDER)->u8[1],
+             packetbuf_attr(PACKETBUF_ATTR_EPACKET_ID),
+             packetbuf_addr(PACKETBUF_ADDR_SENDER)->u8[0],
+             packetbuf_addr(PACKETBUF_ADDR_SENDER)->u8[1]);
+      send_ack(tc, &ack_to, ackflags);
+      stats.duprecv++;
+      return;
     }
 
     /* If we are the sink, the packet has reached its final
@@ -1037,12 +1550,10 @@ node_packet_received(struct unicast_conn *c, const rimeaddr_t *from)
          to inform the sender that the packet was dropped due to
          memory problems. We first check the size of our sending queue
          to ensure that we always have entries for packets that
-         are originated by this node. */
-      if(packetqueue_len(&tc->send_queue) <= MAX_SENDING_QUEUE - MIN_AVAILABLE_QUEUE_ENTRIES &&
-         packetqueue_enqueue_packetbuf(&tc->send_queue,
-                                       FORWARD_PACKET_LIFETIME_BASE *
-                                       packetbuf_attr(PACKETBUF_ATTR_MAX_REXMIT),
-                                       tc)) {
+         are originated by this node, unless a queued packet has a
+         lower priority than the one we received. */
+      if(enqueue_packet(tc, hdr.priority,
+                        MAX_SENDING_QUEUE - MIN_AVAILABLE_QUEUE_ENTRIES + 1)) {
         add_packet_to_recent_packets(tc);
         send_ack(tc, &ack_to, ackflags);
         send_queued_packet(tc);
@@ -1205,6 +1716,12 @@ adv_received(struct neighbor_discovery_conn *c, const rimeaddr_t *from,
 	   n->addr.u8[0], n->addr.u8[1], rtmetric);
   }
 
+  /* The advertisement also tells us how well we hear the neighbor. */
+  n = collect_neighbor_list_find(&tc->neighbor_list, from);
+  if(n != NULL) {
+    collect_neighbor_rx(n);
+  }
+
   update_rtmetric(tc);
 }
 #else
@@ -1249,6 +1766,12 @@ received_announcement(struct announcement *a, const rimeaddr_t *from,
 	   n->addr.u8[0], n->addr.u8[1], value);
   }
 
+  /* The announcement also tells us how well we hear the neighbor. */
+  n = collect_neighbor_list_find(&tc->neighbor_list, from);
+  if(n != NULL) {
+    collect_neighbor_rx(n);
+  }
+
   update_rtmetric(tc);
 
 #if ! COLLECT_CONF_WITH_LISTEN
@@ -1279,6 +1802,9 @@ collect_open(struct collect_conn *tc, uint16_t channels,
   tc->is_router = is_router;
   tc->seqno = 10;
   tc->eseqno = 0;
+#if COLLECT_AGGREGATION
+  tc->aggregation_state = AGGREGATION_IDLE;
+#endif /* COLLECT_AGGREGATION */
   LIST_STRUCT_INIT(tc, send_queue_list);
   collect_neighbor_list_new(&tc->neighbor_list);
   tc->send_queue.list = &(tc->send_queue_list);
@@ -1354,6 +1880,9 @@ collect_close(struct collect_conn *tc)
   neighbor_discovery_close(&tc->neighbor_discovery_conn);
 #endif /* COLLECT_ANNOUNCEMENTS */
   unicast_close(&tc->unicast_conn);
+#if COLLECT_AGGREGATION
+  ctimer_stop(&tc->aggregation_timer);
+#endif /* COLLECT_AGGREGATION */
   while(packetqueue_first(&tc->send_queue) != NULL) {
     packetqueue_dequeue(&tc->send_queue);
   }
@@ -1392,6 +1921,12 @@ collect_set_sink(struct collect_conn *tc, int should_be_sink)
 /*---------------------------------------------------------------------------*/
 int
 collect_send(struct collect_conn *tc, int rexmits)
+{
+  return collect_send_priority(tc, rexmits, COLLECT_PRIORITY_NORMAL);
+}
+/*---------------------------------------------------------------------------*/
+int
+collect_send_priority(struct collect_conn *tc, int rexmits, uint8_t priority)
 {
   struct collect_neighbor *n;
   int ret;
@@ -1435,13 +1970,9 @@ collect_send(struct collect_conn *tc, int rexmits)
     return 1;
   } else {
 
-    /* Allocate space for the header. */
-    packetbuf_hdralloc(sizeof(struct data_msg_hdr));
+    set_data_header(priority);
 
-    if(packetqueue_enqueue_packetbuf(&tc->send_queue,
-                                     FORWARD_PACKET_LIFETIME_BASE *
-                                     packetbuf_attr(PACKETBUF_ATTR_MAX_REXMIT),
-                                     tc)) {
+    if(enqueue_packet(tc, priority, MAX_SENDING_QUEUE)) {
       send_queued_packet(tc);
       ret = 1;
     } else {
@@ -1516,12 +2047,12 @@ collect_purge(struct collect_conn *tc)
 void
 collect_print_stats(void)
 {
-  PRINTF("collect stats foundroute %lu newparent %lu routelost %lu acksent %lu datasent %lu datarecv %lu ackrecv %lu badack %lu duprecv %lu qdrop %lu rtdrop %lu ttldrop %lu ackdrop %lu timedout %lu\n",
+  PRINTF("collect stats foundroute %lu newparent %lu routelost %lu acksent %lu datasent %lu datarecv %lu ackrecv %lu badack %lu duprecv %lu qdrop %lu rtdrop %lu ttldrop %lu ackdrop %lu timedout %lu aggsent %lu aggmerged %lu aggrecv %lu\n",
          stats.foundroute, stats.newparent, stats.routelost,
          stats.acksent, stats.datasent, stats.datarecv,
          stats.ackrecv, stats.badack, stats.duprecv,
          stats.qdrop, stats.rtdrop, stats.ttldrop, stats.ackdrop,
-         stats.timedout);
+         stats.timedout, stats.aggsent, stats.aggmerged, stats.aggrecv);
 }
 /*---------------------------------------------------------------------------*/
 /** @} */
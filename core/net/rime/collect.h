@@ -93,6 +93,17 @@ struct collect_callbacks {
 #define COLLECT_ANNOUNCEMENTS COLLECT_CONF_ANNOUNCEMENTS
 #endif /* COLLECT_CONF_ANNOUNCEMENTS */
 
+/* COLLECT_CONF_AGGREGATION defines if the small packets queued for
+   the parent should be merged into one frame. The first of them
+   waits at most COLLECT_CONF_AGGREGATION_DELAY for others to join
+   it. The aggregates are split at the next hop, so all nodes of the
+   network must have the same setting. */
+#ifdef COLLECT_CONF_AGGREGATION
+#define COLLECT_AGGREGATION COLLECT_CONF_AGGREGATION
+#else
+#define COLLECT_AGGREGATION 0
+#endif /* COLLECT_CONF_AGGREGATION */
+
 struct collect_conn {
   struct unicast_conn unicast_conn;
 #if ! COLLECT_ANNOUNCEMENTS
@@ -112,6 +123,11 @@ struct collect_conn {
 
   struct ctimer proactive_probing_timer;
 
+#if COLLECT_AGGREGATION
+  struct ctimer aggregation_timer;
+  uint8_t aggregation_state;
+#endif /* COLLECT_AGGREGATION */
+
   rimeaddr_t parent, current_parent;
   uint16_t rtmetric;
   uint8_t seqno;
@@ -134,6 +150,20 @@ void collect_close(struct collect_conn *c);
 
 int collect_send(struct collect_conn *c, int rexmits);
 
+/* Priority classes of collect packets. Forwarding nodes send the
+   packets of a higher class first and, within a class, serve the
+   originators in turn. A full queue drops a packet of a lower class
+   to make room. collect_send() uses COLLECT_PRIORITY_NORMAL. */
+enum {
+  COLLECT_PRIORITY_LOW,
+  COLLECT_PRIORITY_NORMAL,
+  COLLECT_PRIORITY_HIGH,
+  COLLECT_PRIORITY_URGENT,
+};
+
+int collect_send_priority(struct collect_conn *c, int rexmits,
+                          uint8_t priority);
+
 void collect_set_sink(struct collect_conn *c, int should_be_sink);
 
 int collect_depth(struct collect_conn *c);
@@ -57,19 +57,23 @@
 #include "net/rime/rudolph2.h"
 #include "cfs/cfs.h"
 
+#include <string.h>
+
 #define SEND_INTERVAL CLOCK_SECOND / 2
 #define STEADY_INTERVAL CLOCK_SECOND * 16
 #define RESEND_INTERVAL SEND_INTERVAL * 4
 #define NACK_TIMEOUT CLOCK_SECOND / 4
 
+/* The version and chunk come first, so that polite only drops our
+   packet when a neighbor sends the same chunk or NACK. */
 struct rudolph2_hdr {
-  uint8_t type;
-  uint8_t hops_from_base;
   uint16_t version;
   uint16_t chunk;
+  uint8_t type;
+  uint8_t hops_from_base;
 };
 
-#define POLITE_HEADER 1
+#define POLITE_HEADER offsetof(struct rudolph2_hdr, hops_from_base)
 
 #define HOPS_MAX 64
 
@@ -92,6 +96,12 @@ enum {
 
 #define LT(a, b) ((signed short)((a) - (b)) < 0)
 
+#if RUDOLPH2_WINDOW < 32
+#define WINDOW_MASK (((uint32_t)1 << RUDOLPH2_WINDOW) - 1)
+#else
+#define WINDOW_MASK 0xffffffffUL
+#endif
+
 /*---------------------------------------------------------------------------*/
 static int
 read_data(struct rudolph2_conn *c, uint8_t *dataptr, int chunk)
@@ -131,10 +141,6 @@ write_data(struct rudolph2_conn *c, int chunk, uint8_t *data, int datalen)
     return;
   }
   
-  if(chunk == 0) {
-    c->cb->write_chunk(c, 0, RUDOLPH2_FLAG_NEWFILE, data, 0);
-  }
-  
   PRINTF("%d.%d: get %d bytes\n",
 	 rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
 	 datalen);
@@ -153,15 +159,15 @@ write_data(struct rudolph2_conn *c, int chunk, uint8_t *data, int datalen)
 }
 /*---------------------------------------------------------------------------*/
 static int
-send_data(struct rudolph2_conn *c, clock_time_t interval)
+send_data(struct rudolph2_conn *c, int chunk, clock_time_t interval)
 {
   int len;
 
-  len = format_data(c, c->snd_nxt);
+  len = format_data(c, chunk);
   polite_send(&c->c, interval, POLITE_HEADER);
   PRINTF("%d.%d: send_data chunk %d, rcv_nxt %d\n",
 	 rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
-	 c->snd_nxt, c->rcv_nxt);
+	 chunk, c->rcv_nxt);
 
   return len;
 }
@@ -170,50 +176,104 @@ static void
 send_nack(struct rudolph2_conn *c)
 {
   struct rudolph2_hdr *hdr;
-  packetbuf_clear();
-  packetbuf_hdralloc(sizeof(struct rudolph2_hdr));
-  hdr = packetbuf_hdrptr();
+  uint32_t missing;
 
+  /* The NACK carries a bitmap of the missing chunks of the window,
+     where bit i stands for chunk rcv_nxt + i. */
+  missing = ~c->rcv_map & WINDOW_MASK;
+
+  packetbuf_clear();
+  hdr = packetbuf_dataptr();
   hdr->hops_from_base = c->hops_from_base;
   hdr->type = TYPE_NACK;
   hdr->version = c->version;
   hdr->chunk = c->rcv_nxt;
+  memcpy(hdr + 1, &missing, sizeof(missing));
+  packetbuf_set_datalen(sizeof(struct rudolph2_hdr) + sizeof(missing));
 
-  PRINTF("%d.%d: Sending nack for %d\n",
+  PRINTF("%d.%d: Sending nack for %d map %08lx\n",
 	 rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
-	 hdr->chunk);
+	 hdr->chunk, (unsigned long)missing);
+  c->nack_time = clock_time();
   polite_send(&c->c, NACK_TIMEOUT, POLITE_HEADER);
 }
 /*---------------------------------------------------------------------------*/
-#if 0 /* Function below not currently used in the code */
+static int
+holds_chunk(struct rudolph2_conn *c, uint16_t chunk)
+{
+  uint16_t i;
+
+  if(LT(chunk, c->rcv_nxt)) {
+    return 1;
+  }
+  i = chunk - c->rcv_nxt;
+  return i < RUDOLPH2_WINDOW && (c->rcv_map & ((uint32_t)1 << i));
+}
+/*---------------------------------------------------------------------------*/
 static void
-send_next(struct rudolph2_conn *c)
+add_repairs(struct rudolph2_conn *c, uint16_t base, uint32_t missing)
 {
-  int len;
-  clock_time_t interval;
+  uint32_t map;
+  uint16_t shift;
+  int i;
 
-  if(c->flags & FLAG_LAST_SENT) {
-    interval = STEADY_INTERVAL;
-  } else {
-    interval = SEND_INTERVAL;
+  /* Only the chunks we hold can be repaired by us, so neighbors that
+     are still receiving the file can help too. */
+  map = 0;
+  for(i = 0; i < 32 && (missing >> i) != 0; i++) {
+    if((missing & ((uint32_t)1 << i)) && holds_chunk(c, base + i)) {
+      map |= (uint32_t)1 << i;
+    }
+  }
+  if(map == 0) {
+    return;
   }
-  
-  len = send_data(c, interval);
 
-  if(len < RUDOLPH2_DATASIZE) {
-    c->flags |= FLAG_LAST_SENT;
+  if(c->snd_map == 0) {
+    c->snd_base = base;
+    c->snd_map = map;
+  } else if(!LT(base, c->snd_base)) {
+    shift = base - c->snd_base;
+    if(shift < 32) {
+      c->snd_map |= map << shift;
+    }
   } else {
-    c->flags &= ~FLAG_LAST_SENT;
+    /* Repair the earliest chunks first. Chunks that no longer fit in
+       the map are asked for again by the next NACK. */
+    shift = c->snd_base - base;
+    c->snd_map = (shift < 32 ? c->snd_map << shift : 0) | map;
+    c->snd_base = base;
   }
-  
-  if(c->nacks == 0 &&
-     len == RUDOLPH2_DATASIZE &&
-     c->snd_nxt + 1 < c->rcv_nxt) {
-    c->snd_nxt++;
+}
+/*---------------------------------------------------------------------------*/
+static int
+next_repair(struct rudolph2_conn *c)
+{
+  int i;
+
+  if(c->snd_map == 0) {
+    return -1;
+  }
+  for(i = 0; (c->snd_map & ((uint32_t)1 << i)) == 0; i++);
+  c->snd_map &= ~((uint32_t)1 << i);
+  return (uint16_t)(c->snd_base + i);
+}
+/*---------------------------------------------------------------------------*/
+static void
+adapt_rate(struct rudolph2_conn *c)
+{
+  /* Additive increase, multiplicative decrease of the number of
+     chunks sent per SEND_INTERVAL. A NACK means that chunks were
+     lost. */
+  if(c->nacks > 0) {
+    c->burst = c->burst > 1 ? c->burst / 2 : 1;
+    c->credit = 0;
+  } else if(c->burst < RUDOLPH2_MAX_BURST && ++c->credit >= c->burst) {
+    c->burst++;
+    c->credit = 0;
   }
   c->nacks = 0;
 }
-#endif /* 0 */
 /*---------------------------------------------------------------------------*/
 static void
 sent(struct polite_conn *polite)
@@ -250,25 +310,26 @@ timed_send(void *ptr)
 {
   struct rudolph2_conn *c = (struct rudolph2_conn *)ptr;
   clock_time_t interval;
+  int chunk;
   int len;
   
-  if((c->flags & FLAG_IS_STOPPED) == 0 &&
-     (c->flags & FLAG_LAST_RECEIVED)) {
-    /*    if(c->snd_nxt + 1 < c->rcv_nxt) {
-      interval = SEND_INTERVAL;
-    } else {
-      interval = STEADY_INTERVAL;
-      }*/
-    /*    send_data(c, interval);*/
+  if(c->flags & FLAG_IS_STOPPED) {
+    return;
+  }
 
+  adapt_rate(c);
+  interval = SEND_INTERVAL / c->burst;
+
+  chunk = next_repair(c);
+  if(chunk >= 0) {
+    /* Repairs go before new chunks. */
+    send_data(c, chunk, interval);
+  } else if(c->flags & FLAG_LAST_RECEIVED) {
     if(c->flags & FLAG_LAST_SENT) {
       interval = STEADY_INTERVAL;
-    } else {
-      interval = SEND_INTERVAL;
     }
-  
 
-    len = send_data(c, interval);
+    len = send_data(c, c->snd_nxt, interval);
     
     if(len < RUDOLPH2_DATASIZE) {
       c->flags |= FLAG_LAST_SENT;
@@ -276,13 +337,87 @@ timed_send(void *ptr)
       c->flags &= ~FLAG_LAST_SENT;
     }
     
-    if(c->nacks == 0 &&
-       len == RUDOLPH2_DATASIZE &&
-     c->snd_nxt + 1 < c->rcv_nxt) {
+    if(len == RUDOLPH2_DATASIZE &&
+       c->snd_nxt + 1 < c->rcv_nxt) {
       c->snd_nxt++;
     }
-    c->nacks = 0;
-    ctimer_set(&c->t, interval, timed_send, c);
+  } else {
+    /* A node that is still receiving only sends repairs. */
+    return;
+  }
+  ctimer_set(&c->t, interval, timed_send, c);
+}
+/*---------------------------------------------------------------------------*/
+static void
+recv_nack(struct rudolph2_conn *c, struct rudolph2_hdr *hdr)
+{
+  uint32_t missing;
+
+  if(hdr->version == c->version) {
+    if(packetbuf_datalen() >= sizeof(struct rudolph2_hdr) + sizeof(missing)) {
+      memcpy(&missing, hdr + 1, sizeof(missing));
+    } else {
+      missing = 1;
+    }
+    add_repairs(c, hdr->chunk, missing);
+  } else if(LT(hdr->version, c->version) &&
+            (c->flags & FLAG_LAST_RECEIVED)) {
+    c->snd_nxt = 0;
+    c->snd_map = 0;
+  } else {
+    return;
+  }
+
+  /* Send the repairs soon, unless chunks are already sent at the
+     pipelined rate. */
+  c->nacks++;
+  if(ctimer_expired(&c->t) || (c->flags & FLAG_LAST_SENT)) {
+    ctimer_set(&c->t, NACK_TIMEOUT, timed_send, c);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+recv_chunk(struct rudolph2_conn *c, uint16_t chunk)
+{
+  uint16_t i;
+  int len;
+
+  packetbuf_hdrreduce(sizeof(struct rudolph2_hdr));
+  len = packetbuf_totlen();
+
+  if(chunk == c->rcv_nxt) {
+    PRINTF("%d.%d: received chunk %d len %d\n",
+	   rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
+	   chunk, len);
+    write_data(c, chunk, packetbuf_dataptr(), len);
+    /* Move past the chunks that were received out of order. */
+    do {
+      c->rcv_nxt++;
+      c->rcv_map >>= 1;
+    } while(c->rcv_map & 1);
+    if(len < RUDOLPH2_DATASIZE) {
+      c->flags |= FLAG_LAST_RECEIVED;
+      send_data(c, c->snd_nxt, RESEND_INTERVAL);
+      ctimer_set(&c->t, RESEND_INTERVAL, timed_send, c);
+    }
+  } else if(LT(c->rcv_nxt, chunk)) {
+    i = chunk - c->rcv_nxt;
+    /* The last chunk is the only short one and is only accepted in
+       order, so that RUDOLPH2_FLAG_LASTCHUNK still means that the file
+       is complete. */
+    if(i < RUDOLPH2_WINDOW && len == RUDOLPH2_DATASIZE &&
+       (c->rcv_map & ((uint32_t)1 << i)) == 0) {
+      PRINTF("%d.%d: received chunk %d out of order, rcv_nxt %d\n",
+	     rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
+	     chunk, c->rcv_nxt);
+      write_data(c, chunk, packetbuf_dataptr(), len);
+      c->rcv_map |= (uint32_t)1 << i;
+    }
+    if(clock_time() - c->nack_time >= NACK_TIMEOUT * 2) {
+      send_nack(c);
+    }
+  } else {
+    /* Ignore packets with a lower chunk number */
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -296,20 +431,11 @@ recv(struct polite_conn *polite)
      than us. */
 
   if(hdr->type == TYPE_NACK && hdr->hops_from_base > c->hops_from_base) {
-    c->nacks++;
     PRINTF("%d.%d: Got NACK for %d:%d (%d:%d)\n",
 	   rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
 	   hdr->version, hdr->chunk,
 	   c->version, c->rcv_nxt);
-    if(hdr->version == c->version) {
-      if(hdr->chunk < c->rcv_nxt) {
-	c->snd_nxt = hdr->chunk;
-	send_data(c, SEND_INTERVAL);
-      }
-    } else if(LT(hdr->version, c->version)) {
-      c->snd_nxt = 0;
-      send_data(c, SEND_INTERVAL);
-    }
+    recv_nack(c, hdr);
   } else if(hdr->type == TYPE_DATA) {
     if(hdr->hops_from_base < c->hops_from_base) {
       /* Only accept data from nodes that are closer to the base than
@@ -321,41 +447,23 @@ recv(struct polite_conn *polite)
 	       hdr->version, hdr->chunk);
 	c->version = hdr->version;
 	c->snd_nxt = c->rcv_nxt = 0;
+	c->rcv_map = c->snd_map = 0;
+	c->nack_time = clock_time() - NACK_TIMEOUT * 2;
 	c->flags &= ~FLAG_LAST_RECEIVED;
 	c->flags &= ~FLAG_LAST_SENT;
-	if(hdr->chunk != 0) {
-	  send_nack(c);
-	} else {
-	  packetbuf_hdrreduce(sizeof(struct rudolph2_hdr));
-	  write_data(c, 0, packetbuf_dataptr(), packetbuf_totlen());
+	ctimer_stop(&c->t);
+	/* Chunks may be written out of order, so the application is
+	   told about the new file before any of them. */
+	if((c->flags & FLAG_IS_STOPPED) == 0) {
+	  c->cb->write_chunk(c, 0, RUDOLPH2_FLAG_NEWFILE,
+			     (uint8_t *)(hdr + 1), 0);
 	}
+	recv_chunk(c, hdr->chunk);
       } else if(hdr->version == c->version) {
 	PRINTF("%d.%d: got chunk %d snd_nxt %d rcv_nxt %d\n",
 	       rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
 	       hdr->chunk, c->snd_nxt, c->rcv_nxt);
-	
-	if(hdr->chunk == c->rcv_nxt) {
-	  int len;
-	  packetbuf_hdrreduce(sizeof(struct rudolph2_hdr));
-	  PRINTF("%d.%d: received chunk %d len %d\n",
-		 rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
-		 hdr->chunk, packetbuf_totlen());
-	  len = packetbuf_totlen();
-	  write_data(c, hdr->chunk, packetbuf_dataptr(), packetbuf_totlen());
-	  c->rcv_nxt++;
-	  if(len < RUDOLPH2_DATASIZE) {
-	    c->flags |= FLAG_LAST_RECEIVED;
-	    send_data(c, RESEND_INTERVAL);
-	    ctimer_set(&c->t, RESEND_INTERVAL, timed_send, c);
-	  }
-	} else if(hdr->chunk > c->rcv_nxt) {
-	  PRINTF("%d.%d: received chunk %d > %d, sending NACK\n",
-		 rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
-		 hdr->chunk, c->rcv_nxt);
-	  send_nack(c);
-	} else if(hdr->chunk < c->rcv_nxt) {
-	  /* Ignore packets with a lower chunk number */
-	}
+	recv_chunk(c, hdr->chunk);
       }
     }
   }
@@ -371,6 +479,9 @@ rudolph2_open(struct rudolph2_conn *c, uint16_t channel,
   c->cb = cb;
   c->version = 0;
   c->hops_from_base = HOPS_MAX;
+  c->rcv_map = c->snd_map = 0;
+  c->burst = 1;
+  c->credit = 0;
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -387,6 +498,9 @@ rudolph2_send(struct rudolph2_conn *c, clock_time_t send_interval)
   c->hops_from_base = 0;
   c->version++;
   c->snd_nxt = 0;
+  c->rcv_map = c->snd_map = 0;
+  c->burst = 1;
+  c->credit = 0;
   len = RUDOLPH2_DATASIZE;
   packetbuf_clear();
   for(c->rcv_nxt = 0; len == RUDOLPH2_DATASIZE; c->rcv_nxt++) {
@@ -394,7 +508,7 @@ rudolph2_send(struct rudolph2_conn *c, clock_time_t send_interval)
   }
   c->flags = FLAG_LAST_RECEIVED;
   /*  printf("Highest chunk %d\n", c->rcv_nxt);*/
-  send_data(c, SEND_INTERVAL);
+  send_data(c, c->snd_nxt, SEND_INTERVAL);
   ctimer_set(&c->t, SEND_INTERVAL, timed_send, c);
 }
 /*---------------------------------------------------------------------------*/
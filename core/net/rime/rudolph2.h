@@ -10,6 +10,14 @@
  * The rudolph2 module implements a single-hop reliable bulk data
  * transfer mechanism.
  *
+ * Receivers accept chunks out of order within a window and ask for the
+ * missing ones with a bitmap. Any node closer to the base that holds a
+ * requested chunk may repair it. The write_chunk callback may therefore
+ * be called with offsets out of order, after a call with
+ * RUDOLPH2_FLAG_NEWFILE. The call with RUDOLPH2_FLAG_LASTCHUNK is
+ * always the last one for a file. The sender adapts the number of
+ * chunks it sends per interval to the NACKs it receives.
+ *
  * \section channels Channels
  *
  * The rudolph2 module uses 2 channels; one for data packets and one
@@ -80,15 +88,45 @@ struct rudolph2_callbacks {
 
 #define RUDOLPH2_DATASIZE 64
 
+/* The number of chunks, from the first missing one, that a receiver
+   accepts out of order and reports in its NACKs. At most 32. With the
+   default of 1, write_chunk() is called in order; a larger window
+   recovers faster from losses, but only suits receivers that can
+   write the chunks at any offset. */
+#ifdef RUDOLPH2_CONF_WINDOW
+#define RUDOLPH2_WINDOW RUDOLPH2_CONF_WINDOW
+#else
+#define RUDOLPH2_WINDOW 1
+#endif
+
+#if RUDOLPH2_WINDOW > 32
+#error RUDOLPH2_CONF_WINDOW must be at most 32, the size of rcv_map
+#endif
+
+/* The largest number of chunks sent per send interval. */
+#ifdef RUDOLPH2_CONF_MAX_BURST
+#define RUDOLPH2_MAX_BURST RUDOLPH2_CONF_MAX_BURST
+#else
+#define RUDOLPH2_MAX_BURST 4
+#endif
+
 struct rudolph2_conn {
   struct polite_conn c;
   const struct rudolph2_callbacks *cb;
   struct ctimer t;
+  clock_time_t nack_time;
+  /* Chunks received after rcv_nxt; bit i is chunk rcv_nxt + i. */
+  uint32_t rcv_map;
+  /* Chunks to repair; bit i is chunk snd_base + i. */
+  uint32_t snd_map;
   uint16_t snd_nxt, rcv_nxt;
+  uint16_t snd_base;
   uint16_t version;
   uint8_t hops_from_base;
   uint8_t nacks;
   uint8_t flags;
+  uint8_t burst;
+  uint8_t credit;
 };
 
 void rudolph2_open(struct rudolph2_conn *c, uint16_t channel,
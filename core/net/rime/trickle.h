@@ -59,6 +59,7 @@
 #define __TRICKLE_H__
 
 #include "sys/ctimer.h"
+#include "lib/trickle-timer.h"
 
 #include "net/rime/broadcast.h"
 #include "net/queuebuf.h"
@@ -75,13 +76,11 @@ struct trickle_callbacks {
 struct trickle_conn {
   struct broadcast_conn c;
   const struct trickle_callbacks *cb;
-  struct ctimer t, interval_timer, first_transmission_timer;
-  struct pt pt;
+  struct trickle_timer tt;
+  struct ctimer first_transmission_timer;
   struct queuebuf *q;
   clock_time_t interval;
   uint8_t seqno;
-  uint8_t interval_scaling;
-  uint8_t duplicates;
 };
 
 void trickle_open(struct trickle_conn *c, clock_time_t interval,
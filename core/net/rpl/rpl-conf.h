@@ -154,4 +154,136 @@
 #define RPL_DIO_REDUNDANCY          10
 #endif
 
+/*
+ * Enable support for the non-storing mode of operation. In this mode
+ * only the root keeps downward routes: the other nodes report their
+ * parent to the root, and the root adds a source routing header
+ * (RFC 6554) to the packets it sends down the DAG. Non-root nodes can
+ * then be built with a small UIP_CONF_DS6_ROUTE_NBU.
+ *
+ * The root must also be configured with RPL_CONF_MOP set to
+ * RPL_MOP_NON_STORING, which is the default when this is enabled.
+ */
+#ifdef RPL_CONF_WITH_NON_STORING
+#define RPL_WITH_NON_STORING RPL_CONF_WITH_NON_STORING
+#else
+#define RPL_WITH_NON_STORING 0
+#endif /* RPL_CONF_WITH_NON_STORING */
+
+/*
+ * Number of child-parent links the root can keep in non-storing mode.
+ * Each link uses 18 bytes of RAM on a 16-bit MCU. Only the root uses
+ * this table.
+ */
+#ifdef RPL_NS_CONF_LINK_NUM
+#define RPL_NS_LINK_NUM RPL_NS_CONF_LINK_NUM
+#else
+#define RPL_NS_LINK_NUM 32
+#endif /* RPL_NS_CONF_LINK_NUM */
+
+/*
+ * Enable downward route summaries in storing mode. Each child keeps a
+ * Bloom filter of the addresses announced in the DAOs it forwards to
+ * us, so that downward traffic can reach more descendants than the
+ * routing table holds. The routing table then only caches exact routes
+ * for the most used destinations.
+ *
+ * A destination that matches the filters of several children, or only
+ * the filter of the child the packet came from, is sent on the default
+ * route instead.
+ */
+#ifdef RPL_CONF_WITH_ROUTE_SUMMARY
+#define RPL_WITH_ROUTE_SUMMARY RPL_CONF_WITH_ROUTE_SUMMARY
+#else
+#define RPL_WITH_ROUTE_SUMMARY 0
+#endif /* RPL_CONF_WITH_ROUTE_SUMMARY */
+
+/*
+ * Number of children that can have a route summary.
+ */
+#ifdef RPL_SUMMARY_CONF_CHILDREN
+#define RPL_SUMMARY_CHILDREN RPL_SUMMARY_CONF_CHILDREN
+#else
+#define RPL_SUMMARY_CHILDREN 4
+#endif /* RPL_SUMMARY_CONF_CHILDREN */
+
+/*
+ * Size of each Bloom filter in bits. Must be a power of two. Each
+ * child uses two filters, so that old entries can be aged out. With
+ * the default size and three hash functions, a child summarizing 50
+ * descendants has a false positive rate of about 10%.
+ */
+#ifdef RPL_SUMMARY_CONF_FILTER_BITS
+#define RPL_SUMMARY_FILTER_BITS RPL_SUMMARY_CONF_FILTER_BITS
+#else
+#define RPL_SUMMARY_FILTER_BITS 256
+#endif /* RPL_SUMMARY_CONF_FILTER_BITS */
+
+/*
+ * Number of hash functions of the Bloom filters.
+ */
+#ifdef RPL_SUMMARY_CONF_HASHES
+#define RPL_SUMMARY_HASHES RPL_SUMMARY_CONF_HASHES
+#else
+#define RPL_SUMMARY_HASHES 3
+#endif /* RPL_SUMMARY_CONF_HASHES */
+
+/*
+ * Age of the route summaries, in seconds. Every period the older
+ * filter of each child is cleared and starts collecting the refreshed
+ * DAOs, so that a descendant that has moved away is forgotten after
+ * two periods. The default is twice the maximum DIO interval, as every
+ * DIO solicits new DAOs from the children.
+ */
+#ifdef RPL_SUMMARY_CONF_PERIOD
+#define RPL_SUMMARY_PERIOD RPL_SUMMARY_CONF_PERIOD
+#else
+#define RPL_SUMMARY_PERIOD \
+  ((2UL << (RPL_DIO_INTERVAL_MIN + RPL_DIO_INTERVAL_DOUBLINGS)) / 1000)
+#endif /* RPL_SUMMARY_CONF_PERIOD */
+
+/*
+ * Aggregate the targets of the DAOs received from the children. In
+ * storing mode, instead of forwarding each DAO to the preferred
+ * parent, a node collects the targets during a short window and sends
+ * them in a single DAO, together with its own target if its DAO timer
+ * fires in the meantime. Disabled by default.
+ */
+#ifdef RPL_CONF_WITH_DAO_AGGREGATION
+#define RPL_WITH_DAO_AGGREGATION RPL_CONF_WITH_DAO_AGGREGATION
+#else
+#define RPL_WITH_DAO_AGGREGATION 0
+#endif /* RPL_CONF_WITH_DAO_AGGREGATION */
+
+/*
+ * Number of targets that can wait for an aggregated DAO. DAOs whose
+ * targets do not fit are forwarded as they are.
+ */
+#ifdef RPL_DAO_CONF_AGGREGATION_TARGETS
+#define RPL_DAO_AGGREGATION_TARGETS RPL_DAO_CONF_AGGREGATION_TARGETS
+#else
+#define RPL_DAO_AGGREGATION_TARGETS 8
+#endif /* RPL_DAO_CONF_AGGREGATION_TARGETS */
+
+/*
+ * Time a target may wait for other targets before being sent.
+ */
+#ifdef RPL_DAO_CONF_AGGREGATION_WINDOW
+#define RPL_DAO_AGGREGATION_WINDOW RPL_DAO_CONF_AGGREGATION_WINDOW
+#else
+#define RPL_DAO_AGGREGATION_WINDOW CLOCK_SECOND
+#endif /* RPL_DAO_CONF_AGGREGATION_WINDOW */
+
+/*
+ * Maximum size of the RPL part of an aggregated DAO, in bytes. The
+ * default keeps a DAO between link-local addresses within a single
+ * 802.15.4 frame. It can be raised up to the size allowed by the
+ * 6LoWPAN fragmentation when fragments are unlikely to be lost.
+ */
+#ifdef RPL_DAO_CONF_AGGREGATION_MAX_SIZE
+#define RPL_DAO_AGGREGATION_MAX_SIZE RPL_DAO_CONF_AGGREGATION_MAX_SIZE
+#else
+#define RPL_DAO_AGGREGATION_MAX_SIZE 80
+#endif /* RPL_DAO_CONF_AGGREGATION_MAX_SIZE */
+
 #endif /* RPL_CONF_H */
@@ -293,3 +293,169 @@ rpl_invert_header(void)
   }
 }
 /************************************************************************/
+#if RPL_WITH_NON_STORING
+#define UIP_RH_BUF                ((struct uip_routing_hdr *)&uip_buf[uip_l2_l3_hdr_len])
+#define UIP_IPH_RH_BUF            ((struct uip_routing_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
+#define UIP_IPH_EXT_PTR           (&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
+/************************************************************************/
+static void
+set_link_local(uip_ipaddr_t *ll, const uip_ipaddr_t *addr)
+{
+  uip_ip6addr(ll, 0xfe80, 0, 0, 0, 0, 0, 0, 0);
+  memcpy(&ll->u8[8], &addr->u8[8], 8);
+}
+/************************************************************************/
+int
+rpl_process_srh_header(void)
+{
+  uint8_t *srh;
+  uint8_t *slot;
+  uip_ipaddr_t addr;
+  int ext_len;
+  uint8_t cmpri, cmpre, pad;
+  uint8_t n, i, size;
+
+  srh = (uint8_t *)UIP_RH_BUF;
+  cmpri = srh[4] >> 4;
+  cmpre = srh[4] & 0x0f;
+  pad = srh[5] >> 4;
+  ext_len = (UIP_RH_BUF->len << 3) + 8;
+
+  if(UIP_IPH_LEN + uip_ext_len + ext_len > uip_len) {
+    PRINTF("RPL: Source routing header longer than the packet\n");
+    return 0;
+  }
+  if(ext_len < RPL_SRH_LEN + pad + (16 - cmpre)) {
+    PRINTF("RPL: Bad source routing header length\n");
+    return 0;
+  }
+  n = ((ext_len - RPL_SRH_LEN - pad - (16 - cmpre)) / (16 - cmpri)) + 1;
+  if(UIP_RH_BUF->seg_left > n) {
+    PRINTF("RPL: Bad segments left in source routing header\n");
+    return 0;
+  }
+
+  /* The elided octets of the next address are those of the current
+     destination address. */
+  i = n - UIP_RH_BUF->seg_left;
+  size = i == n - 1 ? 16 - cmpre : 16 - cmpri;
+  slot = srh + RPL_SRH_LEN + i * (16 - cmpri);
+  uip_ipaddr_copy(&addr, &UIP_IP_BUF->destipaddr);
+  memcpy(&addr.u8[16 - size], slot, size);
+
+  if(uip_is_addr_mcast(&addr) || uip_ds6_is_my_addr(&addr)) {
+    PRINTF("RPL: Invalid or looping address in source routing header\n");
+    return 0;
+  }
+
+  /* Swap the addresses, so that the header records the path taken. */
+  memcpy(slot, &UIP_IP_BUF->destipaddr.u8[16 - size], size);
+  uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &addr);
+  UIP_RH_BUF->seg_left--;
+
+  PRINTF("RPL: Source routing to ");
+  PRINT6ADDR(&UIP_IP_BUF->destipaddr);
+  PRINTF(", %u segments left\n", UIP_RH_BUF->seg_left);
+  return 1;
+}
+/************************************************************************/
+static int
+insert_srh(rpl_dag_t *dag)
+{
+  rpl_ns_node_t *path[RPL_SRH_MAX_HOPS];
+  uint8_t *srh;
+  int len;
+  int hdr_len;
+  uint8_t cmpr, addr_size, pad;
+  uint8_t i, j;
+
+  len = rpl_ns_get_path(dag, &UIP_IP_BUF->destipaddr, path, RPL_SRH_MAX_HOPS);
+  if(len == 0) {
+    return 0;
+  }
+  if(len == 1) {
+    /* The destination is a child of the root. */
+    return 1;
+  }
+
+  /* Source routed packets cannot loop, so the RPL hop-by-hop option
+     is not needed. */
+  if(UIP_IP_BUF->proto == UIP_PROTO_HBHO) {
+    rpl_remove_header();
+  }
+
+  /* All nodes share the DAG prefix. Elide the interface identifier
+     octets that are common to all hops as well. */
+  cmpr = 15;
+  for(i = 1; i < len; i++) {
+    j = 0;
+    while(8 + j < cmpr && path[i]->iid[j] == path[0]->iid[j]) {
+      j++;
+    }
+    cmpr = 8 + j;
+  }
+  addr_size = 16 - cmpr;
+  hdr_len = (len - 1) * addr_size;
+  pad = (8 - (hdr_len & 7)) & 7;
+  hdr_len += RPL_SRH_LEN + pad;
+
+  if(uip_len + hdr_len > UIP_BUFSIZE - UIP_LLH_LEN) {
+    PRINTF("RPL: Packet too long for a source routing header\n");
+    return 0;
+  }
+
+  memmove(UIP_IPH_EXT_PTR + hdr_len, UIP_IPH_EXT_PTR, uip_len - UIP_IPH_LEN);
+  srh = UIP_IPH_EXT_PTR;
+  memset(srh, 0, hdr_len);
+  UIP_IPH_RH_BUF->next = UIP_IP_BUF->proto;
+  UIP_IPH_RH_BUF->len = (hdr_len >> 3) - 1;
+  UIP_IPH_RH_BUF->routing_type = RPL_RH_TYPE_SRH;
+  UIP_IPH_RH_BUF->seg_left = len - 1;
+  srh[4] = (cmpr << 4) | cmpr;
+  srh[5] = pad << 4;
+  for(i = 1; i < len; i++) {
+    memcpy(srh + RPL_SRH_LEN + (i - 1) * addr_size,
+           &path[i]->iid[8 - addr_size], addr_size);
+  }
+
+  /* The first hop becomes the destination of the packet. */
+  UIP_IP_BUF->proto = UIP_PROTO_ROUTING;
+  memcpy(&UIP_IP_BUF->destipaddr.u8[8], path[0]->iid, 8);
+  uip_len += hdr_len;
+  UIP_IP_BUF->len[0] = (uip_len - UIP_IPH_LEN) >> 8;
+  UIP_IP_BUF->len[1] = (uip_len - UIP_IPH_LEN) & 0xff;
+
+  PRINTF("RPL: Inserted a source routing header of %d bytes, %d hops\n",
+         hdr_len, len);
+  return 1;
+}
+/************************************************************************/
+int
+rpl_srh_next_hop(uip_ipaddr_t *nexthop)
+{
+  rpl_dag_t *dag;
+
+  if(UIP_IP_BUF->proto != UIP_PROTO_ROUTING ||
+     UIP_IPH_RH_BUF->routing_type != RPL_RH_TYPE_SRH) {
+    /* Only the root of a non-storing DAG adds source routing headers,
+       to the nodes of the DAG. */
+    if(uip_is_addr_link_local(&UIP_IP_BUF->destipaddr) ||
+       default_instance == NULL ||
+       default_instance->mop != RPL_MOP_NON_STORING ||
+       default_instance->current_dag == NULL) {
+      return 0;
+    }
+    dag = default_instance->current_dag;
+    if(!dag->joined || dag->rank != ROOT_RANK(default_instance) ||
+       !insert_srh(dag)) {
+      return 0;
+    }
+  }
+
+  /* A source route is strict: the destination address is always a
+     neighbor. */
+  set_link_local(nexthop, &UIP_IP_BUF->destipaddr);
+  return 1;
+}
+/************************************************************************/
+#endif /* RPL_WITH_NON_STORING */
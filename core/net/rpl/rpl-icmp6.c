@@ -544,6 +544,277 @@ dio_output(rpl_instance_t *instance, uip_ipaddr_t *uc_addr)
 #endif /* RPL_LEAF_ONLY */
 }
 /*---------------------------------------------------------------------------*/
+#if RPL_WITH_DAO_AGGREGATION
+/* Targets learned from the DAOs of our children, waiting to be sent to
+   our preferred parent together. */
+struct dao_target {
+  uip_ipaddr_t prefix;
+  uint8_t prefixlen;
+  uint8_t lifetime;
+};
+
+static struct dao_target dao_targets[RPL_DAO_AGGREGATION_TARGETS];
+static uint8_t dao_target_num;
+static rpl_instance_t *dao_target_instance;
+static struct ctimer dao_aggregation_timer;
+
+static void dao_aggregation_flush(void *ptr);
+#endif /* RPL_WITH_DAO_AGGREGATION */
+/*---------------------------------------------------------------------------*/
+static int
+dao_target_size(uint8_t prefixlen)
+{
+  return 4 + (prefixlen + 7) / CHAR_BIT;
+}
+/*---------------------------------------------------------------------------*/
+static int
+dao_write_header(rpl_instance_t *instance, unsigned char *buffer)
+{
+  int pos;
+
+  RPL_LOLLIPOP_INCREMENT(dao_sequence);
+  pos = 0;
+
+  buffer[pos++] = instance->instance_id;
+  buffer[pos] = 0;
+#if RPL_DAO_SPECIFY_DAG
+  buffer[pos] |= RPL_DAO_D_FLAG;
+#endif /* RPL_DAO_SPECIFY_DAG */
+#if RPL_CONF_DAO_ACK
+  buffer[pos] |= RPL_DAO_K_FLAG;
+#endif /* RPL_CONF_DAO_ACK */
+  ++pos;
+  buffer[pos++] = 0; /* reserved */
+  buffer[pos++] = dao_sequence;
+#if RPL_DAO_SPECIFY_DAG
+  memcpy(buffer + pos, &instance->current_dag->dag_id,
+         sizeof(instance->current_dag->dag_id));
+  pos += sizeof(instance->current_dag->dag_id);
+#endif /* RPL_DAO_SPECIFY_DAG */
+
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static int
+dao_write_target(unsigned char *buffer, int pos,
+                 uip_ipaddr_t *prefix, uint8_t prefixlen)
+{
+  buffer[pos++] = RPL_OPTION_TARGET;
+  buffer[pos++] = 2 + ((prefixlen + 7) / CHAR_BIT);
+  buffer[pos++] = 0; /* reserved */
+  buffer[pos++] = prefixlen;
+  memcpy(buffer + pos, prefix, (prefixlen + 7) / CHAR_BIT);
+  pos += ((prefixlen + 7) / CHAR_BIT);
+
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static int
+dao_write_transit(unsigned char *buffer, int pos, uint8_t lifetime,
+                  uip_ipaddr_t *parent)
+{
+  buffer[pos++] = RPL_OPTION_TRANSIT;
+  buffer[pos++] = parent == NULL ? 4 : 4 + sizeof(uip_ipaddr_t);
+  buffer[pos++] = 0; /* flags - ignored */
+  buffer[pos++] = 0; /* path control - ignored */
+  buffer[pos++] = 0; /* path seq - ignored */
+  buffer[pos++] = lifetime;
+  if(parent != NULL) {
+    memcpy(buffer + pos, parent, sizeof(uip_ipaddr_t));
+    pos += sizeof(uip_ipaddr_t);
+  }
+
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+#if RPL_WITH_DAO_AGGREGATION
+static int
+dao_append_targets(rpl_instance_t *instance, unsigned char *buffer, int pos)
+{
+  struct dao_target *t;
+  int i;
+  int size;
+
+  if(instance != dao_target_instance) {
+    return pos;
+  }
+
+  /* Consecutive targets with the same lifetime share a transit
+     information option. */
+  for(i = 0; i < dao_target_num; i++) {
+    t = &dao_targets[i];
+    size = dao_target_size(t->prefixlen) + RPL_DAO_TRANSIT_LEN;
+    if(pos + size > RPL_DAO_AGGREGATION_MAX_SIZE) {
+      break;
+    }
+    pos = dao_write_target(buffer, pos, &t->prefix, t->prefixlen);
+    if(i + 1 == dao_target_num || dao_targets[i + 1].lifetime != t->lifetime ||
+       pos + RPL_DAO_TRANSIT_LEN +
+       dao_target_size(dao_targets[i + 1].prefixlen) + RPL_DAO_TRANSIT_LEN >
+       RPL_DAO_AGGREGATION_MAX_SIZE) {
+      pos = dao_write_transit(buffer, pos, t->lifetime, NULL);
+    }
+  }
+
+  PRINTF("RPL: Aggregated %d DAO targets\n", i);
+
+  /* Keep the targets that did not fit for the next DAO. */
+  dao_target_num -= i;
+  memmove(dao_targets, dao_targets + i, dao_target_num * sizeof(dao_targets[0]));
+  if(dao_target_num > 0) {
+    ctimer_set(&dao_aggregation_timer, 0, dao_aggregation_flush, NULL);
+  } else {
+    ctimer_stop(&dao_aggregation_timer);
+  }
+
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static void
+dao_aggregation_flush(void *ptr)
+{
+  rpl_instance_t *instance;
+  rpl_parent_t *parent;
+  unsigned char *buffer;
+  int pos;
+
+  instance = dao_target_instance;
+  if(dao_target_num == 0 || instance == NULL || !instance->used ||
+     instance->current_dag == NULL ||
+     instance->current_dag->preferred_parent == NULL) {
+    dao_target_num = 0;
+    return;
+  }
+  parent = instance->current_dag->preferred_parent;
+
+  buffer = UIP_ICMP_PAYLOAD;
+  pos = dao_write_header(instance, buffer);
+  pos = dao_append_targets(instance, buffer, pos);
+
+  PRINTF("RPL: Sending aggregated DAO to ");
+  PRINT6ADDR(&parent->addr);
+  PRINTF("\n");
+
+  uip_icmp6_send(&parent->addr, ICMP6_RPL, RPL_CODE_DAO, pos);
+}
+/*---------------------------------------------------------------------------*/
+static int
+dao_aggregate(rpl_instance_t *instance, uip_ipaddr_t *prefix,
+              uint8_t prefixlen, uint8_t lifetime)
+{
+  struct dao_target *t;
+  int size;
+  int i;
+
+  if(dao_target_num > 0 && instance != dao_target_instance) {
+    /* Only one instance is aggregated at a time. */
+    return 0;
+  }
+
+  for(i = 0; i < dao_target_num; i++) {
+    t = &dao_targets[i];
+    if(t->prefixlen == prefixlen &&
+       uip_ipaddr_prefixcmp(&t->prefix, prefix, prefixlen)) {
+      break;
+    }
+  }
+  if(i == dao_target_num) {
+    if(dao_target_num == RPL_DAO_AGGREGATION_TARGETS) {
+      return 0;
+    }
+    dao_target_num++;
+  }
+
+  t = &dao_targets[i];
+  uip_ipaddr_copy(&t->prefix, prefix);
+  t->prefixlen = prefixlen;
+  t->lifetime = lifetime;
+  dao_target_instance = instance;
+
+  /* Send the DAO as soon as the targets fill it up. */
+  size = 4 + (RPL_DAO_SPECIFY_DAG ? sizeof(uip_ipaddr_t) : 0);
+  for(i = 0; i < dao_target_num; i++) {
+    size += dao_target_size(dao_targets[i].prefixlen) + RPL_DAO_TRANSIT_LEN;
+  }
+  if(size >= RPL_DAO_AGGREGATION_MAX_SIZE) {
+    ctimer_set(&dao_aggregation_timer, 0, dao_aggregation_flush, NULL);
+  } else if(dao_target_num == 1) {
+    ctimer_set(&dao_aggregation_timer, RPL_DAO_AGGREGATION_WINDOW,
+               dao_aggregation_flush, NULL);
+  }
+
+  return 1;
+}
+#endif /* RPL_WITH_DAO_AGGREGATION */
+/*---------------------------------------------------------------------------*/
+static int
+dao_target_input(rpl_instance_t *instance, uip_ipaddr_t *from,
+                 int learned_from, uip_ipaddr_t *prefix, uint8_t prefixlen,
+                 uint8_t lifetime, uip_ipaddr_t *parent_addr)
+{
+  rpl_dag_t *dag;
+  uip_ds6_route_t *rep;
+  int summarized;
+
+  dag = instance->current_dag;
+
+  PRINTF("RPL: DAO lifetime: %u, prefix length: %u prefix: ",
+          (unsigned)lifetime, (unsigned)prefixlen);
+  PRINT6ADDR(prefix);
+  PRINTF("\n");
+
+#if RPL_WITH_NON_STORING
+  if(instance->mop == RPL_MOP_NON_STORING) {
+    if(parent_addr == NULL) {
+      PRINTF("RPL: Ignoring a non-storing DAO without parent address\n");
+      RPL_STAT(rpl_stats.malformed_msgs++);
+      return 0;
+    }
+    if(rpl_ns_update_node(dag, prefix, parent_addr,
+                          RPL_LIFETIME(instance, lifetime)) == NULL &&
+       lifetime != RPL_ZERO_LIFETIME) {
+      RPL_STAT(rpl_stats.mem_overflows++);
+      PRINTF("RPL: Could not add a non-storing link after receiving a DAO\n");
+      return 0;
+    }
+    return 1;
+  }
+#endif /* RPL_WITH_NON_STORING */
+
+  if(lifetime == RPL_ZERO_LIFETIME) {
+    /* No-Path DAO received; invoke the route purging routine. */
+    rep = uip_ds6_route_lookup(prefix);
+    if(rep != NULL && rep->state.saved_lifetime == 0 && rep->length == prefixlen) {
+      PRINTF("RPL: Setting expiration timer for prefix ");
+      PRINT6ADDR(prefix);
+      PRINTF("\n");
+      rep->state.saved_lifetime = rep->state.lifetime;
+      rep->state.lifetime = DAO_EXPIRATION_TIMEOUT;
+    }
+    return 0;
+  }
+
+#if RPL_WITH_ROUTE_SUMMARY
+  summarized = prefixlen == 128 && rpl_summary_add(dag, prefix, from);
+#else
+  summarized = 0;
+#endif /* RPL_WITH_ROUTE_SUMMARY */
+
+  rep = rpl_add_route(dag, prefix, prefixlen, from);
+  if(rep != NULL) {
+    rep->state.lifetime = RPL_LIFETIME(instance, lifetime);
+    rep->state.learned_from = learned_from;
+  } else if(summarized) {
+    PRINTF("RPL: The DAO target is only kept in the route summary\n");
+  } else {
+    RPL_STAT(rpl_stats.mem_overflows++);
+    PRINTF("RPL: Could not add a route after receiving a DAO\n");
+    return 0;
+  }
+
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
 static void
 dao_input(void)
 {
@@ -554,21 +825,26 @@ dao_input(void)
   uint16_t sequence;
   uint8_t instance_id;
   uint8_t lifetime;
-  uint8_t prefixlen;
   uint8_t flags;
   uint8_t subopt_type;
-  uint8_t pathcontrol;
-  uint8_t pathsequence;
   uip_ipaddr_t prefix;
-  uip_ds6_route_t *rep;
   uint8_t buffer_length;
+  uint8_t targets[RPL_DAO_MAX_TARGETS];
+  uint8_t num_targets;
+  uip_ipaddr_t parent_addr;
+  uip_ipaddr_t *parent;
+  int accepted;
+  int forward;
   int pos;
   int len;
   int i;
+  int t;
   int learned_from;
   rpl_parent_t *p;
-
-  prefixlen = 0;
+#if RPL_WITH_DAO_AGGREGATION
+  int out;
+  int kept;
+#endif /* RPL_WITH_DAO_AGGREGATION */
 
   uip_ipaddr_copy(&dao_sender_addr, &UIP_IP_BUF->srcipaddr);
 
@@ -609,57 +885,20 @@ dao_input(void)
     /* Perhaps, there are verification to do but ... */
   }
 
-  /* Check if there are any RPL options present. */
-  i = pos;
-  for(; i < buffer_length; i += len) {
-    subopt_type = buffer[i];
-    if(subopt_type == RPL_OPTION_PAD1) {
-      len = 1;
-    } else {
-      /* The option consists of a two-byte header and a payload. */
-      len = 2 + buffer[i + 1];
-    }
-
-    switch(subopt_type) {
-    case RPL_OPTION_TARGET:
-      /* Handle the target option. */
-      prefixlen = buffer[i + 3];
-      memset(&prefix, 0, sizeof(prefix));
-      memcpy(&prefix, buffer + i + 4, (prefixlen + 7) / CHAR_BIT);
-      break;
-    case RPL_OPTION_TRANSIT:
-      /* The path sequence and control are ignored. */
-      pathcontrol = buffer[i + 3];
-      pathsequence = buffer[i + 4];
-      lifetime = buffer[i + 5];
-      /* The parent address is also ignored. */
-      break;
-    }
-  }
-
-  PRINTF("RPL: DAO lifetime: %u, prefix length: %u prefix: ",
-          (unsigned)lifetime, (unsigned)prefixlen);
-  PRINT6ADDR(&prefix);
-  PRINTF("\n");
-
-  rep = uip_ds6_route_lookup(&prefix);
-
-  if(lifetime == RPL_ZERO_LIFETIME) {
-    /* No-Path DAO received; invoke the route purging routine. */
-    if(rep != NULL && rep->state.saved_lifetime == 0 && rep->length == prefixlen) {
-      PRINTF("RPL: Setting expiration timer for prefix ");
-      PRINT6ADDR(&prefix);
-      PRINTF("\n");
-      rep->state.saved_lifetime = rep->state.lifetime;
-      rep->state.lifetime = DAO_EXPIRATION_TIMEOUT;
-    }
+#if RPL_WITH_NON_STORING
+  if(instance->mop == RPL_MOP_NON_STORING &&
+     dag->rank != ROOT_RANK(instance)) {
+    /* Only the root keeps downward routes in non-storing mode. */
+    PRINTF("RPL: Ignoring a non-storing DAO on a non-root node\n");
     return;
   }
+#endif /* RPL_WITH_NON_STORING */
 
   learned_from = uip_is_addr_mcast(&dao_sender_addr) ?
                  RPL_ROUTE_FROM_MULTICAST_DAO : RPL_ROUTE_FROM_UNICAST_DAO;
 
-  if(learned_from == RPL_ROUTE_FROM_UNICAST_DAO) {
+  if(learned_from == RPL_ROUTE_FROM_UNICAST_DAO &&
+     instance->mop != RPL_MOP_NON_STORING) {
     /* Check whether this is a DAO forwarding loop. */
     p = rpl_find_parent(dag, &dao_sender_addr);
     /* check if this is a new DAO registration with an "illegal" rank */
@@ -673,23 +912,116 @@ dao_input(void)
     }
   }
 
-  rep = rpl_add_route(dag, &prefix, prefixlen, &dao_sender_addr);
-  if(rep == NULL) {
-    RPL_STAT(rpl_stats.mem_overflows++);
-    PRINTF("RPL: Could not add a route after receiving a DAO\n");
+  /* A DAO may carry several targets. Each group of target options is
+     followed by the transit information option that applies to it. The
+     end of the options closes a group that has no transit option. */
+  num_targets = 0;
+  accepted = 0;
+  forward = 0;
+  parent = NULL;
+#if RPL_WITH_DAO_AGGREGATION
+  /* The targets that are not aggregated are forwarded. Their options
+     are moved to the front of the already parsed part of the buffer. */
+  out = pos;
+#endif /* RPL_WITH_DAO_AGGREGATION */
+  i = pos;
+  for(; i <= buffer_length; i += len) {
+    if(i == buffer_length) {
+      subopt_type = RPL_OPTION_TRANSIT;
+      len = 1;
+    } else {
+      subopt_type = buffer[i];
+      if(subopt_type == RPL_OPTION_PAD1) {
+        len = 1;
+      } else {
+        /* The option consists of a two-byte header and a payload. */
+        len = 2 + buffer[i + 1];
+      }
+    }
+
+    switch(subopt_type) {
+    case RPL_OPTION_TARGET:
+      /* Handle the target option. */
+      if(num_targets < RPL_DAO_MAX_TARGETS) {
+        targets[num_targets++] = i;
+      }
+      break;
+    case RPL_OPTION_TRANSIT:
+      if(i < buffer_length) {
+        /* The path sequence and control are ignored. */
+        lifetime = buffer[i + 5];
+        /* The parent address is only used in non-storing mode. */
+        if(buffer[i + 1] >= 4 + sizeof(parent_addr)) {
+          memcpy(&parent_addr, buffer + i + 6, sizeof(parent_addr));
+          parent = &parent_addr;
+        }
+      }
+#if RPL_WITH_DAO_AGGREGATION
+      kept = 0;
+#endif /* RPL_WITH_DAO_AGGREGATION */
+      for(t = 0; t < num_targets; t++) {
+        memset(&prefix, 0, sizeof(prefix));
+        memcpy(&prefix, buffer + targets[t] + 4,
+               (buffer[targets[t] + 3] + 7) / CHAR_BIT);
+        if(dao_target_input(instance, &dao_sender_addr, learned_from,
+                            &prefix, buffer[targets[t] + 3],
+                            lifetime, parent)) {
+          accepted++;
+#if RPL_WITH_DAO_AGGREGATION
+          if(learned_from == RPL_ROUTE_FROM_UNICAST_DAO &&
+             instance->mop != RPL_MOP_NON_STORING &&
+             !dao_aggregate(instance, &prefix, buffer[targets[t] + 3],
+                            lifetime)) {
+            memmove(buffer + out, buffer + targets[t],
+                    2 + buffer[targets[t] + 1]);
+            out += 2 + buffer[targets[t] + 1];
+            kept++;
+          }
+#else
+          forward = 1;
+#endif /* RPL_WITH_DAO_AGGREGATION */
+        }
+      }
+#if RPL_WITH_DAO_AGGREGATION
+      if(kept > 0) {
+        if(i < buffer_length) {
+          memmove(buffer + out, buffer + i, len);
+          out += len;
+        }
+        forward = 1;
+      }
+#endif /* RPL_WITH_DAO_AGGREGATION */
+      /* The next group starts over with the default lifetime. */
+      num_targets = 0;
+      lifetime = instance->default_lifetime;
+      parent = NULL;
+      break;
+    }
+  }
+
+  if(accepted == 0) {
     return;
   }
 
-  rep->state.lifetime = RPL_LIFETIME(instance, lifetime);
-  rep->state.learned_from = learned_from;
+  if(instance->mop == RPL_MOP_NON_STORING) {
+    if(flags & RPL_DAO_K_FLAG) {
+      dao_ack_output(instance, &dao_sender_addr, sequence);
+    }
+    return;
+  }
 
   if(learned_from == RPL_ROUTE_FROM_UNICAST_DAO) {
-    if(dag->preferred_parent) {
+    if(forward && dag->preferred_parent) {
       PRINTF("RPL: Forwarding DAO to parent ");
       PRINT6ADDR(&dag->preferred_parent->addr);
       PRINTF("\n");
+#if RPL_WITH_DAO_AGGREGATION
+      uip_icmp6_send(&dag->preferred_parent->addr,
+                     ICMP6_RPL, RPL_CODE_DAO, out);
+#else
       uip_icmp6_send(&dag->preferred_parent->addr,
                      ICMP6_RPL, RPL_CODE_DAO, buffer_length);
+#endif /* RPL_WITH_DAO_AGGREGATION */
     }
     if(flags & RPL_DAO_K_FLAG) {
       dao_ack_output(instance, &dao_sender_addr, sequence);
@@ -703,9 +1035,11 @@ dao_output(rpl_parent_t *n, uint8_t lifetime)
   rpl_dag_t *dag;
   rpl_instance_t *instance;
   unsigned char *buffer;
-  uint8_t prefixlen;
   uip_ipaddr_t prefix;
   int pos;
+#if RPL_WITH_NON_STORING
+  uip_ipaddr_t parent_addr;
+#endif /* RPL_WITH_NON_STORING */
 
   /* Destination Advertisement Object */
 
@@ -723,41 +1057,39 @@ dao_output(rpl_parent_t *n, uint8_t lifetime)
 
   buffer = UIP_ICMP_PAYLOAD;
 
-  RPL_LOLLIPOP_INCREMENT(dao_sequence);
-  pos = 0;
-
-  buffer[pos++] = instance->instance_id;
-  buffer[pos] = 0;
-#if RPL_DAO_SPECIFY_DAG
-  buffer[pos] |= RPL_DAO_D_FLAG;
-#endif /* RPL_DAO_SPECIFY_DAG */
-#if RPL_CONF_DAO_ACK
-  buffer[pos] |= RPL_DAO_K_FLAG;
-#endif /* RPL_CONF_DAO_ACK */
-  ++pos;
-  buffer[pos++] = 0; /* reserved */
-  buffer[pos++] = dao_sequence;
-#if RPL_DAO_SPECIFY_DAG
-  memcpy(buffer + pos, &dag->dag_id, sizeof(dag->dag_id));
-  pos+=sizeof(dag->dag_id);
-#endif /* RPL_DAO_SPECIFY_DAG */
+  pos = dao_write_header(instance, buffer);
 
   /* create target subopt */
-  prefixlen = sizeof(prefix) * CHAR_BIT;
-  buffer[pos++] = RPL_OPTION_TARGET;
-  buffer[pos++] = 2 + ((prefixlen + 7) / CHAR_BIT);
-  buffer[pos++] = 0; /* reserved */
-  buffer[pos++] = prefixlen;
-  memcpy(buffer + pos, &prefix, (prefixlen + 7) / CHAR_BIT);
-  pos += ((prefixlen + 7) / CHAR_BIT);
+  pos = dao_write_target(buffer, pos, &prefix, sizeof(prefix) * CHAR_BIT);
+
+#if RPL_WITH_NON_STORING
+  if(instance->mop == RPL_MOP_NON_STORING) {
+    /* The transit option carries the global address of the parent,
+       and the DAO goes directly to the root. The parent is assumed to
+       use the same prefix as this node. */
+    memcpy(&parent_addr, &prefix, 8);
+    memcpy(&parent_addr.u8[8], &n->addr.u8[8], 8);
+    pos = dao_write_transit(buffer, pos, lifetime, &parent_addr);
+
+    PRINTF("RPL: Sending non-storing DAO with prefix ");
+    PRINT6ADDR(&prefix);
+    PRINTF(" to the root ");
+    PRINT6ADDR(&dag->dag_id);
+    PRINTF("\n");
 
+    uip_icmp6_send(&dag->dag_id, ICMP6_RPL, RPL_CODE_DAO, pos);
+    return;
+  }
+#endif /* RPL_WITH_NON_STORING */
   /* Create a transit information sub-option. */
-  buffer[pos++] = RPL_OPTION_TRANSIT;
-  buffer[pos++] = 4;
-  buffer[pos++] = 0; /* flags - ignored */
-  buffer[pos++] = 0; /* path control - ignored */
-  buffer[pos++] = 0; /* path seq - ignored */
-  buffer[pos++] = lifetime;
+  pos = dao_write_transit(buffer, pos, lifetime, NULL);
+
+#if RPL_WITH_DAO_AGGREGATION
+  /* Add the targets of our children that are waiting for a DAO. */
+  if(n == dag->preferred_parent) {
+    pos = dao_append_targets(instance, buffer, pos);
+  }
+#endif /* RPL_WITH_DAO_AGGREGATION */
 
   PRINTF("RPL: Sending DAO with prefix ");
   PRINT6ADDR(&prefix);
@@ -0,0 +1,276 @@
+/**
+ * \addtogroup uip6
+ * @{
+ */
+/*
+ * Copyright (c) 2012, LCIS/CTSYS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+/**
+ * \file
+ *         DODAG topology kept by the root in RPL non-storing mode.
+ *
+ *         In non-storing mode, the nodes send their DAOs directly to
+ *         the root, with the address of their parent in the transit
+ *         information option. The root keeps one child-parent link per
+ *         node and builds source routes from these links. All nodes of
+ *         a DAG share the DAG prefix, so only the interface identifiers
+ *         are stored.
+ */
+
+#include "net/rpl/rpl-private.h"
+#include "lib/list.h"
+#include "lib/memb.h"
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+#include <string.h>
+
+#if RPL_WITH_NON_STORING
+
+LIST(ns_nodes);
+MEMB(ns_node_memb, rpl_ns_node_t, RPL_NS_LINK_NUM);
+/************************************************************************/
+static int
+is_root_address(rpl_dag_t *dag, const uip_ipaddr_t *addr)
+{
+  return uip_ipaddr_cmp(&dag->dag_id, addr);
+}
+/************************************************************************/
+/* Only the IIDs are stored, so the other addresses must not be looked
+   up: they would match the node that has the same IID. */
+static int
+is_dag_address(rpl_dag_t *dag, const uip_ipaddr_t *addr)
+{
+  return !uip_is_addr_link_local(addr) &&
+    uip_ipaddr_prefixcmp(&dag->prefix_info.prefix, addr, 64);
+}
+/************************************************************************/
+static int
+has_children(rpl_ns_node_t *node)
+{
+  rpl_ns_node_t *n;
+
+  for(n = list_head(ns_nodes); n != NULL; n = list_item_next(n)) {
+    if(n->parent == node) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/************************************************************************/
+rpl_ns_node_t *
+rpl_ns_get_node(rpl_dag_t *dag, const uip_ipaddr_t *addr)
+{
+  rpl_ns_node_t *n;
+
+  if(!is_dag_address(dag, addr)) {
+    return NULL;
+  }
+  for(n = list_head(ns_nodes); n != NULL; n = list_item_next(n)) {
+    if(n->dag == dag && memcmp(n->iid, &addr->u8[8], 8) == 0) {
+      return n;
+    }
+  }
+  return NULL;
+}
+/************************************************************************/
+static rpl_ns_node_t *
+add_node(rpl_dag_t *dag, const uip_ipaddr_t *addr)
+{
+  rpl_ns_node_t *n;
+
+  n = rpl_ns_get_node(dag, addr);
+  if(n == NULL) {
+    n = memb_alloc(&ns_node_memb);
+    if(n == NULL) {
+      PRINTF("RPL: No space for more non-storing links\n");
+      return NULL;
+    }
+    memcpy(n->iid, &addr->u8[8], 8);
+    n->dag = dag;
+    n->parent = NULL;
+    n->lifetime = RPL_ZERO_LIFETIME;
+    list_add(ns_nodes, n);
+  }
+  return n;
+}
+/************************************************************************/
+rpl_ns_node_t *
+rpl_ns_update_node(rpl_dag_t *dag, const uip_ipaddr_t *child,
+                   const uip_ipaddr_t *parent, uint32_t lifetime)
+{
+  rpl_ns_node_t *child_node;
+  rpl_ns_node_t *parent_node;
+
+  if(!is_dag_address(dag, child)) {
+    PRINTF("RPL: Non-storing target outside of the DAG prefix\n");
+    return NULL;
+  }
+  child_node = rpl_ns_get_node(dag, child);
+
+  if(lifetime == RPL_ZERO_LIFETIME) {
+    /* No-Path DAO: the link is removed during the next purge. A No-Path
+       for another parent than the current one is stale, as the node has
+       announced its new parent since, and is ignored. */
+    if(child_node == NULL) {
+      return NULL;
+    }
+    if(is_root_address(dag, parent)) {
+      parent_node = NULL;
+    } else {
+      parent_node = rpl_ns_get_node(dag, parent);
+      if(parent_node == NULL) {
+        PRINTF("RPL: Ignoring a No-Path DAO for an unknown parent\n");
+        return NULL;
+      }
+    }
+    if(child_node->parent != parent_node) {
+      PRINTF("RPL: Ignoring a No-Path DAO for a former parent\n");
+      return NULL;
+    }
+    child_node->lifetime = RPL_ZERO_LIFETIME;
+    return child_node;
+  }
+
+  if(is_root_address(dag, parent)) {
+    parent_node = NULL;
+  } else if(!is_dag_address(dag, parent)) {
+    return NULL;
+  } else {
+    /* The parent may not have sent its own DAO yet. It is then added
+       with a zero lifetime, which marks its path as unknown. */
+    parent_node = add_node(dag, parent);
+    if(parent_node == NULL) {
+      return NULL;
+    }
+  }
+
+  if(child_node == NULL) {
+    child_node = add_node(dag, child);
+    if(child_node == NULL) {
+      return NULL;
+    }
+  }
+  if(child_node == parent_node) {
+    return NULL;
+  }
+
+  child_node->parent = parent_node;
+  child_node->lifetime = lifetime;
+
+  PRINTF("RPL: Non-storing link ");
+  PRINT6ADDR(child);
+  PRINTF(" -> ");
+  PRINT6ADDR(parent);
+  PRINTF(" lifetime %lu\n", (unsigned long)lifetime);
+
+  return child_node;
+}
+/************************************************************************/
+int
+rpl_ns_get_path(rpl_dag_t *dag, const uip_ipaddr_t *addr,
+                rpl_ns_node_t **path, int max_len)
+{
+  rpl_ns_node_t *dest;
+  rpl_ns_node_t *n;
+  int len;
+  int i;
+
+  dest = rpl_ns_get_node(dag, addr);
+  if(dest == NULL) {
+    return 0;
+  }
+
+  /* Walk up to the root. A path longer than max_len is either too long
+     for the caller or has a loop. */
+  len = 0;
+  for(n = dest; n != NULL; n = n->parent) {
+    if(n->lifetime == RPL_ZERO_LIFETIME || len == max_len) {
+      return 0;
+    }
+    len++;
+  }
+
+  /* Fill the path from its end, so that path[0] is the first hop from
+     the root and path[len - 1] is the destination. */
+  i = len;
+  for(n = dest; n != NULL; n = n->parent) {
+    path[--i] = n;
+  }
+
+  return len;
+}
+/************************************************************************/
+void
+rpl_ns_periodic(void)
+{
+  rpl_ns_node_t *n;
+  rpl_ns_node_t *next;
+
+  for(n = list_head(ns_nodes); n != NULL; n = next) {
+    next = list_item_next(n);
+    if(n->lifetime > 1 && n->lifetime != RPL_NS_INFINITE_LIFETIME) {
+      n->lifetime--;
+    } else if(n->lifetime == 1) {
+      n->lifetime = RPL_ZERO_LIFETIME;
+    }
+    /* Expired nodes are kept while other nodes still use them as
+       parent, since the links below them remain valid. */
+    if(n->lifetime == RPL_ZERO_LIFETIME && !has_children(n)) {
+      list_remove(ns_nodes, n);
+      memb_free(&ns_node_memb, n);
+    }
+  }
+}
+/************************************************************************/
+void
+rpl_ns_free_dag(rpl_dag_t *dag)
+{
+  rpl_ns_node_t *n;
+  rpl_ns_node_t *next;
+
+  for(n = list_head(ns_nodes); n != NULL; n = next) {
+    next = list_item_next(n);
+    if(n->dag == dag) {
+      list_remove(ns_nodes, n);
+      memb_free(&ns_node_memb, n);
+    }
+  }
+}
+/************************************************************************/
+void
+rpl_ns_init(void)
+{
+  list_init(ns_nodes);
+  memb_init(&ns_node_memb);
+}
+/************************************************************************/
+#endif /* RPL_WITH_NON_STORING */
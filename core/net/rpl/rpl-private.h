@@ -99,12 +99,30 @@
 #define RPL_HDR_OPT_RANK_ERR_SHIFT   	6
 #define RPL_HDR_OPT_FWD_ERR		0x20
 #define RPL_HDR_OPT_FWD_ERR_SHIFT   	5
+
+/* RPL source routing header (RFC 6554), without the addresses. */
+#define RPL_SRH_LEN                     8
+#ifdef RPL_CONF_SRH_MAX_HOPS
+#define RPL_SRH_MAX_HOPS                RPL_CONF_SRH_MAX_HOPS
+#else
+#define RPL_SRH_MAX_HOPS                16
+#endif
 /*---------------------------------------------------------------------------*/
 /* Default values for RPL constants and variables. */
 
 /* The default value for the DAO timer. */
 #define RPL_DAO_LATENCY                 (CLOCK_SECOND * 4)
 
+/* Length of a transit information option without a parent address. */
+#define RPL_DAO_TRANSIT_LEN             6
+
+/* Maximum number of targets read from a received DAO. */
+#ifdef RPL_CONF_DAO_MAX_TARGETS
+#define RPL_DAO_MAX_TARGETS             RPL_CONF_DAO_MAX_TARGETS
+#else
+#define RPL_DAO_MAX_TARGETS             8
+#endif
+
 /* Special value indicating immediate removal. */
 #define RPL_ZERO_LIFETIME               0
 
@@ -181,6 +199,8 @@
 
 #ifdef  RPL_CONF_MOP
 #define RPL_MOP_DEFAULT                 RPL_CONF_MOP
+#elif RPL_WITH_NON_STORING
+#define RPL_MOP_DEFAULT                 RPL_MOP_NON_STORING
 #else
 #define RPL_MOP_DEFAULT                 RPL_MOP_STORING_NO_MULTICAST
 #endif
@@ -262,6 +282,19 @@ extern rpl_stats_t rpl_stats;
 #define RPL_STAT(code)
 #endif /* RPL_CONF_STATS */
 /*---------------------------------------------------------------------------*/
+/* A child-parent link kept by the root in non-storing mode. */
+struct rpl_ns_node {
+  struct rpl_ns_node *next;
+  uint32_t lifetime;
+  rpl_dag_t *dag;
+  /* A NULL parent means that the node is a child of the root. */
+  struct rpl_ns_node *parent;
+  uint8_t iid[8];
+};
+typedef struct rpl_ns_node rpl_ns_node_t;
+
+#define RPL_NS_INFINITE_LIFETIME        0xffffffffUL
+/*---------------------------------------------------------------------------*/
 /* Instances */
 extern rpl_instance_t instance_table[];
 extern rpl_instance_t *default_instance;
@@ -303,11 +336,32 @@ uip_ds6_route_t *rpl_add_route(rpl_dag_t *dag, uip_ipaddr_t *prefix,
                                int prefix_len, uip_ipaddr_t *next_hop);
 void rpl_purge_routes(void);
 
+/* Non-storing mode topology at the root. rpl_ns_get_path() returns the
+   number of hops from the root to addr, or 0 if no path is known. */
+void rpl_ns_init(void);
+rpl_ns_node_t *rpl_ns_update_node(rpl_dag_t *dag, const uip_ipaddr_t *child,
+                                  const uip_ipaddr_t *parent,
+                                  uint32_t lifetime);
+rpl_ns_node_t *rpl_ns_get_node(rpl_dag_t *dag, const uip_ipaddr_t *addr);
+int rpl_ns_get_path(rpl_dag_t *dag, const uip_ipaddr_t *addr,
+                    rpl_ns_node_t **path, int max_len);
+void rpl_ns_periodic(void);
+void rpl_ns_free_dag(rpl_dag_t *dag);
+
+/* Downward route summaries in storing mode. */
+void rpl_summary_init(void);
+int rpl_summary_add(rpl_dag_t *dag, uip_ipaddr_t *addr,
+                    uip_ipaddr_t *child);
+void rpl_summary_periodic(void);
+void rpl_summary_remove_child(uip_ipaddr_t *child, rpl_dag_t *dag);
+void rpl_summary_free_dag(rpl_dag_t *dag);
+
 /* Objective function. */
 rpl_of_t *rpl_find_of(rpl_ocp_t);
 
 /* Timer functions. */
 void rpl_schedule_dao(rpl_instance_t *);
+void rpl_init_dio_timer(rpl_instance_t *);
 void rpl_reset_dio_timer(rpl_instance_t *);
 void rpl_reset_periodic_timer(void);
 
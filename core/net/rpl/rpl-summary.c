@@ -0,0 +1,344 @@
+/**
+ * \addtogroup uip6
+ * @{
+ */
+/*
+ * Copyright (c) 2012, LCIS/CTSYS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+/**
+ * \file
+ *         Bloom filter summaries of the downward routes in storing mode.
+ *
+ *         Each child that forwards DAOs to us gets a Bloom filter of the
+ *         addresses it has announced. The routing table is then used as
+ *         a cache of exact routes for the most used destinations, and
+ *         the other destinations are routed to the single child whose
+ *         filter matches them.
+ */
+
+#include "net/uip.h"
+#include "net/uip-ds6.h"
+#include "net/packetbuf.h"
+#include "net/rpl/rpl-private.h"
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+#include <string.h>
+
+#if RPL_WITH_ROUTE_SUMMARY
+
+#if (RPL_SUMMARY_FILTER_BITS & (RPL_SUMMARY_FILTER_BITS - 1)) != 0
+#error RPL_SUMMARY_FILTER_BITS must be a power of two
+#endif
+
+#define UIP_IP_BUF                ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+#define FILTER_MASK               (RPL_SUMMARY_FILTER_BITS - 1)
+
+struct summary {
+  uip_ipaddr_t child;
+  /* A NULL DAG marks an unused summary. */
+  rpl_dag_t *dag;
+  uint16_t count[2];
+  uint8_t filter[2][RPL_SUMMARY_FILTER_BITS / 8];
+};
+
+static struct summary summaries[RPL_SUMMARY_CHILDREN];
+/* The filter generation that receives the new DAOs. */
+static uint8_t current;
+static unsigned long age;
+
+/* Returned when an exact route cannot be cached. */
+static uip_ds6_route_t summary_route;
+
+extern uip_ds6_route_t uip_ds6_routing_table[UIP_DS6_ROUTE_NB];
+/************************************************************************/
+static void
+hash(const uip_ipaddr_t *addr, uint16_t *h1, uint16_t *h2)
+{
+  uint16_t a;
+  uint16_t b;
+  uint8_t i;
+
+  /* Two independent hashes; the other ones are derived from them by
+     double hashing. */
+  a = 5381;
+  b = 0;
+  for(i = 0; i < sizeof(uip_ipaddr_t); i++) {
+    a = (a << 5) + a + addr->u8[i];
+    b = addr->u8[i] + (b << 6) - b;
+  }
+  *h1 = a;
+  *h2 = b | 1;
+}
+/************************************************************************/
+static int
+filter_match(const uint8_t *filter, uint16_t h1, uint16_t h2)
+{
+  uint8_t i;
+  uint16_t bit;
+
+  for(i = 0; i < RPL_SUMMARY_HASHES; i++) {
+    bit = (h1 + i * h2) & FILTER_MASK;
+    if((filter[bit >> 3] & (1 << (bit & 7))) == 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+/************************************************************************/
+static struct summary *
+find_summary(rpl_dag_t *dag, uip_ipaddr_t *child)
+{
+  struct summary *s;
+
+  for(s = summaries; s < summaries + RPL_SUMMARY_CHILDREN; s++) {
+    if(s->dag == dag && uip_ipaddr_cmp(&s->child, child)) {
+      return s;
+    }
+  }
+  return NULL;
+}
+/************************************************************************/
+static int
+is_previous_hop(struct summary *s)
+{
+  uip_ipaddr_t addr;
+
+  /* The link-layer sender of the packet being forwarded is still in
+     the packetbuf. */
+  if(uip_ds6_is_my_addr(&UIP_IP_BUF->srcipaddr)) {
+    return 0;
+  }
+  uip_ip6addr(&addr, 0xfe80, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_set_addr_iid(&addr,
+                       (uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER));
+  return uip_ipaddr_cmp(&addr, &s->child);
+}
+/************************************************************************/
+static uip_ds6_route_t *
+least_used_route(void)
+{
+  uip_ds6_route_t *r;
+  uip_ds6_route_t *victim;
+
+  /* Only routes learned from DAOs are in the summaries, and can be
+     dropped from the cache. */
+  victim = NULL;
+  for(r = uip_ds6_routing_table; r < uip_ds6_routing_table + UIP_DS6_ROUTE_NB;
+      r++) {
+    if(r->isused && r->length == 128 && r->state.hits == 0 &&
+       r->state.learned_from == RPL_ROUTE_FROM_UNICAST_DAO) {
+      victim = r;
+      break;
+    }
+  }
+  return victim;
+}
+/************************************************************************/
+static uip_ds6_route_t *
+cache_route(struct summary *s, uip_ipaddr_t *destipaddr)
+{
+  uip_ds6_route_t *rep;
+
+  rep = rpl_add_route(s->dag, destipaddr, 128, &s->child);
+  if(rep == NULL) {
+    rep = least_used_route();
+    if(rep != NULL) {
+      uip_ds6_route_rm(rep);
+      rep = rpl_add_route(s->dag, destipaddr, 128, &s->child);
+    }
+  }
+
+  if(rep == NULL) {
+    /* All cached routes are in use: route this packet without caching
+       the destination. */
+    rep = &summary_route;
+    uip_ipaddr_copy(&rep->ipaddr, destipaddr);
+    rep->length = 128;
+    uip_ipaddr_copy(&rep->nexthop, &s->child);
+    return rep;
+  }
+
+  rep->state.learned_from = RPL_ROUTE_FROM_UNICAST_DAO;
+  rep->state.hits = 1;
+  return rep;
+}
+/************************************************************************/
+uip_ds6_route_t *
+rpl_summary_route_lookup(uip_ipaddr_t *destipaddr)
+{
+  uip_ds6_route_t *rep;
+  struct summary *s;
+  struct summary *match;
+  uint16_t h1;
+  uint16_t h2;
+
+  rep = uip_ds6_route_lookup(destipaddr);
+  if(rep != NULL) {
+    if(rep->state.hits < 0xff) {
+      rep->state.hits++;
+    }
+    return rep;
+  }
+
+  hash(destipaddr, &h1, &h2);
+  match = NULL;
+  for(s = summaries; s < summaries + RPL_SUMMARY_CHILDREN; s++) {
+    if(s->dag == NULL ||
+       !(filter_match(s->filter[0], h1, h2) ||
+         filter_match(s->filter[1], h1, h2))) {
+      continue;
+    }
+    if(is_previous_hop(s)) {
+      /* The child sent the packet back: its match was a false
+         positive. */
+      continue;
+    }
+    if(match != NULL) {
+      PRINTF("RPL: Ambiguous route summary for ");
+      PRINT6ADDR(destipaddr);
+      PRINTF("\n");
+      return NULL;
+    }
+    match = s;
+  }
+
+  if(match == NULL) {
+    return NULL;
+  }
+
+  PRINTF("RPL: Route summary match for ");
+  PRINT6ADDR(destipaddr);
+  PRINTF(" via ");
+  PRINT6ADDR(&match->child);
+  PRINTF("\n");
+
+  return cache_route(match, destipaddr);
+}
+/************************************************************************/
+int
+rpl_summary_add(rpl_dag_t *dag, uip_ipaddr_t *addr, uip_ipaddr_t *child)
+{
+  struct summary *s;
+  uint16_t h1;
+  uint16_t h2;
+  uint16_t bit;
+  uint8_t i;
+
+  s = find_summary(dag, child);
+  if(s == NULL) {
+    for(s = summaries; s < summaries + RPL_SUMMARY_CHILDREN; s++) {
+      if(s->dag == NULL) {
+        break;
+      }
+    }
+    if(s == summaries + RPL_SUMMARY_CHILDREN) {
+      PRINTF("RPL: No space for more route summaries\n");
+      return 0;
+    }
+    memset(s, 0, sizeof(*s));
+    uip_ipaddr_copy(&s->child, child);
+    s->dag = dag;
+  }
+
+  hash(addr, &h1, &h2);
+  for(i = 0; i < RPL_SUMMARY_HASHES; i++) {
+    bit = (h1 + i * h2) & FILTER_MASK;
+    s->filter[current][bit >> 3] |= 1 << (bit & 7);
+  }
+  s->count[current]++;
+
+  return 1;
+}
+/************************************************************************/
+void
+rpl_summary_periodic(void)
+{
+  struct summary *s;
+  uip_ds6_route_t *r;
+
+  if(++age < RPL_SUMMARY_PERIOD) {
+    return;
+  }
+  age = 0;
+
+  PRINTF("RPL: Aging the route summaries\n");
+
+  current ^= 1;
+  for(s = summaries; s < summaries + RPL_SUMMARY_CHILDREN; s++) {
+    if(s->dag != NULL) {
+      memset(s->filter[current], 0, sizeof(s->filter[current]));
+      s->count[current] = 0;
+      if(s->count[current ^ 1] == 0) {
+        s->dag = NULL;
+      }
+    }
+  }
+
+  for(r = uip_ds6_routing_table; r < uip_ds6_routing_table + UIP_DS6_ROUTE_NB;
+      r++) {
+    r->state.hits >>= 1;
+  }
+}
+/************************************************************************/
+void
+rpl_summary_remove_child(uip_ipaddr_t *child, rpl_dag_t *dag)
+{
+  struct summary *s;
+
+  s = find_summary(dag, child);
+  if(s != NULL) {
+    s->dag = NULL;
+  }
+}
+/************************************************************************/
+void
+rpl_summary_free_dag(rpl_dag_t *dag)
+{
+  struct summary *s;
+
+  for(s = summaries; s < summaries + RPL_SUMMARY_CHILDREN; s++) {
+    if(s->dag == dag) {
+      s->dag = NULL;
+    }
+  }
+}
+/************************************************************************/
+void
+rpl_summary_init(void)
+{
+  memset(summaries, 0, sizeof(summaries));
+  current = 0;
+  age = 0;
+}
+/************************************************************************/
+#endif /* RPL_WITH_ROUTE_SUMMARY */
@@ -43,6 +43,7 @@
 #include "net/rpl/rpl-private.h"
 #include "lib/random.h"
 #include "sys/ctimer.h"
+#include "net/neighbor-attr.h"
 
 #define DEBUG DEBUG_NONE
 #include "net/uip-debug.h"
@@ -51,8 +52,7 @@
 static struct ctimer periodic_timer;
 
 static void handle_periodic_timer(void *ptr);
-static void new_dio_interval(rpl_instance_t *instance);
-static void handle_dio_timer(void *ptr);
+static void handle_dio_timer(void *ptr, uint8_t suppress);
 
 static uint16_t next_dis;
 
@@ -77,92 +77,58 @@ handle_periodic_timer(void *ptr)
   ctimer_reset(&periodic_timer);
 }
 /************************************************************************/
-static void
-new_dio_interval(rpl_instance_t *instance)
+static uint8_t
+count_neighbors(void)
 {
-  uint32_t time;
-
-  /* TODO: too small timer intervals for many cases */
-  time = 1UL << instance->dio_intcurrent;
+  struct neighbor_addr *n;
+  uint8_t count;
 
-  /* Convert from milliseconds to CLOCK_TICKS. */
-  time = (time * CLOCK_SECOND) / 1000;
+  count = 0;
+  for(n = neighbor_attr_list_neighbors(); n != NULL; n = n->next) {
+    count++;
+  }
+  return count;
+}
+/************************************************************************/
+static void
+handle_dio_timer(void *ptr, uint8_t suppress)
+{
+  rpl_instance_t *instance;
 
-  instance->dio_next_delay = time;
+  instance = (rpl_instance_t *)ptr;
 
-  /* random number between I/2 and I */
-  time = time >> 1;
-  time += (time * random_rand()) / RANDOM_RAND_MAX;
+  PRINTF("RPL: DIO Timer triggered\n");
 
-  /*
-   * The intervals must be equally long among the nodes for Trickle to
-   * operate efficiently. Therefore we need to calculate the delay between
-   * the randomized time and the start time of the next interval.
-   */
-  instance->dio_next_delay -= time;
-  instance->dio_send = 1;
+  /* Let the Trickle timer adapt its redundancy to the neighborhood. */
+  trickle_timer_set_density(&instance->dio_timer, count_neighbors());
 
 #if RPL_CONF_STATS
-  /* keep some stats */
-  instance->dio_totint++;
-  instance->dio_totrecv += instance->dio_counter;
-  ANNOTATE("#A rank=%u.%u(%u),stats=%d %d %d %d,color=%s\n",
+  ANNOTATE("#A rank=%u.%u(%u),stats=%u %u %u %u,color=%s\n",
 	   DAG_RANK(instance->current_dag->rank, instance),
            (10 * (instance->current_dag->rank % instance->min_hoprankinc)) / instance->min_hoprankinc,
            instance->current_dag->version,
-           instance->dio_totint, instance->dio_totsend,
-           instance->dio_totrecv,instance->dio_intcurrent,
+           instance->dio_timer.stats.intervals, instance->dio_timer.stats.sent,
+           instance->dio_timer.stats.received,
+           instance->dio_timer.stats.suppressed,
 	   instance->current_dag->rank == ROOT_RANK(instance) ? "BLUE" : "ORANGE");
 #endif /* RPL_CONF_STATS */
 
-  /* reset the redundancy counter */
-  instance->dio_counter = 0;
-
-  /* schedule the timer */
-  PRINTF("RPL: Scheduling DIO timer %lu ticks in future (Interval)\n", time);
-  ctimer_set(&instance->dio_timer, time, &handle_dio_timer, instance);
-}
-/************************************************************************/
-static void
-handle_dio_timer(void *ptr)
-{
-  rpl_instance_t *instance;
-
-  instance = (rpl_instance_t *)ptr;
-
-  PRINTF("RPL: DIO Timer triggered\n");
   if(!dio_send_ok) {
     if(uip_ds6_get_link_local(ADDR_PREFERRED) != NULL) {
       dio_send_ok = 1;
     } else {
       PRINTF("RPL: Postponing DIO transmission since link local address is not ok\n");
-      ctimer_set(&instance->dio_timer, CLOCK_SECOND, &handle_dio_timer, instance);
+      trickle_timer_defer(&instance->dio_timer, CLOCK_SECOND);
       return;
     }
   }
 
-  if(instance->dio_send) {
-    /* send DIO if counter is less than desired redundancy */
-    if(instance->dio_counter < instance->dio_redundancy) {
-#if RPL_CONF_STATS
-      instance->dio_totsend++;
-#endif /* RPL_CONF_STATS */
-      dio_output(instance, NULL);
-    } else {
-      PRINTF("RPL: Supressing DIO transmission (%d >= %d)\n",
-             instance->dio_counter, instance->dio_redundancy);
-    }
-    instance->dio_send = 0;
-    PRINTF("RPL: Scheduling DIO timer %lu ticks in future (sent)\n",
-           instance->dio_next_delay);
-    ctimer_set(&instance->dio_timer, instance->dio_next_delay, handle_dio_timer, instance);
+  if(suppress) {
+    PRINTF("RPL: Supressing DIO transmission (%d >= %d)\n",
+           instance->dio_timer.c,
+           trickle_timer_redundancy(&instance->dio_timer));
   } else {
-    /* check if we need to double interval */
-    if(instance->dio_intcurrent < instance->dio_intmin + instance->dio_intdoubl) {
-      instance->dio_intcurrent++;
-      PRINTF("RPL: DIO Timer interval doubled %d\n", instance->dio_intcurrent);
-    }
-    new_dio_interval(instance);
+    dio_output(instance, NULL);
   }
 }
 /************************************************************************/
@@ -173,18 +139,41 @@ rpl_reset_periodic_timer(void)
   ctimer_set(&periodic_timer, CLOCK_SECOND, handle_periodic_timer, NULL);
 }
 /************************************************************************/
+/* Configures the DIO timer from the DIO parameters of the instance and
+   restarts it at its minimal interval. */
+void
+rpl_init_dio_timer(rpl_instance_t *instance)
+{
+  uint32_t ms;
+  uint32_t imin;
+
+  /* Convert the minimum interval from 2^n milliseconds to clock ticks.
+     The longer intervals are derived from it by the Trickle timer. The
+     conversion is done in 32 bits and clamped before it is narrowed to
+     clock_time_t. */
+  if(instance->dio_intmin >= 32) {
+    imin = TRICKLE_TIMER_MAX_INTERVAL;
+  } else {
+    ms = 1UL << instance->dio_intmin;
+    imin = (ms / 1000) * CLOCK_SECOND + ((ms % 1000) * CLOCK_SECOND) / 1000;
+    if(imin > TRICKLE_TIMER_MAX_INTERVAL) {
+      imin = TRICKLE_TIMER_MAX_INTERVAL;
+    }
+  }
+  trickle_timer_config(&instance->dio_timer, (clock_time_t)imin,
+                       instance->dio_intdoubl, instance->dio_redundancy);
+#if !RPL_LEAF_ONLY
+  trickle_timer_set(&instance->dio_timer, handle_dio_timer, instance);
+#endif /* RPL_LEAF_ONLY */
+}
+/************************************************************************/
 /* Resets the DIO timer in the instance to its minimal interval. */
 void
 rpl_reset_dio_timer(rpl_instance_t *instance)
 {
 #if !RPL_LEAF_ONLY
-  /* Do not reset if we are already on the minimum interval,
-     unless forced to do so. */
-  if(instance->dio_intcurrent > instance->dio_intmin) {
-    instance->dio_counter = 0;
-    instance->dio_intcurrent = instance->dio_intmin;
-    new_dio_interval(instance);
-  }
+  /* Do not reset if we are already on the minimum interval. */
+  trickle_timer_inconsistency(&instance->dio_timer);
 #if RPL_CONF_STATS
   rpl_stats.resets++;
 #endif /* RPL_CONF_STATS */
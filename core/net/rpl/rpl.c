@@ -73,6 +73,13 @@ rpl_purge_routes(void)
       }
     }
   }
+
+#if RPL_WITH_NON_STORING
+  rpl_ns_periodic();
+#endif /* RPL_WITH_NON_STORING */
+#if RPL_WITH_ROUTE_SUMMARY
+  rpl_summary_periodic();
+#endif /* RPL_WITH_ROUTE_SUMMARY */
 }
 /************************************************************************/
 void
@@ -85,6 +92,13 @@ rpl_remove_routes(rpl_dag_t *dag)
       uip_ds6_route_rm(&uip_ds6_routing_table[i]);
     }
   }
+
+#if RPL_WITH_NON_STORING
+  rpl_ns_free_dag(dag);
+#endif /* RPL_WITH_NON_STORING */
+#if RPL_WITH_ROUTE_SUMMARY
+  rpl_summary_free_dag(dag);
+#endif /* RPL_WITH_ROUTE_SUMMARY */
 }
 /************************************************************************/
 void
@@ -101,6 +115,9 @@ rpl_remove_routes_by_nexthop(uip_ipaddr_t *nexthop, rpl_dag_t *dag)
       locroute->isused = 0;
     }
   }
+#if RPL_WITH_ROUTE_SUMMARY
+  rpl_summary_remove_child(nexthop, dag);
+#endif /* RPL_WITH_ROUTE_SUMMARY */
   ANNOTATE("#L %u 0\n",nexthop->u8[sizeof(uip_ipaddr_t) - 1]);
 }
 /************************************************************************/
@@ -213,6 +230,12 @@ rpl_init(void)
 
   rpl_reset_periodic_timer();
   neighbor_info_subscribe(rpl_link_neighbor_callback);
+#if RPL_WITH_NON_STORING
+  rpl_ns_init();
+#endif /* RPL_WITH_NON_STORING */
+#if RPL_WITH_ROUTE_SUMMARY
+  rpl_summary_init();
+#endif /* RPL_WITH_ROUTE_SUMMARY */
 
   /* add rpl multicast address */
   uip_create_linklocal_rplnodes_mcast(&rplmaddr);
@@ -44,11 +44,15 @@
 #include "net/uip.h"
 #include "net/uip-ds6.h"
 #include "sys/ctimer.h"
+#include "lib/trickle-timer.h"
 
 /*---------------------------------------------------------------------------*/
 /* The amount of parents that this node has in a particular DAG. */
 #define RPL_PARENT_COUNT(dag)   list_length((dag)->parents)
 /*---------------------------------------------------------------------------*/
+/* Routing type of the RPL source routing header (RFC 6554). */
+#define RPL_RH_TYPE_SRH                 3
+/*---------------------------------------------------------------------------*/
 typedef uint16_t rpl_rank_t;
 typedef uint16_t rpl_ocp_t;
 /*---------------------------------------------------------------------------*/
@@ -210,19 +214,11 @@ struct rpl_instance {
   uint8_t dio_intmin;
   uint8_t dio_redundancy;
   uint8_t default_lifetime;
-  uint8_t dio_intcurrent;
-  uint8_t dio_send; /* for keeping track of which mode the timer is in */
-  uint8_t dio_counter;
   rpl_rank_t max_rankinc;
   rpl_rank_t min_hoprankinc;
   uint16_t lifetime_unit; /* lifetime in seconds = l_u * d_l */
-#if RPL_CONF_STATS
-  uint16_t dio_totint;
-  uint16_t dio_totsend;
-  uint16_t dio_totrecv;
-#endif /* RPL_CONF_STATS */
-  uint32_t dio_next_delay; /* delay for completion of dio interval */
-  struct ctimer dio_timer;
+  /* Trickle timer for DIOs; dio_timer.stats holds the DIO counters. */
+  struct trickle_timer dio_timer;
   struct ctimer dao_timer;
 };
 
@@ -241,5 +237,12 @@ int rpl_update_header_final(uip_ipaddr_t *addr);
 int rpl_verify_header(int);
 void rpl_remove_header(void);
 uint8_t rpl_invert_header(void);
+#if RPL_WITH_NON_STORING
+int rpl_process_srh_header(void);
+int rpl_srh_next_hop(uip_ipaddr_t *nexthop);
+#endif /* RPL_WITH_NON_STORING */
+#if RPL_WITH_ROUTE_SUMMARY
+uip_ds6_route_t *rpl_summary_route_lookup(uip_ipaddr_t *destipaddr);
+#endif /* RPL_WITH_ROUTE_SUMMARY */
 /*---------------------------------------------------------------------------*/
 #endif /* RPL_H */
@@ -0,0 +1,490 @@
+/*
+ * Copyright (c) 2012, LCIS/CTSYS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         6lowpan UDP payload compressor
+ *
+ *         When the destination port of a UDP datagram has a codec,
+ *         one byte follows the compressed UDP header: 0 if the payload
+ *         is sent as is, or the length of the encoded payload that
+ *         follows. The encoded payload starts with a frame byte: the
+ *         sequence number of the reference values it defines, or 0x80
+ *         and the sequence number of the reference values it uses. It
+ *         is followed by tokens:
+ *
+ *         0x00-0x7f  the byte itself
+ *         0x80-0xbf  a dictionary string
+ *         0xc0-0xc4  a decimal number of 1 to 5 digits, then its value
+ *         0xc8-0xcc  a decimal number of 1 to 5 digits, then its
+ *                    difference to the reference value
+ *         0xff       the next byte as is
+ *
+ *         Values are sent 7 bits per byte, least significant bits
+ *         first, and differences are zigzag encoded.
+ */
+
+#include "net/sicslowpan-udp-codec.h"
+#include "net/uip.h"
+#include "net/packetbuf.h"
+#include "lib/list.h"
+
+#include <string.h>
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+#define UIP_IP_BUF  ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UIP_UDP_BUF ((struct uip_udp_hdr *)&uip_buf[UIP_LLIPH_LEN])
+
+#define TOKEN_DICTIONARY 0x80
+#define TOKEN_ABSOLUTE   0xc0
+#define TOKEN_DELTA      0xc8
+#define TOKEN_ESCAPE     0xff
+
+#define FRAME_DELTA      0x80
+#define SEQ_MASK         0x7f
+
+/* The longest decimal number that fits in 16 bits. */
+#define MAX_DIGITS       5
+
+LIST(codecs);
+/*---------------------------------------------------------------------------*/
+static struct sicslowpan_udp_codec *
+codec_lookup(uint16_t port)
+{
+  struct sicslowpan_udp_codec *c;
+
+  for(c = list_head(codecs); c != NULL; c = list_item_next(c)) {
+    if(c->port == port) {
+      return c;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static int
+is_digit(uint8_t c)
+{
+  return c >= '0' && c <= '9';
+}
+/*---------------------------------------------------------------------------*/
+static int
+put_value(uint8_t *out, uint16_t pos, uint16_t max, uint32_t value)
+{
+  do {
+    if(pos >= max) {
+      return -1;
+    }
+    out[pos] = value & 0x7f;
+    value >>= 7;
+    if(value != 0) {
+      out[pos] |= 0x80;
+    }
+    pos++;
+  } while(value != 0);
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static int
+get_value(const uint8_t *in, uint16_t pos, uint16_t len, uint32_t *value)
+{
+  uint8_t shift;
+
+  *value = 0;
+  for(shift = 0; shift < 21; shift += 7) {
+    if(pos >= len) {
+      return -1;
+    }
+    *value |= (uint32_t)(in[pos] & 0x7f) << shift;
+    if((in[pos++] & 0x80) == 0) {
+      return pos;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+void
+sicslowpan_udp_codec_register(struct sicslowpan_udp_codec *c, uint16_t port,
+                              const char * const *dictionary, uint8_t size)
+{
+  memset(c, 0, sizeof(struct sicslowpan_udp_codec));
+  c->port = port;
+  c->dictionary = dictionary;
+  c->dictionary_size = size > SICSLOWPAN_UDP_CODEC_MAX_DICTIONARY ?
+    SICSLOWPAN_UDP_CODEC_MAX_DICTIONARY : size;
+  list_add(codecs, c);
+}
+/*---------------------------------------------------------------------------*/
+void
+sicslowpan_udp_codec_remove(struct sicslowpan_udp_codec *c)
+{
+  list_remove(codecs, c);
+}
+/*---------------------------------------------------------------------------*/
+int
+sicslowpan_udp_codec_encode(struct sicslowpan_udp_codec *c,
+                            const rimeaddr_t *to,
+                            const uint8_t *in, uint16_t len,
+                            uint8_t *out, uint16_t max)
+{
+  uint16_t base[SICSLOWPAN_UDP_CODEC_FIELDS];
+  uint16_t p;
+  int o;
+  uint8_t keyframe;
+  uint8_t seq;
+  uint8_t field;
+  uint8_t i;
+  uint8_t best;
+  uint8_t best_len;
+  uint8_t word_len;
+  uint8_t digits;
+  uint32_t value;
+  int32_t delta;
+
+  if(max == 0) {
+    return -1;
+  }
+
+  /* New reference values are sent periodically, and whenever the next
+     hop changes, as it may not have the current ones. */
+  keyframe = !c->tx.used || c->count == 0 || !rimeaddr_cmp(&c->tx.addr, to);
+  if(keyframe) {
+    seq = (c->tx.seq + 1) & SEQ_MASK;
+    out[0] = seq;
+  } else {
+    seq = c->tx.seq;
+    out[0] = FRAME_DELTA | seq;
+  }
+  o = 1;
+
+  field = 0;
+  p = 0;
+  while(p < len) {
+    /* Longest dictionary string at this position. */
+    best = 0;
+    best_len = 0;
+    for(i = 0; i < c->dictionary_size; i++) {
+      word_len = strlen(c->dictionary[i]);
+      if(word_len > best_len && word_len <= len - p &&
+         memcmp(&in[p], c->dictionary[i], word_len) == 0) {
+        best = i;
+        best_len = word_len;
+      }
+    }
+    if(best_len > 1) {
+      if(o >= max) {
+        return -1;
+      }
+      out[o++] = TOKEN_DICTIONARY | best;
+      p += best_len;
+      continue;
+    }
+
+    if(is_digit(in[p])) {
+      value = 0;
+      for(digits = 0; p + digits < len && is_digit(in[p + digits]); digits++) {
+        if(digits < MAX_DIGITS) {
+          value = value * 10 + (in[p + digits] - '0');
+        }
+      }
+      if(digits <= MAX_DIGITS && value <= 0xffff) {
+        if(o >= max) {
+          return -1;
+        }
+        if(keyframe || field >= c->tx.fields) {
+          out[o++] = TOKEN_ABSOLUTE | (digits - 1);
+          o = put_value(out, o, max, value);
+          if(keyframe && field < SICSLOWPAN_UDP_CODEC_FIELDS) {
+            base[field] = value;
+          }
+        } else {
+          out[o++] = TOKEN_DELTA | (digits - 1);
+          delta = (int32_t)value - c->tx.base[field];
+          o = put_value(out, o, max,
+                        ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+        }
+        if(o < 0) {
+          return -1;
+        }
+        field++;
+        p += digits;
+        continue;
+      }
+      /* Numbers that do not fit in 16 bits are sent as text. */
+      while(digits-- > 0) {
+        if(o >= max) {
+          return -1;
+        }
+        out[o++] = in[p++];
+      }
+      continue;
+    }
+
+    if(in[p] & 0x80) {
+      if(o + 1 >= max) {
+        return -1;
+      }
+      out[o++] = TOKEN_ESCAPE;
+    } else if(o >= max) {
+      return -1;
+    }
+    out[o++] = in[p++];
+  }
+
+  if(keyframe) {
+    rimeaddr_copy(&c->tx.addr, to);
+    c->tx.used = 1;
+    c->tx.seq = seq;
+    c->tx.fields = field < SICSLOWPAN_UDP_CODEC_FIELDS ?
+      field : SICSLOWPAN_UDP_CODEC_FIELDS;
+    memcpy(c->tx.base, base, c->tx.fields * sizeof(uint16_t));
+  }
+  c->count = (c->count + 1) % SICSLOWPAN_UDP_CODEC_KEYFRAME;
+
+  return o;
+}
+/*---------------------------------------------------------------------------*/
+int
+sicslowpan_udp_codec_decode(struct sicslowpan_udp_codec *c,
+                            const rimeaddr_t *from,
+                            const uint8_t *in, uint16_t len,
+                            uint8_t *out, uint16_t max)
+{
+  struct sicslowpan_udp_codec_ref *ref;
+  uint16_t base[SICSLOWPAN_UDP_CODEC_FIELDS];
+  uint16_t o;
+  int p;
+  uint8_t keyframe;
+  uint8_t field;
+  uint8_t token;
+  uint8_t word_len;
+  uint8_t digits;
+  uint8_t i;
+  uint32_t value;
+  int32_t delta;
+
+  if(len == 0) {
+    return -1;
+  }
+
+  ref = NULL;
+  for(i = 0; i < SICSLOWPAN_UDP_CODEC_SOURCES; i++) {
+    if(c->rx[i].used && rimeaddr_cmp(&c->rx[i].addr, from)) {
+      ref = &c->rx[i];
+      break;
+    }
+  }
+
+  keyframe = (in[0] & FRAME_DELTA) == 0;
+  if(!keyframe && (ref == NULL || ref->seq != (in[0] & SEQ_MASK))) {
+    /* We missed the reference values of this payload. */
+    PRINTF("udp-codec: no reference values %u for port %u\n",
+           in[0] & SEQ_MASK, c->port);
+    return -1;
+  }
+
+  field = 0;
+  o = 0;
+  p = 1;
+  while(p < len) {
+    token = in[p++];
+    if(token < TOKEN_DICTIONARY) {
+      if(o >= max) {
+        return -1;
+      }
+      out[o++] = token;
+    } else if(token < TOKEN_ABSOLUTE) {
+      token &= ~TOKEN_DICTIONARY;
+      if(token >= c->dictionary_size) {
+        return -1;
+      }
+      word_len = strlen(c->dictionary[token]);
+      if(o + word_len > max) {
+        return -1;
+      }
+      memcpy(&out[o], c->dictionary[token], word_len);
+      o += word_len;
+    } else if(token == TOKEN_ESCAPE) {
+      if(p >= len || o >= max) {
+        return -1;
+      }
+      out[o++] = in[p++];
+    } else if((token & ~7) == TOKEN_ABSOLUTE || (token & ~7) == TOKEN_DELTA) {
+      digits = (token & 7) + 1;
+      if(digits > MAX_DIGITS || o + digits > max) {
+        return -1;
+      }
+      p = get_value(in, p, len, &value);
+      if(p < 0) {
+        return -1;
+      }
+      if((token & ~7) == TOKEN_DELTA) {
+        if(keyframe || field >= ref->fields) {
+          return -1;
+        }
+        delta = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+        value = (uint32_t)((int32_t)ref->base[field] + delta);
+      } else if(keyframe && field < SICSLOWPAN_UDP_CODEC_FIELDS) {
+        base[field] = value;
+      }
+      if(value > 0xffff) {
+        return -1;
+      }
+      for(i = digits; i > 0; i--) {
+        out[o + i - 1] = '0' + value % 10;
+        value /= 10;
+      }
+      if(value != 0) {
+        /* The number does not fit in its digits. */
+        return -1;
+      }
+      o += digits;
+      field++;
+    } else {
+      return -1;
+    }
+  }
+
+  if(keyframe) {
+    if(ref == NULL) {
+      ref = &c->rx[c->rx_next];
+      c->rx_next = (c->rx_next + 1) % SICSLOWPAN_UDP_CODEC_SOURCES;
+      rimeaddr_copy(&ref->addr, from);
+      ref->used = 1;
+    }
+    ref->seq = in[0] & SEQ_MASK;
+    ref->fields = field < SICSLOWPAN_UDP_CODEC_FIELDS ?
+      field : SICSLOWPAN_UDP_CODEC_FIELDS;
+    memcpy(ref->base, base, ref->fields * sizeof(uint16_t));
+  }
+
+  return o;
+}
+/*---------------------------------------------------------------------------*/
+static int
+is_compressable(uint8_t next_header)
+{
+  /* The UDP header itself is compressed by IPHC. */
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+compress(uint8_t *compressed, uint8_t *uncomp_hdr_len)
+{
+  struct sicslowpan_udp_codec *c;
+  uint16_t payload_len;
+  uint16_t max;
+  int len;
+
+  if(UIP_IP_BUF->proto != UIP_PROTO_UDP ||
+     *uncomp_hdr_len != UIP_IPH_LEN + UIP_UDPH_LEN) {
+    return 0;
+  }
+  c = codec_lookup(UIP_HTONS(UIP_UDP_BUF->destport));
+  if(c == NULL) {
+    return 0;
+  }
+
+  /* The encoded payload replaces the whole payload, and the length of
+     the headers it stands for must fit in uncomp_hdr_len. The encoded
+     payload must also be shorter than the payload. */
+  len = -1;
+  payload_len = uip_len - *uncomp_hdr_len;
+  if(uip_len <= 0xff && payload_len > 1) {
+    max = payload_len - 1;
+    if(max > SICSLOWPAN_UDP_CODEC_MAX_LEN) {
+      max = SICSLOWPAN_UDP_CODEC_MAX_LEN;
+    }
+    len = sicslowpan_udp_codec_encode(c,
+                                      packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
+                                      &uip_buf[UIP_LLH_LEN + *uncomp_hdr_len],
+                                      payload_len, compressed + 1, max);
+  }
+  if(len <= 0) {
+    compressed[0] = 0;
+    return 1;
+  }
+
+  PRINTF("udp-codec: port %u, %u bytes encoded in %d\n",
+         c->port, payload_len, len);
+  compressed[0] = len;
+  *uncomp_hdr_len = uip_len;
+  return 1 + len;
+}
+/*---------------------------------------------------------------------------*/
+static int
+uncompress(uint8_t *compressed, uint8_t *lowpanbuf, uint8_t *uncomp_hdr_len)
+{
+  struct uip_ip_hdr *ip;
+  struct uip_udp_hdr *udp;
+  struct sicslowpan_udp_codec *c;
+  int len;
+
+  ip = (struct uip_ip_hdr *)&lowpanbuf[UIP_LLH_LEN];
+  udp = (struct uip_udp_hdr *)&lowpanbuf[UIP_LLIPH_LEN];
+  if(ip->proto != UIP_PROTO_UDP ||
+     *uncomp_hdr_len != UIP_IPH_LEN + UIP_UDPH_LEN) {
+    return 0;
+  }
+  c = codec_lookup(UIP_HTONS(udp->destport));
+  if(c == NULL) {
+    return 0;
+  }
+  if(compressed[0] == 0) {
+    return 1;
+  }
+
+  len = sicslowpan_udp_codec_decode(c, packetbuf_addr(PACKETBUF_ADDR_SENDER),
+                                    compressed + 1, compressed[0],
+                                    &lowpanbuf[UIP_LLH_LEN + *uncomp_hdr_len],
+                                    0xff - *uncomp_hdr_len);
+  if(len < 0) {
+    /* UDP checksums may be disabled, so the datagram cannot be passed
+       on with a wrong payload. */
+    PRINTF("udp-codec: cannot decode payload for port %u\n", c->port);
+    return -1;
+  }
+  *uncomp_hdr_len += len;
+  return 1 + compressed[0];
+}
+/*---------------------------------------------------------------------------*/
+struct sicslowpan_nh_compressor sicslowpan_udp_compressor = {
+  is_compressable,
+  compress,
+  uncompress
+};
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2012, LCIS/CTSYS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Header file for the 6lowpan UDP payload compressor
+ *
+ *         The compressor is a SICSLOWPAN_NH_COMPRESSOR plug-in that
+ *         compresses the payload of UDP datagrams sent to the ports
+ *         registered with a codec. A codec replaces the strings of its
+ *         dictionary by one byte, and the decimal numbers of the
+ *         payload by their binary value. Every
+ *         SICSLOWPAN_UDP_CODEC_KEYFRAME payloads, the numbers are sent
+ *         as is and become the reference values; the payloads in
+ *         between carry the difference to these references.
+ *
+ *         6lowpan compression is done hop by hop, so every node of the
+ *         network must register the same codecs, with the same
+ *         dictionaries, for the same ports. To use the compressor,
+ *         define SICSLOWPAN_CONF_NH_COMPRESSOR as
+ *         sicslowpan_udp_compressor.
+ */
+
+#ifndef __SICSLOWPAN_UDP_CODEC_H__
+#define __SICSLOWPAN_UDP_CODEC_H__
+
+#include "contiki-conf.h"
+#include "net/rime/rimeaddr.h"
+#include "net/sicslowpan.h"
+
+/** Largest encoded payload. The IPHC header and the encoded payload
+    must fit in one frame. */
+#ifdef SICSLOWPAN_UDP_CODEC_CONF_MAX_LEN
+#define SICSLOWPAN_UDP_CODEC_MAX_LEN SICSLOWPAN_UDP_CODEC_CONF_MAX_LEN
+#else
+#define SICSLOWPAN_UDP_CODEC_MAX_LEN 48
+#endif
+
+/** Number of decimal fields of a payload that are delta encoded. */
+#ifdef SICSLOWPAN_UDP_CODEC_CONF_FIELDS
+#define SICSLOWPAN_UDP_CODEC_FIELDS SICSLOWPAN_UDP_CODEC_CONF_FIELDS
+#else
+#define SICSLOWPAN_UDP_CODEC_FIELDS 8
+#endif
+
+/** Number of previous hops whose reference values a codec keeps. */
+#ifdef SICSLOWPAN_UDP_CODEC_CONF_SOURCES
+#define SICSLOWPAN_UDP_CODEC_SOURCES SICSLOWPAN_UDP_CODEC_CONF_SOURCES
+#else
+#define SICSLOWPAN_UDP_CODEC_SOURCES 4
+#endif
+
+/** Number of payloads between two sets of reference values. A node
+    that misses the reference values from a neighbor drops the payloads
+    that use them: up to SICSLOWPAN_UDP_CODEC_KEYFRAME - 1 datagrams,
+    until the next reference values arrive. Lower values resynchronize
+    sooner on lossy links, at the cost of a lower compression. */
+#ifdef SICSLOWPAN_UDP_CODEC_CONF_KEYFRAME
+#define SICSLOWPAN_UDP_CODEC_KEYFRAME SICSLOWPAN_UDP_CODEC_CONF_KEYFRAME
+#else
+#define SICSLOWPAN_UDP_CODEC_KEYFRAME 8
+#endif
+
+/** Largest dictionary a codec can have. */
+#define SICSLOWPAN_UDP_CODEC_MAX_DICTIONARY 64
+
+/**
+ * \brief Reference values shared with a neighbor
+ */
+struct sicslowpan_udp_codec_ref {
+  rimeaddr_t addr;
+  uint8_t used;
+  uint8_t seq;
+  uint8_t fields;
+  uint16_t base[SICSLOWPAN_UDP_CODEC_FIELDS];
+};
+
+/**
+ * \brief A codec for the payloads sent to a UDP port
+ */
+struct sicslowpan_udp_codec {
+  struct sicslowpan_udp_codec *next;
+  uint16_t port;
+  const char * const *dictionary;
+  uint8_t dictionary_size;
+  /* Number of payloads sent since the last reference values. */
+  uint8_t count;
+  /* Reference values sent to the last next hop. */
+  struct sicslowpan_udp_codec_ref tx;
+  /* Reference values received from the previous hops. */
+  struct sicslowpan_udp_codec_ref rx[SICSLOWPAN_UDP_CODEC_SOURCES];
+  uint8_t rx_next;
+};
+
+/**
+ * \brief Register a codec for a UDP port
+ * \param c    A pointer to the codec structure, which must be kept
+ * \param port The UDP destination port, in host byte order
+ * \param dictionary The strings replaced by one byte, longest first
+ * \param size The number of strings, at most SICSLOWPAN_UDP_CODEC_MAX_DICTIONARY
+ */
+void sicslowpan_udp_codec_register(struct sicslowpan_udp_codec *c,
+                                   uint16_t port,
+                                   const char * const *dictionary,
+                                   uint8_t size);
+
+/**
+ * \brief Remove a codec
+ * \param c    A pointer to a registered codec
+ */
+void sicslowpan_udp_codec_remove(struct sicslowpan_udp_codec *c);
+
+/**
+ * \brief Encode a payload
+ * \param c    The codec
+ * \param to   The link-layer address of the next hop
+ * \param in   The payload
+ * \param len  The length of the payload
+ * \param out  The buffer for the encoded payload
+ * \param max  The size of the buffer
+ * \return The length of the encoded payload, or -1 if it does not fit
+ *
+ *             The reference values of the codec are only updated when
+ *             the encoding succeeds.
+ */
+int sicslowpan_udp_codec_encode(struct sicslowpan_udp_codec *c,
+                                const rimeaddr_t *to,
+                                const uint8_t *in, uint16_t len,
+                                uint8_t *out, uint16_t max);
+
+/**
+ * \brief Decode a payload
+ * \param c    The codec
+ * \param from The link-layer address of the previous hop
+ * \param in   The encoded payload
+ * \param len  The length of the encoded payload
+ * \param out  The buffer for the payload
+ * \param max  The size of the buffer
+ * \return The length of the payload, or -1 if it cannot be decoded
+ */
+int sicslowpan_udp_codec_decode(struct sicslowpan_udp_codec *c,
+                                const rimeaddr_t *from,
+                                const uint8_t *in, uint16_t len,
+                                uint8_t *out, uint16_t max);
+
+extern struct sicslowpan_nh_compressor sicslowpan_udp_compressor;
+
+#endif /* __SICSLOWPAN_UDP_CODEC_H__ */
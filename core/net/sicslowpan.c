@@ -107,6 +107,14 @@ void uip_log(char *msg);
 #define SICSLOWPAN_MAX_MAC_TRANSMISSIONS 4
 #endif
 
+/** Time during which an expired context is still used for decompression,
+    in seconds */
+#ifdef SICSLOWPAN_CONF_CONTEXT_GRACE
+#define SICSLOWPAN_CONTEXT_GRACE SICSLOWPAN_CONF_CONTEXT_GRACE
+#else
+#define SICSLOWPAN_CONTEXT_GRACE 3600
+#endif
+
 #ifndef SICSLOWPAN_COMPRESSION
 #ifdef SICSLOWPAN_CONF_COMPRESSION
 #define SICSLOWPAN_COMPRESSION SICSLOWPAN_CONF_COMPRESSION
@@ -163,9 +171,21 @@ void uip_log(char *msg);
 /** @} */
 
 
-/** \brief Size of the 802.15.4 payload (127byte - 25 for MAC header) */
+/** \brief Size of the 802.15.4 payload (127byte - 25 for MAC header),
+    used when the framer does not report its header length */
 #define MAC_MAX_PAYLOAD 102
 
+/** \brief Size of the 802.15.4 frame without the FCS */
+#define MAC_MAX_FRAME (127 - 2)
+
+/** \brief Bytes added below the framer by the RDC layer, such as the
+    ContikiMAC header, configurable through SICSLOWPAN_CONF_MAC_OVERHEAD */
+#ifdef SICSLOWPAN_CONF_MAC_OVERHEAD
+#define SICSLOWPAN_MAC_OVERHEAD SICSLOWPAN_CONF_MAC_OVERHEAD
+#else
+#define SICSLOWPAN_MAC_OVERHEAD 2
+#endif
+
 
 /** \brief Some MAC layers need a minimum payload, which is
     configurable through the SICSLOWPAN_CONF_MIN_MAC_PAYLOAD
@@ -179,6 +199,10 @@ void uip_log(char *msg);
 /** \name General variables
  *  @{
  */
+#ifdef SICSLOWPAN_CONF_NH_COMPRESSOR
+#define SICSLOWPAN_NH_COMPRESSOR SICSLOWPAN_CONF_NH_COMPRESSOR
+#endif
+
 #ifdef SICSLOWPAN_NH_COMPRESSOR
 /** A pointer to the additional compressor */
 extern struct sicslowpan_nh_compressor SICSLOWPAN_NH_COMPRESSOR;
@@ -244,6 +268,10 @@ static uint16_t processed_ip_in_len;
 /** Datagram tag to be put in the fragments I send. */
 static uint16_t my_tag;
 
+/** Packetbuf attributes of the datagram being fragmented. */
+static struct packetbuf_attr frag_attrs[PACKETBUF_NUM_ATTRS];
+static struct packetbuf_addr frag_addrs[PACKETBUF_NUM_ADDRS];
+
 /** When reassembling, the tag in the fragments being merged. */
 static uint16_t reass_tag;
 
@@ -315,10 +343,26 @@ set_packet_attrs()
  *  @{
  */
 
-/** Addresses contexts for IPHC. */
+/** Addresses contexts for IPHC, indexed by context number. */
 #if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
 static struct sicslowpan_addr_context 
 addr_contexts[SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS];
+
+/** Hash index of the compression contexts by prefix. Each slot holds a
+    context number + 1, or 0 if the slot is empty. */
+#if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS < 4
+#define CONTEXT_INDEX_SIZE 4
+#elif SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS < 8
+#define CONTEXT_INDEX_SIZE 8
+#elif SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS < 16
+#define CONTEXT_INDEX_SIZE 16
+#else
+#define CONTEXT_INDEX_SIZE 32
+#endif
+static uint8_t context_index[CONTEXT_INDEX_SIZE];
+
+/** clock_seconds() at which the next context changes state, 0 if none. */
+static unsigned long context_next_expiry;
 #endif
 
 /** pointer to an address context. */
@@ -360,18 +404,95 @@ static const uint8_t ttl_values[] = {0, 1, 64, 255};
 /** \name HC06 related functions
  * @{                                                                 */
 /*--------------------------------------------------------------------*/
-/** \brief find the context corresponding to prefix ipaddr */
+#if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
+static uint8_t
+context_hash(const uint8_t *prefix)
+{
+  uint8_t h;
+  uint8_t i;
+
+  h = 0;
+  for(i = 0; i < 8; i++) {
+    h = ((h << 1) | (h >> 7)) ^ prefix[i];
+  }
+  return (h ^ (h >> 4)) & (CONTEXT_INDEX_SIZE - 1);
+}
+/*--------------------------------------------------------------------*/
+/** \brief rebuild the prefix index of the compression contexts */
+static void
+context_index_update(void)
+{
+  uint8_t i;
+  uint8_t slot;
+
+  memset(context_index, 0, sizeof(context_index));
+  for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
+    if(addr_contexts[i].used == SICSLOWPAN_CONTEXT_COMPRESS) {
+      slot = context_hash(addr_contexts[i].prefix);
+      while(context_index[slot] != 0) {
+        slot = (slot + 1) & (CONTEXT_INDEX_SIZE - 1);
+      }
+      context_index[slot] = i + 1;
+    }
+  }
+}
+/*--------------------------------------------------------------------*/
+/** \brief apply the context lifetimes that have expired */
+static void
+context_expire(void)
+{
+  unsigned long now;
+  uint8_t i;
+  struct sicslowpan_addr_context *c;
+
+  now = clock_seconds();
+  if(context_next_expiry == 0 || (long)(now - context_next_expiry) < 0) {
+    return;
+  }
+
+  context_next_expiry = 0;
+  for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
+    c = &addr_contexts[i];
+    if(c->used == SICSLOWPAN_CONTEXT_UNUSED || c->expiry == 0) {
+      continue;
+    }
+    if((long)(now - c->expiry) >= 0) {
+      if(c->used == SICSLOWPAN_CONTEXT_COMPRESS) {
+        PRINTF("IPHC: context %u is now decompression only\n", c->number);
+        c->used = SICSLOWPAN_CONTEXT_DECOMPRESS;
+        c->expiry = now + SICSLOWPAN_CONTEXT_GRACE;
+      } else {
+        PRINTF("IPHC: context %u removed\n", c->number);
+        c->used = SICSLOWPAN_CONTEXT_UNUSED;
+        continue;
+      }
+    }
+    if(context_next_expiry == 0 ||
+       (long)(c->expiry - context_next_expiry) < 0) {
+      context_next_expiry = c->expiry;
+    }
+  }
+  context_index_update();
+}
+#endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
+/*--------------------------------------------------------------------*/
+/** \brief find the compression context corresponding to prefix ipaddr */
 static struct sicslowpan_addr_context*
 addr_context_lookup_by_prefix(uip_ipaddr_t *ipaddr)
 {
 /* Remove code to avoid warnings and save flash if no context is used */
 #if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
-  int i;
-  for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
-    if((addr_contexts[i].used == 1) &&
-       uip_ipaddr_prefixcmp(&addr_contexts[i].prefix, ipaddr, 64)) {
-      return &addr_contexts[i];
+  uint8_t slot;
+  uint8_t i;
+
+  context_expire();
+  slot = context_hash(ipaddr->u8);
+  for(i = 0; i < CONTEXT_INDEX_SIZE && context_index[slot] != 0; i++) {
+    if(uip_ipaddr_prefixcmp(&addr_contexts[context_index[slot] - 1].prefix,
+                            ipaddr, 64)) {
+      return &addr_contexts[context_index[slot] - 1];
     }
+    slot = (slot + 1) & (CONTEXT_INDEX_SIZE - 1);
   }
 #endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
   return NULL;
@@ -383,12 +504,12 @@ addr_context_lookup_by_number(uint8_t number)
 {
 /* Remove code to avoid warnings and save flash if no context is used */ 
 #if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
-  int i;
-  for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
-    if((addr_contexts[i].used == 1) &&
-       addr_contexts[i].number == number) {
-      return &addr_contexts[i];
-    }
+  context_expire();
+  /* Contexts that may no longer be used for compression are still
+     valid for decompression. */
+  if(number < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS &&
+     addr_contexts[number].used != SICSLOWPAN_CONTEXT_UNUSED) {
+    return &addr_contexts[number];
   }
 #endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
   return NULL;
@@ -781,11 +902,15 @@ compress_hdr_hc06(rimeaddr_t *rime_destaddr)
  * \param ip_len Equal to 0 if the packet is not a fragment (IP length
  * is then inferred from the L2 length), non 0 if the packet is a 1st
  * fragment.
+ * \return 1 on success, 0 if the packet must be dropped
  */
-static void
+static int
 uncompress_hdr_hc06(uint16_t ip_len)
 {
   uint8_t tmp, iphc0, iphc1;
+#ifdef SICSLOWPAN_NH_COMPRESSOR
+  int nh_len = 0;
+#endif
   /* at least two byte will be used for the encoding */
   hc06_ptr = rime_ptr + rime_hdr_len + 2;
 
@@ -867,7 +992,7 @@ uncompress_hdr_hc06(uint16_t ip_len)
       context = addr_context_lookup_by_number(sci);
       if(context == NULL) {
         PRINTF("sicslowpan uncompress_hdr: error context not found\n");
-        return;
+        return 0;
       }
     }
     /* if tmp == 0 we do not have a context and therefore no prefix */
@@ -915,7 +1040,7 @@ uncompress_hdr_hc06(uint16_t ip_len)
       /* all valid cases below need the context! */
       if(context == NULL) {
 	PRINTF("sicslowpan uncompress_hdr: error context not found\n");
-	return;
+	return 0;
       }
       uncompress_addr(&SICSLOWPAN_IP_BUF->destipaddr, context->prefix,
                       unc_ctxconf[tmp],
@@ -981,7 +1106,7 @@ uncompress_hdr_hc06(uint16_t ip_len)
 
       default:
 	PRINTF("sicslowpan uncompress_hdr: error unsupported UDP compression\n");
-	return;
+	return 0;
       }
       if(!checksum_compressed) { /* has_checksum, default  */
 	memcpy(&SICSLOWPAN_UDP_BUF->udpchksum, hc06_ptr, 2);
@@ -991,11 +1116,20 @@ uncompress_hdr_hc06(uint16_t ip_len)
 	PRINTF("IPHC: sicslowpan uncompress_hdr: checksum *NOT* included\n");
       }
       uncomp_hdr_len += UIP_UDPH_LEN;
+#ifdef SICSLOWPAN_NH_COMPRESSOR
+      /* The compressor may follow the UDP header, as on output */
+      nh_len = SICSLOWPAN_NH_COMPRESSOR.uncompress(hc06_ptr, sicslowpan_buf, &uncomp_hdr_len);
+#endif
     }
 #ifdef SICSLOWPAN_NH_COMPRESSOR
     else {
-      hc06_ptr += SICSLOWPAN_NH_COMPRESSOR.uncompress(hc06_ptr, sicslowpan_buf, &uncomp_hdr_len);
+      nh_len = SICSLOWPAN_NH_COMPRESSOR.uncompress(hc06_ptr, sicslowpan_buf, &uncomp_hdr_len);
+    }
+    if(nh_len < 0) {
+      PRINTF("sicslowpan uncompress_hdr: next header compressor dropped the packet\n");
+      return 0;
     }
+    hc06_ptr += nh_len;
 #endif
   }
 
@@ -1017,9 +1151,88 @@ uncompress_hdr_hc06(uint16_t ip_len)
     memcpy(&SICSLOWPAN_UDP_BUF->udplen, &SICSLOWPAN_IP_BUF->len[0], 2);
   }
 
-  return;
+  return 1;
 }
 /** @} */
+
+#if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
+/*--------------------------------------------------------------------*/
+int
+sicslowpan_context_set(uint8_t number, const uint8_t *prefix,
+                       uint8_t length, uint8_t compress, uint16_t lifetime)
+{
+  struct sicslowpan_addr_context *c;
+  unsigned long now;
+  uint8_t i;
+
+  if(number >= SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS || length > 64) {
+    return 0;
+  }
+  c = &addr_contexts[number];
+  now = clock_seconds();
+
+  if(lifetime == 0) {
+    /* The context is withdrawn: keep it for decompression only. */
+    if(c->used == SICSLOWPAN_CONTEXT_UNUSED) {
+      return 0;
+    }
+    c->used = SICSLOWPAN_CONTEXT_DECOMPRESS;
+    c->expiry = now + SICSLOWPAN_CONTEXT_GRACE;
+  } else {
+    c->used = compress ? SICSLOWPAN_CONTEXT_COMPRESS :
+      SICSLOWPAN_CONTEXT_DECOMPRESS;
+    c->number = number;
+    c->length = length;
+    /* Bits beyond the context length are zero, so that the context only
+       matches addresses that can be rebuilt from it. */
+    memset(c->prefix, 0, sizeof(c->prefix));
+    for(i = 0; i < length / 8; i++) {
+      c->prefix[i] = prefix[i];
+    }
+    if(length & 7) {
+      c->prefix[i] = prefix[i] & (0xff << (8 - (length & 7)));
+    }
+    if(lifetime == 0xffff) {
+      c->expiry = 0;
+    } else {
+      c->expiry = now + (unsigned long)lifetime * 60;
+      if(c->expiry == 0) {
+        c->expiry = 1;
+      }
+    }
+  }
+
+  if(c->expiry != 0 && (context_next_expiry == 0 ||
+                        (long)(c->expiry - context_next_expiry) < 0)) {
+    context_next_expiry = c->expiry;
+  }
+  PRINTF("IPHC: context %u set, length %u, state %u, lifetime %u\n",
+         number, length, c->used, lifetime);
+  context_index_update();
+  return 1;
+}
+/*--------------------------------------------------------------------*/
+const struct sicslowpan_addr_context *
+sicslowpan_context_get(uint8_t number)
+{
+  return addr_context_lookup_by_number(number);
+}
+/*--------------------------------------------------------------------*/
+uint16_t
+sicslowpan_context_lifetime(const struct sicslowpan_addr_context *context)
+{
+  unsigned long remaining;
+
+  if(context->used != SICSLOWPAN_CONTEXT_COMPRESS) {
+    return 0;
+  }
+  if(context->expiry == 0) {
+    return 0xffff;
+  }
+  remaining = (context->expiry - clock_seconds() + 59) / 60;
+  return remaining >= 0xffff ? 0xfffe : (uint16_t)remaining;
+}
+#endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
 #endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
 
 
@@ -1336,7 +1549,9 @@ send_packet(rimeaddr_t *dest)
 #endif
 
   /* Provide a callback function to receive the result of
-     a packet transmission. */
+     a packet transmission. The status stays deferred until the MAC
+     calls it. */
+  last_tx_status = MAC_TX_DEFERRED;
   NETSTACK_MAC.send(&packet_sent, NULL);
 
   /* If we are sending multiple packets in a row, we need to let the
@@ -1344,6 +1559,48 @@ send_packet(rimeaddr_t *dest)
   watchdog_periodic();
 }
 /*--------------------------------------------------------------------*/
+#if SICSLOWPAN_CONF_FRAG
+/**
+ * \brief Check if the fragment just given to the MAC was lost
+ *
+ * The following fragments are useless to the receiver once one of
+ * them is lost, so the datagram is dropped.
+ */
+static int
+fragment_failed(void)
+{
+  return last_tx_status == MAC_TX_COLLISION ||
+    last_tx_status == MAC_TX_NOACK ||
+    last_tx_status == MAC_TX_ERR ||
+    last_tx_status == MAC_TX_ERR_FATAL;
+}
+#endif /* SICSLOWPAN_CONF_FRAG */
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Get the space left for 6lowpan in a frame
+ *
+ * The length of the MAC header depends on the destination (broadcast
+ * frames use a short destination address) and on the framer, so it is
+ * asked to the framer for the receiver set in the packetbuf. With
+ * framer_802154, 8-byte addresses, a single PAN ID and the 2-byte
+ * ContikiMAC header, this leaves 125 - 2 - 21 = 102 bytes for unicast
+ * and 125 - 2 - 15 = 108 bytes for broadcast frames.
+ */
+static int
+mac_max_payload(void)
+{
+  int hdrlen;
+
+  hdrlen = FRAMER_FAILED;
+  if(NETSTACK_FRAMER.length != NULL) {
+    hdrlen = NETSTACK_FRAMER.length();
+  }
+  if(hdrlen < 0) {
+    return MAC_MAX_PAYLOAD;
+  }
+  return MAC_MAX_FRAME - SICSLOWPAN_MAC_OVERHEAD - hdrlen;
+}
+/*--------------------------------------------------------------------*/
 /** \brief Take an IP packet and format it to be sent on an 802.15.4
  *  network using 6lowpan.
  *  \param localdest The MAC address of the destination
@@ -1362,6 +1619,9 @@ output(uip_lladdr_t *localdest)
   /* Number of bytes processed. */
   uint16_t processed_ip_out_len;
 
+  /* Space left for 6lowpan in each frame. */
+  int max_payload;
+
   /* init */
   uncomp_hdr_len = 0;
   rime_hdr_len = 0;
@@ -1407,6 +1667,9 @@ output(uip_lladdr_t *localdest)
   
   PRINTFO("sicslowpan output: sending packet len %d\n", uip_len);
 
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &dest);
+  max_payload = mac_max_payload();
+
   if(uip_len >= COMPRESSION_THRESHOLD) {
     /* Try to compress the headers */
 #if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC1
@@ -1423,15 +1686,20 @@ output(uip_lladdr_t *localdest)
   }
   PRINTFO("sicslowpan output: header of len %d\n", rime_hdr_len);
 
-  if(uip_len - uncomp_hdr_len > MAC_MAX_PAYLOAD - rime_hdr_len) {
+  if(uip_len - uncomp_hdr_len > max_payload - rime_hdr_len) {
 #if SICSLOWPAN_CONF_FRAG
-    struct queuebuf *q;
+    uint16_t tag;
     /*
      * The outbound IPv6 packet is too large to fit into a single 15.4
      * packet, so we fragment it into multiple packets and send them.
      * The first fragment contains frag1 dispatch, then
      * IPv6/HC1/HC06/HC_UDP dispatchs/headers.
      * The following fragments contain only the fragn dispatch.
+     *
+     * The fragments are handed to the MAC one after the other without
+     * waiting for their transmission, so that a queueing MAC sends the
+     * whole train as one burst. Each fragment is built from uip_buf in
+     * a cleared packetbuf, with the attributes of the datagram.
      */
 
     PRINTFO("Fragmentation sending packet len %d\n", uip_len);
@@ -1451,30 +1719,22 @@ output(uip_lladdr_t *localdest)
     SET16(RIME_FRAG_PTR, RIME_FRAG_DISPATCH_SIZE,
           ((SICSLOWPAN_DISPATCH_FRAG1 << 8) | uip_len));
 /*     RIME_FRAG_BUF->tag = uip_htons(my_tag); */
-    SET16(RIME_FRAG_PTR, RIME_FRAG_TAG, my_tag);
-    my_tag++;
+    tag = my_tag++;
+    SET16(RIME_FRAG_PTR, RIME_FRAG_TAG, tag);
 
     /* Copy payload and send */
     rime_hdr_len += SICSLOWPAN_FRAG1_HDR_LEN;
-    rime_payload_len = (MAC_MAX_PAYLOAD - rime_hdr_len) & 0xf8;
-    PRINTFO("(len %d, tag %d)\n", rime_payload_len, my_tag);
+    rime_payload_len = (max_payload - rime_hdr_len) & 0xf8;
+    PRINTFO("(len %d, tag %d)\n", rime_payload_len, tag);
     memcpy(rime_ptr + rime_hdr_len,
            (uint8_t *)UIP_IP_BUF + uncomp_hdr_len, rime_payload_len);
     packetbuf_set_datalen(rime_payload_len + rime_hdr_len);
-    q = queuebuf_new_from_packetbuf();
-    if(q == NULL) {
-      PRINTFO("could not allocate queuebuf for first fragment, dropping packet\n");
-      return 0;
-    }
+    packetbuf_attr_copyto(frag_attrs, frag_addrs);
     send_packet(&dest);
-    queuebuf_to_packetbuf(q);
-    queuebuf_free(q);
-    q = NULL;
-
-    /* Check tx result. */
-    if((last_tx_status == MAC_TX_COLLISION) ||
-       (last_tx_status == MAC_TX_ERR) ||
-       (last_tx_status == MAC_TX_ERR_FATAL)) {
+
+    /* Only a MAC that sends synchronously, or that cannot queue the
+       fragment, reports its result here. */
+    if(fragment_failed()) {
       PRINTFO("error in fragment tx, dropping subsequent fragments.\n");
       return 0;
     }
@@ -1484,17 +1744,21 @@ output(uip_lladdr_t *localdest)
     
     /*
      * Create following fragments
-     * Datagram tag is already in the buffer, we need to set the
-     * FRAGN dispatch and for each fragment, the offset
+     * The FRAGN header carries the same tag, and for each fragment,
+     * the offset
      */
     rime_hdr_len = SICSLOWPAN_FRAGN_HDR_LEN;
-/*     RIME_FRAG_BUF->dispatch_size = */
-/*       uip_htons((SICSLOWPAN_DISPATCH_FRAGN << 8) | uip_len); */
-    SET16(RIME_FRAG_PTR, RIME_FRAG_DISPATCH_SIZE,
-          ((SICSLOWPAN_DISPATCH_FRAGN << 8) | uip_len));
-    rime_payload_len = (MAC_MAX_PAYLOAD - rime_hdr_len) & 0xf8;
+    rime_payload_len = (max_payload - rime_hdr_len) & 0xf8;
     while(processed_ip_out_len < uip_len) {
       PRINTFO("sicslowpan output: fragment ");
+      packetbuf_clear();
+      packetbuf_attr_copyfrom(frag_attrs, frag_addrs);
+      rime_ptr = packetbuf_dataptr();
+/*     RIME_FRAG_BUF->dispatch_size = */
+/*       uip_htons((SICSLOWPAN_DISPATCH_FRAGN << 8) | uip_len); */
+      SET16(RIME_FRAG_PTR, RIME_FRAG_DISPATCH_SIZE,
+            ((SICSLOWPAN_DISPATCH_FRAGN << 8) | uip_len));
+      SET16(RIME_FRAG_PTR, RIME_FRAG_TAG, tag);
       RIME_FRAG_PTR[RIME_FRAG_OFFSET] = processed_ip_out_len >> 3;
       
       /* Copy payload and send */
@@ -1503,25 +1767,14 @@ output(uip_lladdr_t *localdest)
         rime_payload_len = uip_len - processed_ip_out_len;
       }
       PRINTFO("(offset %d, len %d, tag %d)\n",
-             processed_ip_out_len >> 3, rime_payload_len, my_tag);
+             processed_ip_out_len >> 3, rime_payload_len, tag);
       memcpy(rime_ptr + rime_hdr_len,
              (uint8_t *)UIP_IP_BUF + processed_ip_out_len, rime_payload_len);
       packetbuf_set_datalen(rime_payload_len + rime_hdr_len);
-      q = queuebuf_new_from_packetbuf();
-      if(q == NULL) {
-        PRINTFO("could not allocate queuebuf, dropping fragment\n");
-        return 0;
-      }
       send_packet(&dest);
-      queuebuf_to_packetbuf(q);
-      queuebuf_free(q);
-      q = NULL;
       processed_ip_out_len += rime_payload_len;
 
-      /* Check tx result. */
-      if((last_tx_status == MAC_TX_COLLISION) ||
-         (last_tx_status == MAC_TX_ERR) ||
-         (last_tx_status == MAC_TX_ERR_FATAL)) {
+      if(fragment_failed()) {
         PRINTFO("error in fragment tx, dropping subsequent fragments.\n");
         return 0;
       }
@@ -1666,7 +1919,14 @@ input(void)
 #if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
   if((RIME_HC1_PTR[RIME_HC1_DISPATCH] & 0xe0) == SICSLOWPAN_DISPATCH_IPHC) {
     PRINTFI("sicslowpan input: IPHC\n");
-    uncompress_hdr_hc06(frag_size);
+    if(!uncompress_hdr_hc06(frag_size)) {
+#if SICSLOWPAN_CONF_FRAG
+      /* Do not wait for the other fragments of a dropped datagram. */
+      sicslowpan_len = 0;
+      processed_ip_in_len = 0;
+#endif /* SICSLOWPAN_CONF_FRAG */
+      return;
+    }
   } else
 #endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
     switch(RIME_HC1_PTR[RIME_HC1_DISPATCH]) {
@@ -1834,6 +2094,20 @@ sicslowpan_init(void)
   }
 #endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 1 */
 
+#if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
+  /* Preconfigured contexts are 64 bits long and never expire. Other
+     contexts are learnt from the Router Advertisements. */
+  {
+    int i;
+    for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
+      addr_contexts[i].length = 64;
+      addr_contexts[i].expiry = 0;
+    }
+    context_next_expiry = 0;
+    context_index_update();
+  }
+#endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
+
 #endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
 }
 /*--------------------------------------------------------------------*/
@@ -219,11 +219,24 @@
  * each context can have upto 8 bytes
  */
 struct sicslowpan_addr_context {
-  uint8_t used; /* possibly use as prefix-length */
+  uint8_t used; /* one of the SICSLOWPAN_CONTEXT_ states */
   uint8_t number;
+  uint8_t length; /* context length in bits */
   uint8_t prefix[8];
+  unsigned long expiry; /* clock_seconds() of the next state change, 0 if never */
 };
 
+/**
+ * \name Address context states
+ * @{
+ */
+#define SICSLOWPAN_CONTEXT_UNUSED                   0
+/** The context is used for compression and decompression */
+#define SICSLOWPAN_CONTEXT_COMPRESS                 1
+/** The context expired or has its C flag cleared: decompression only */
+#define SICSLOWPAN_CONTEXT_DECOMPRESS               2
+/** @} */
+
 /**
  * \name Address compressibility test functions
  * @{
@@ -313,11 +326,43 @@ struct sicslowpan_nh_compressor {
   int (* compress)(uint8_t *compressed, uint8_t *uncompressed_len);
 
   /** uncompress next header (TCP/UDP, etc) - ptr points to next header to
-      uncompress */
+      uncompress. Returns the number of bytes consumed, or -1 if the
+      packet must be dropped */
   int (* uncompress)(uint8_t *compressed, uint8_t *lowpanbuf, uint8_t *uncompressed_len);
 
 };
 
+/**
+ * \brief Add, update or remove an IPHC address context
+ * \param number   The context identifier, below SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS
+ * \param prefix   The context prefix (8 bytes, bits beyond length are ignored)
+ * \param length   The context length in bits, at most 64
+ * \param compress Non-zero if the context may be used for compression
+ * \param lifetime The valid lifetime in minutes, 0xffff for infinite
+ * \return 1 if the context was stored, 0 otherwise
+ *
+ * This is used when processing the 6LoWPAN Context Option of Router
+ * Advertisements (RFC 6775). A context whose lifetime expires, or that
+ * is received with a zero lifetime, is kept for decompression only
+ * during SICSLOWPAN_CONTEXT_GRACE seconds before it is removed.
+ */
+int sicslowpan_context_set(uint8_t number, const uint8_t *prefix,
+                           uint8_t length, uint8_t compress,
+                           uint16_t lifetime);
+
+/**
+ * \brief Get an IPHC address context
+ * \param number The context identifier
+ * \return The context, or NULL if the context is not in use
+ */
+const struct sicslowpan_addr_context *sicslowpan_context_get(uint8_t number);
+
+/**
+ * \brief Get the remaining valid lifetime of a context, in minutes
+ * \param context A context returned by sicslowpan_context_get()
+ * \return The lifetime, 0xffff for infinite, 0 for a decompression-only context
+ */
+uint16_t sicslowpan_context_lifetime(const struct sicslowpan_addr_context *context);
 
 extern const struct network_driver sicslowpan_driver;
 
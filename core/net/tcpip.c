@@ -47,6 +47,12 @@
 #include "net/uip-ds6.h"
 #endif
 
+#if UIP_CONF_IPV6 && UIP_CONF_IPV6_INPUT_BUFFERS
+#include "net/packetbuf.h"
+#include "lib/list.h"
+#include "lib/memb.h"
+#endif
+
 #include <string.h>
 
 #define DEBUG DEBUG_NONE
@@ -85,6 +91,21 @@ static struct etimer periodic;
 extern struct etimer uip_reass_timer;
 #endif
 
+#if UIP_CONF_IPV6 && UIP_CONF_IPV6_INPUT_BUFFERS
+/* Incoming packets wait in a pool of buffers until the tcpip process
+   handles them, so that the network driver can take the next frame
+   from the radio while the previous packet is being processed. */
+struct input_buf {
+  struct input_buf *next;
+  rimeaddr_t sender;
+  uint16_t len;
+  uint8_t data[UIP_BUFSIZE - UIP_LLH_LEN];
+};
+
+MEMB(input_memb, struct input_buf, UIP_CONF_IPV6_INPUT_BUFFERS);
+LIST(input_list);
+#endif /* UIP_CONF_IPV6 && UIP_CONF_IPV6_INPUT_BUFFERS */
+
 #if UIP_TCP
 /**
  * \internal Structure for holding a TCP port and a process ID.
@@ -179,6 +200,20 @@ check_for_tcp_syn(void)
 }
 /*---------------------------------------------------------------------------*/
 static void
+poll_send_window(void)
+{
+#if UIP_TCP && UIP_TCP_SEND_WINDOW > 1
+  /* A connection that has just sent a segment while having buffered
+     segments in flight is polled again right away, so that it can
+     fill the rest of its window. */
+  if(uip_len > 0 && uip_conn != NULL && uip_conn->segs != NULL &&
+     uip_tcp_window_open(uip_conn)) {
+    tcpip_poll_tcp(uip_conn);
+  }
+#endif /* UIP_TCP && UIP_TCP_SEND_WINDOW > 1 */
+}
+/*---------------------------------------------------------------------------*/
+static void
 packet_input(void)
 {
 #if UIP_CONF_IP_FORWARD
@@ -188,6 +223,7 @@ packet_input(void)
       tcpip_is_forwarding = 0;
       check_for_tcp_syn();
       uip_input();
+      poll_send_window();
       if(uip_len > 0) {
 #if UIP_CONF_TCP_SPLIT
         uip_split_output();
@@ -207,6 +243,7 @@ packet_input(void)
   if(uip_len > 0) {
     check_for_tcp_syn();
     uip_input();
+    poll_send_window();
     if(uip_len > 0) {
 #if UIP_CONF_TCP_SPLIT
       uip_split_output();
@@ -432,6 +469,7 @@ eventhandler(process_event_t ev, process_data_t data)
                  connections. */
               etimer_restart(&periodic);
               uip_periodic(i);
+              poll_send_window();
 #if UIP_CONF_IPV6
               tcpip_ipv6_output();
 #else
@@ -489,6 +527,7 @@ eventhandler(process_event_t ev, process_data_t data)
     case TCP_POLL:
       if(data != NULL) {
         uip_poll_conn(data);
+        poll_send_window();
 #if UIP_CONF_IPV6
         tcpip_ipv6_output();
 #else /* UIP_CONF_IPV6 */
@@ -520,13 +559,59 @@ eventhandler(process_event_t ev, process_data_t data)
     case PACKET_INPUT:
       packet_input();
       break;
+
+#if UIP_CONF_IPV6 && UIP_CONF_IPV6_INPUT_BUFFERS
+    case PROCESS_EVENT_POLL:
+      {
+        struct input_buf *b;
+
+        /* Handle one queued packet at a time, and let the other
+           processes run in between. */
+        b = list_pop(input_list);
+        if(b != NULL) {
+          memcpy(&uip_buf[UIP_LLH_LEN], b->data, b->len);
+          uip_len = b->len;
+          uip_ext_len = 0;
+          /* The sender is used by RPL to identify its neighbors. */
+          packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &b->sender);
+          memb_free(&input_memb, b);
+          packet_input();
+          uip_len = 0;
+          uip_ext_len = 0;
+        }
+        if(list_head(input_list) != NULL) {
+          process_poll(&tcpip_process);
+        }
+      }
+      break;
+#endif /* UIP_CONF_IPV6 && UIP_CONF_IPV6_INPUT_BUFFERS */
   };
 }
 /*---------------------------------------------------------------------------*/
 void
 tcpip_input(void)
 {
+#if UIP_CONF_IPV6 && UIP_CONF_IPV6_INPUT_BUFFERS
+  struct input_buf *b;
+
+  if(uip_len > 0 && uip_len <= sizeof(b->data)) {
+    b = memb_alloc(&input_memb);
+    if(b != NULL) {
+      memcpy(b->data, &uip_buf[UIP_LLH_LEN], uip_len);
+      b->len = uip_len;
+      rimeaddr_copy(&b->sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+      list_add(input_list, b);
+      process_poll(&tcpip_process);
+    } else {
+      /* Handling the packet right away would pass it before the queued
+         ones, so it is dropped instead. */
+      PRINTF("tcpip_input: no free input buffer, dropping packet\n");
+      UIP_STAT(++uip_stat.ip.drop);
+    }
+  }
+#else /* UIP_CONF_IPV6 && UIP_CONF_IPV6_INPUT_BUFFERS */
   process_post_synch(&tcpip_process, PACKET_INPUT, NULL);
+#endif /* UIP_CONF_IPV6 && UIP_CONF_IPV6_INPUT_BUFFERS */
   uip_len = 0;
 #if UIP_CONF_IPV6
   uip_ext_len = 0;
@@ -539,6 +624,9 @@ tcpip_ipv6_output(void)
 {
   uip_ds6_nbr_t *nbr = NULL;
   uip_ipaddr_t *nexthop;
+#if UIP_CONF_IPV6_RPL && RPL_WITH_NON_STORING
+  uip_ipaddr_t srh_nexthop;
+#endif /* UIP_CONF_IPV6_RPL && RPL_WITH_NON_STORING */
 
   if(uip_len == 0) {
     return;
@@ -559,11 +647,20 @@ tcpip_ipv6_output(void)
   if(!uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
     /* Next hop determination */
     nbr = NULL;
+#if UIP_CONF_IPV6_RPL && RPL_WITH_NON_STORING
+    if(rpl_srh_next_hop(&srh_nexthop)) {
+      nexthop = &srh_nexthop;
+    } else
+#endif /* UIP_CONF_IPV6_RPL && RPL_WITH_NON_STORING */
     if(uip_ds6_is_addr_onlink(&UIP_IP_BUF->destipaddr)){
       nexthop = &UIP_IP_BUF->destipaddr;
     } else {
       uip_ds6_route_t* locrt;
+#if UIP_CONF_IPV6_RPL && RPL_WITH_ROUTE_SUMMARY
+      locrt = rpl_summary_route_lookup(&UIP_IP_BUF->destipaddr);
+#else
       locrt = uip_ds6_route_lookup(&UIP_IP_BUF->destipaddr);
+#endif /* UIP_CONF_IPV6_RPL && RPL_WITH_ROUTE_SUMMARY */
       if(locrt == NULL) {
         if((nexthop = uip_ds6_defrt_choose()) == NULL) {
 #ifdef UIP_FALLBACK_INTERFACE
@@ -755,6 +852,11 @@ PROCESS_THREAD(tcpip_process, ev, data)
 #endif /* UIP_CONF_ICMP6 */
   etimer_set(&periodic, CLOCK_SECOND / 2);
 
+#if UIP_CONF_IPV6 && UIP_CONF_IPV6_INPUT_BUFFERS
+  memb_init(&input_memb);
+  list_init(input_list);
+#endif /* UIP_CONF_IPV6 && UIP_CONF_IPV6_INPUT_BUFFERS */
+
   uip_init();
 #ifdef UIP_FALLBACK_INTERFACE
   UIP_FALLBACK_INTERFACE.init();
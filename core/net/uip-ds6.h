@@ -244,6 +244,10 @@ typedef struct rpl_route_entry {
   uint32_t saved_lifetime;
   void *dag;
   uint8_t learned_from;
+#if RPL_CONF_WITH_ROUTE_SUMMARY
+  /* Usage counter, aged by the RPL route summaries. */
+  uint8_t hits;
+#endif /* RPL_CONF_WITH_ROUTE_SUMMARY */
 } rpl_route_entry_t;
 #endif /* UIP_DS6_ROUTE_STATE_TYPE */
 
@@ -73,6 +73,15 @@
 #include "net/uip-nd6.h"
 #include "net/uip-ds6.h"
 #include "lib/random.h"
+#include "net/sicslowpan.h"
+
+/** Process and send the 6LoWPAN Context Option (RFC 6775) in RAs */
+#ifdef UIP_CONF_ND6_6CO
+#define UIP_ND6_6CO UIP_CONF_ND6_6CO
+#else
+#define UIP_ND6_6CO (SICSLOWPAN_CONF_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 && \
+                     SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0)
+#endif
 
 /*------------------------------------------------------------------*/
 #define DEBUG 0
@@ -112,6 +121,7 @@ void uip_log(char *msg);
 #define UIP_ND6_OPT_HDR_BUF  ((uip_nd6_opt_hdr *)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset])
 #define UIP_ND6_OPT_PREFIX_BUF ((uip_nd6_opt_prefix_info *)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset])
 #define UIP_ND6_OPT_MTU_BUF ((uip_nd6_opt_mtu *)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset])
+#define UIP_ND6_OPT_6CO_BUF ((uip_nd6_opt_6co *)&uip_buf[uip_l2_l3_icmp_hdr_len + nd6_opt_offset])
 /** @} */
 
 static uint8_t nd6_opt_offset;                     /** Offset from the end of the icmpv6 header to the option in uip_buf*/
@@ -690,6 +700,36 @@ uip_nd6_ra_output(uip_ipaddr_t * dest)
 
   uip_len += UIP_ND6_OPT_MTU_LEN;
   nd6_opt_offset += UIP_ND6_OPT_MTU_LEN;
+
+#if UIP_ND6_6CO
+  /* 6LoWPAN contexts. Withdrawn contexts are advertised with the C flag
+     cleared and a zero lifetime until they are removed. */
+  {
+    const struct sicslowpan_addr_context *context;
+    uint8_t cid;
+
+    for(cid = 0; cid < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; cid++) {
+      context = sicslowpan_context_get(cid);
+      if(context == NULL) {
+        continue;
+      }
+      UIP_ND6_OPT_6CO_BUF->type = UIP_ND6_OPT_6CO;
+      UIP_ND6_OPT_6CO_BUF->len = UIP_ND6_OPT_6CO_LEN >> 3;
+      UIP_ND6_OPT_6CO_BUF->context_len = context->length;
+      UIP_ND6_OPT_6CO_BUF->flags_cid = cid & UIP_ND6_6CO_CID_MASK;
+      if(context->used == SICSLOWPAN_CONTEXT_COMPRESS) {
+        UIP_ND6_OPT_6CO_BUF->flags_cid |= UIP_ND6_6CO_FLAG_C;
+      }
+      UIP_ND6_OPT_6CO_BUF->reserved = 0;
+      UIP_ND6_OPT_6CO_BUF->lifetime =
+        uip_htons(sicslowpan_context_lifetime(context));
+      memcpy(UIP_ND6_OPT_6CO_BUF->prefix, context->prefix, 8);
+      uip_len += UIP_ND6_OPT_6CO_LEN;
+      nd6_opt_offset += UIP_ND6_OPT_6CO_LEN;
+    }
+  }
+#endif /* UIP_ND6_6CO */
+
   UIP_IP_BUF->len[0] = ((uip_len - UIP_IPH_LEN) >> 8);
   UIP_IP_BUF->len[1] = ((uip_len - UIP_IPH_LEN) & 0xff);
 
@@ -819,6 +859,20 @@ uip_nd6_ra_input(void)
       uip_ds6_if.link_mtu =
         uip_ntohl(((uip_nd6_opt_mtu *) UIP_ND6_OPT_HDR_BUF)->mtu);
       break;
+#if UIP_ND6_6CO
+    case UIP_ND6_OPT_6CO:
+      PRINTF("Processing 6CO option in RA\n");
+      /* Only contexts of up to 64 bits can be used by IPHC here. */
+      if((UIP_ND6_OPT_6CO_BUF->len == 2 || UIP_ND6_OPT_6CO_BUF->len == 3) &&
+         UIP_ND6_OPT_6CO_BUF->context_len <= 64) {
+        sicslowpan_context_set(UIP_ND6_OPT_6CO_BUF->flags_cid & UIP_ND6_6CO_CID_MASK,
+                               UIP_ND6_OPT_6CO_BUF->prefix,
+                               UIP_ND6_OPT_6CO_BUF->context_len,
+                               UIP_ND6_OPT_6CO_BUF->flags_cid & UIP_ND6_6CO_FLAG_C,
+                               uip_ntohs(UIP_ND6_OPT_6CO_BUF->lifetime));
+      }
+      break;
+#endif /* UIP_ND6_6CO */
     case UIP_ND6_OPT_PREFIX_INFO:
       PRINTF("Processing PREFIX option in RA\n");
       nd6_opt_prefix_info = (uip_nd6_opt_prefix_info *) UIP_ND6_OPT_HDR_BUF;
@@ -122,6 +122,7 @@
 #define UIP_ND6_OPT_PREFIX_INFO         3
 #define UIP_ND6_OPT_REDIRECTED_HDR      4
 #define UIP_ND6_OPT_MTU                 5
+#define UIP_ND6_OPT_6CO                 34
 /** @} */
 
 /** \name ND6 option types */
@@ -144,6 +145,7 @@
 #define UIP_ND6_OPT_HDR_LEN            2
 #define UIP_ND6_OPT_PREFIX_INFO_LEN    32
 #define UIP_ND6_OPT_MTU_LEN            8
+#define UIP_ND6_OPT_6CO_LEN            16 /* for contexts up to 64 bits */
 
 
 /* Length of TLLAO and SLLAO options, it is L2 dependant */
@@ -173,6 +175,8 @@
 #define UIP_ND6_NA_FLAG_OVERRIDE        0x20
 #define UIP_ND6_RA_FLAG_ONLINK          0x80
 #define UIP_ND6_RA_FLAG_AUTONOMOUS      0x40
+#define UIP_ND6_6CO_FLAG_C              0x10
+#define UIP_ND6_6CO_CID_MASK            0x0f
 /** @} */
 
 /**
@@ -213,7 +217,7 @@ typedef struct uip_nd6_rs {
 /**
  * \brief A router advertisement constant part
  *
- * Possible options are: SLLAO, MTU, Prefix Information
+ * Possible options are: SLLAO, MTU, Prefix Information, 6LoWPAN Context
  */
 typedef struct uip_nd6_ra {
   uint8_t cur_ttl;
@@ -266,6 +270,17 @@ typedef struct uip_nd6_opt_mtu {
   uint32_t mtu;
 } uip_nd6_opt_mtu;
 
+/** \brief ND option 6LoWPAN context (RFC 6775) */
+typedef struct uip_nd6_opt_6co {
+  uint8_t type;
+  uint8_t len;
+  uint8_t context_len;
+  uint8_t flags_cid;
+  uint16_t reserved;
+  uint16_t lifetime;
+  uint8_t prefix[8]; /* 16 bytes when len is 3 */
+} uip_nd6_opt_6co;
+
 /** \struct Redirected header option */
 typedef struct uip_nd6_opt_redirected_hdr {
   uint8_t type;
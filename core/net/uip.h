@@ -575,6 +575,43 @@ struct uip_conn *uip_connect(uip_ipaddr_t *ripaddr, uint16_t port);
  */
 #define uip_outstanding(conn) ((conn)->len)
 
+#if UIP_TCP_SEND_WINDOW > 1
+/**
+ * Set the number of segments a connection may have in flight.
+ *
+ * A connection starts with a send window of one segment, in which
+ * case the application retransmits its data as usual. With a larger
+ * window, uIP keeps a copy of each segment until it is acknowledged
+ * and retransmits it without calling the application. The
+ * application is then polled as long as the window is open, and must
+ * only call uip_send() when uip_window_open() is true, since data
+ * sent on a closed window is dropped. The UIP_ACKDATA flag means that
+ * some of the segments were acknowledged, and uip_close() is ignored
+ * until all data has been acknowledged.
+ *
+ * \param conn A pointer to the uip_conn structure for the connection.
+ * \param segments The number of segments, at most UIP_TCP_SEND_WINDOW.
+ */
+void uip_set_send_window(struct uip_conn *conn, uint8_t segments);
+
+/**
+ * Check if a connection may send a segment of uip_mss() bytes.
+ *
+ * \param conn A pointer to the uip_conn structure for the connection.
+ */
+int uip_tcp_window_open(struct uip_conn *conn);
+#else /* UIP_TCP_SEND_WINDOW > 1 */
+#define uip_set_send_window(conn, segments)
+#define uip_tcp_window_open(conn) (!uip_outstanding(conn))
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
+
+/**
+ * Check if the current connection may send a segment.
+ *
+ * \hideinitializer
+ */
+#define uip_window_open() uip_tcp_window_open(uip_conn)
+
 /**
  * Send data on the current connection.
  *
@@ -849,7 +886,24 @@ struct uip_udp_conn *uip_udp_new(const uip_ipaddr_t *ripaddr, uint16_t rport);
  *
  * \hideinitializer
  */
+#if UIP_CONF_IPV6
+#define uip_udp_bind(conn, port) do {           \
+    (conn)->lport = port;                       \
+    uip_udp_demux_flush();                      \
+  } while(0)
+#else /* UIP_CONF_IPV6 */
 #define uip_udp_bind(conn, port) (conn)->lport = port
+#endif /* UIP_CONF_IPV6 */
+
+#if UIP_CONF_IPV6
+/**
+ * Forget the cached UDP demultiplexing hints.
+ *
+ * Called when the local port of a UDP connection changes, as a port
+ * may then be used by more than one connection.
+ */
+void uip_udp_demux_flush(void);
+#endif /* UIP_CONF_IPV6 */
 
 /**
  * Send a UDP datagram of length len on the current connection.
@@ -1313,6 +1367,16 @@ struct uip_conn {
   uint8_t timer;         /**< The retransmission timer. */
   uint8_t nrtx;          /**< The number of retransmissions for the last
 			 segment sent. */
+#if UIP_TCP_SEND_WINDOW > 1
+  uint16_t rwnd;         /**< The window last advertised by the remote
+                         host. */
+  uint8_t sndwnd;        /**< The number of segments the connection may
+                         have in flight. */
+  uint8_t nsegs;         /**< The number of segments in flight. */
+  uint8_t close_pending; /**< The application has closed the connection
+                         while segments were in flight. */
+  struct uip_tcp_seg *segs; /**< The segments in flight, oldest first. */
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
 
   /** The application state. */
   uip_tcp_appstate_t appstate;
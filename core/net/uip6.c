@@ -76,6 +76,7 @@
 #include "net/uip-icmp6.h"
 #include "net/uip-nd6.h"
 #include "net/uip-ds6.h"
+#include "lib/memb.h"
 
 #include <string.h>
 
@@ -243,6 +244,21 @@ static uint8_t iss[4];
 uint8_t uip_acc32[4];
 static uint8_t opt;
 static uint16_t tmp16;
+
+#if UIP_TCP_SEND_WINDOW > 1
+/* An unacknowledged segment kept for retransmission. */
+struct uip_tcp_seg {
+  struct uip_tcp_seg *next;
+  uint16_t len;
+  uint8_t data[UIP_TCP_MSS];
+};
+
+/* The segments in flight of the connections with a send window. */
+MEMB(seg_memb, struct uip_tcp_seg, UIP_TCP_SEND_BUFFERS);
+static uint8_t segs_free;
+/* The offset from snd_nxt of the segment being sent. */
+static uint16_t snd_offset;
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
 #endif /* UIP_TCP */
 /** @} */
 
@@ -255,6 +271,35 @@ struct uip_udp_conn uip_udp_conns[UIP_UDP_CONNS];
 #endif /* UIP_UDP */
 /** @} */
 
+/*---------------------------------------------------------------------------*/
+/** @{ \name Demultiplexing caches                                           */
+/*---------------------------------------------------------------------------*/
+/* The last connection found for a hash of the ports of a packet. An
+   entry is only a hint: it is checked against the packet, and the
+   connection tables are searched when it does not match. The size
+   must be a power of two, or 0 to disable the caches. */
+#ifdef UIP_CONF_DEMUX_SIZE
+#define UIP_DEMUX_SIZE UIP_CONF_DEMUX_SIZE
+#else
+#define UIP_DEMUX_SIZE 8
+#endif
+
+#define DEMUX_HASH(p) (((p) ^ ((p) >> 8)) & (UIP_DEMUX_SIZE - 1))
+
+#if UIP_DEMUX_SIZE > 0
+#if UIP_TCP
+/* Indexed by the local and remote ports and the remote address. */
+static struct uip_conn *tcp_demux[UIP_DEMUX_SIZE];
+#define TCP_DEMUX_SLOT(lport, rport, addr) \
+  DEMUX_HASH((uint16_t)((lport) ^ (rport) ^ (addr)->u8[15]))
+#endif /* UIP_TCP */
+#if UIP_UDP
+/* Indexed by the local port, for ports used by a single connection. */
+static struct uip_udp_conn *udp_demux[UIP_DEMUX_SIZE];
+#endif /* UIP_UDP */
+#endif /* UIP_DEMUX_SIZE > 0 */
+/** @} */
+
 /*---------------------------------------------------------------------------*/
 /** @{ \name ICMPv6 variables                                                */
 /*---------------------------------------------------------------------------*/
@@ -416,7 +461,15 @@ uip_init(void)
   }
   for(c = 0; c < UIP_CONNS; ++c) {
     uip_conns[c].tcpstateflags = UIP_CLOSED;
+#if UIP_TCP_SEND_WINDOW > 1
+    uip_conns[c].segs = NULL;
+    uip_conns[c].nsegs = 0;
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
   }
+#if UIP_TCP_SEND_WINDOW > 1
+  memb_init(&seg_memb);
+  segs_free = UIP_TCP_SEND_BUFFERS;
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
 #endif /* UIP_TCP */
 
 #if UIP_ACTIVE_OPEN || UIP_UDP
@@ -428,6 +481,15 @@ uip_init(void)
     uip_udp_conns[c].lport = 0;
   }
 #endif /* UIP_UDP */
+
+#if UIP_DEMUX_SIZE > 0
+#if UIP_TCP
+  memset(tcp_demux, 0, sizeof(tcp_demux));
+#endif /* UIP_TCP */
+#if UIP_UDP
+  memset(udp_demux, 0, sizeof(udp_demux));
+#endif /* UIP_UDP */
+#endif /* UIP_DEMUX_SIZE > 0 */
 }
 /*---------------------------------------------------------------------------*/
 #if UIP_TCP && UIP_ACTIVE_OPEN
@@ -493,9 +555,17 @@ uip_connect(uip_ipaddr_t *ripaddr, uint16_t rport)
   conn->rto = UIP_RTO;
   conn->sa = 0;
   conn->sv = 16;   /* Initial value of the RTT variance. */
+#if UIP_TCP_SEND_WINDOW > 1
+  conn->sndwnd = 1;
+  conn->rwnd = UIP_TCP_MSS;
+  conn->close_pending = 0;
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
   conn->lport = uip_htons(lastport);
   conn->rport = rport;
   uip_ipaddr_copy(&conn->ripaddr, ripaddr);
+#if UIP_DEMUX_SIZE > 0
+  tcp_demux[TCP_DEMUX_SLOT(conn->lport, rport, ripaddr)] = conn;
+#endif /* UIP_DEMUX_SIZE > 0 */
   
   return conn;
 }
@@ -566,9 +636,21 @@ uip_udp_new(const uip_ipaddr_t *ripaddr, uint16_t rport)
     uip_ipaddr_copy(&conn->ripaddr, ripaddr);
   }
   conn->ttl = uip_ds6_if.cur_hop_limit;
+
+  /* The new connection is usually bound to a port right away, which
+     may then no longer be used by a single connection. */
+  uip_udp_demux_flush();
   
   return conn;
 }
+/*---------------------------------------------------------------------------*/
+void
+uip_udp_demux_flush(void)
+{
+#if UIP_DEMUX_SIZE > 0
+  memset(udp_demux, 0, sizeof(udp_demux));
+#endif /* UIP_DEMUX_SIZE > 0 */
+}
 #endif /* UIP_UDP */
 /*---------------------------------------------------------------------------*/
 #if UIP_TCP
@@ -821,8 +903,168 @@ uip_add_rcv_nxt(uint16_t n)
   uip_conn->rcv_nxt[2] = uip_acc32[2];
   uip_conn->rcv_nxt[3] = uip_acc32[3];
 }
+/*---------------------------------------------------------------------------*/
+static uint8_t
+tcp_conn_match(struct uip_conn *conn)
+{
+  return conn->tcpstateflags != UIP_CLOSED &&
+    UIP_TCP_BUF->destport == conn->lport &&
+    UIP_TCP_BUF->srcport == conn->rport &&
+    uip_ipaddr_cmp(&UIP_IP_BUF->srcipaddr, &conn->ripaddr);
+}
 #endif
 /*---------------------------------------------------------------------------*/
+#if UIP_UDP
+static uint8_t
+udp_conn_match(struct uip_udp_conn *conn)
+{
+  /* If the local UDP port is non-zero, the connection is considered
+     to be used. If so, the local port number is checked against the
+     destination port number in the received packet. If the two port
+     numbers match, the remote port number is checked if the
+     connection is bound to a remote port. Finally, if the
+     connection is bound to a remote IP address, the source IP
+     address of the packet is checked. */
+  return conn->lport != 0 &&
+    UIP_UDP_BUF->destport == conn->lport &&
+    (conn->rport == 0 ||
+     UIP_UDP_BUF->srcport == conn->rport) &&
+    (uip_is_addr_unspecified(&conn->ripaddr) ||
+     uip_ipaddr_cmp(&UIP_IP_BUF->srcipaddr, &conn->ripaddr));
+}
+/*---------------------------------------------------------------------------*/
+#if UIP_DEMUX_SIZE > 0
+static void
+udp_demux_add(struct uip_udp_conn *conn)
+{
+  struct uip_udp_conn *other;
+
+  /* When several connections share the port, the first one that
+     matches the packet must be used, so the port is not cached. */
+  for(other = &uip_udp_conns[0];
+      other < &uip_udp_conns[UIP_UDP_CONNS];
+      ++other) {
+    if(other != conn && other->lport == conn->lport) {
+      return;
+    }
+  }
+  udp_demux[DEMUX_HASH(conn->lport)] = conn;
+}
+#endif /* UIP_DEMUX_SIZE > 0 */
+#endif /* UIP_UDP */
+/*---------------------------------------------------------------------------*/
+#if UIP_TCP && UIP_TCP_SEND_WINDOW > 1
+/* A connection whose data is kept in the segment pool. */
+#define BUFFERED(conn) ((conn)->sndwnd > 1 || (conn)->segs != NULL)
+
+static void
+free_segs(struct uip_conn *conn)
+{
+  struct uip_tcp_seg *s;
+
+  while(conn->segs != NULL) {
+    s = conn->segs;
+    conn->segs = s->next;
+    memb_free(&seg_memb, s);
+    segs_free++;
+  }
+  conn->nsegs = 0;
+  conn->close_pending = 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_set_send_window(struct uip_conn *conn, uint8_t segments)
+{
+  if(segments > UIP_TCP_SEND_WINDOW) {
+    segments = UIP_TCP_SEND_WINDOW;
+  } else if(segments == 0) {
+    segments = 1;
+  }
+  conn->sndwnd = segments;
+}
+/*---------------------------------------------------------------------------*/
+int
+uip_tcp_window_open(struct uip_conn *conn)
+{
+  if(!BUFFERED(conn)) {
+    return conn->len == 0;
+  }
+  if(conn->len == 0) {
+    return segs_free > 0;
+  }
+  /* Data sent before the window was enabled must be acknowledged
+     first. The peer must also have room for a full segment. */
+  return conn->segs != NULL && conn->nsegs < conn->sndwnd &&
+    segs_free > 0 && conn->rwnd >= conn->len + conn->mss;
+}
+/*---------------------------------------------------------------------------*/
+/* Keep a copy of the data that the application has sent, and set the
+   offset of its sequence number. */
+static uint8_t
+queue_seg(struct uip_conn *conn)
+{
+  struct uip_tcp_seg *s, **tail;
+
+  if(!uip_tcp_window_open(conn)) {
+    return 0;
+  }
+  s = memb_alloc(&seg_memb);
+  if(s == NULL) {
+    return 0;
+  }
+  segs_free--;
+
+  if(uip_slen > conn->mss) {
+    uip_slen = conn->mss;
+  }
+  s->len = uip_slen;
+  s->next = NULL;
+  memcpy(s->data, uip_sappdata, uip_slen);
+  for(tail = &conn->segs; *tail != NULL; tail = &(*tail)->next);
+  *tail = s;
+  conn->nsegs++;
+
+  if(conn->len == 0) {
+    conn->timer = conn->rto;
+  }
+  snd_offset = conn->len;
+  conn->len += uip_slen;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Release the segments covered by the incoming ACK. Acknowledgements
+   that end inside a segment are ignored. */
+static uint8_t
+ack_segs(struct uip_conn *conn)
+{
+  struct uip_tcp_seg *s, *next;
+  uint16_t acked;
+
+  acked = 0;
+  for(s = conn->segs; s != NULL; s = s->next) {
+    acked += s->len;
+    uip_add32(conn->snd_nxt, acked);
+    if(UIP_TCP_BUF->ackno[0] == uip_acc32[0] &&
+       UIP_TCP_BUF->ackno[1] == uip_acc32[1] &&
+       UIP_TCP_BUF->ackno[2] == uip_acc32[2] &&
+       UIP_TCP_BUF->ackno[3] == uip_acc32[3]) {
+      next = s->next;
+      while(conn->segs != next) {
+        s = conn->segs;
+        conn->segs = s->next;
+        memb_free(&seg_memb, s);
+        segs_free++;
+        conn->nsegs--;
+      }
+      memcpy(conn->snd_nxt, uip_acc32, 4);
+      conn->len -= acked;
+      return 1;
+    }
+  }
+  return 0;
+}
+#endif /* UIP_TCP && UIP_TCP_SEND_WINDOW > 1 */
+/*---------------------------------------------------------------------------*/
 
 /**
  * \brief Process the options in Destination and Hop By Hop extension headers
@@ -918,7 +1160,7 @@ uip_process(uint8_t flag)
   if(flag == UIP_POLL_REQUEST) {
 #if UIP_TCP
     if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED &&
-       !uip_outstanding(uip_connr)) {
+       uip_tcp_window_open(uip_connr)) {
       uip_flags = UIP_POLL;
       UIP_APPCALL();
       goto appsend;
@@ -1014,6 +1256,22 @@ uip_process(uint8_t flag)
 #endif /* UIP_ACTIVE_OPEN */
                      
             case UIP_ESTABLISHED:
+#if UIP_TCP_SEND_WINDOW > 1
+              /* Buffered connections retransmit their oldest segment
+                 without calling the application. Only that segment is
+                 resent, as uip_process() sends one packet per call; the
+                 others are resent by the following timeouts if the
+                 peer has dropped them. A receiver that drops
+                 out-of-order segments, as uIP does, therefore costs up
+                 to one RTO per segment in flight after a loss. */
+              if(uip_connr->segs != NULL) {
+                uip_len = uip_connr->segs->len;
+                memcpy(uip_appdata, uip_connr->segs->data, uip_len);
+                uip_len += UIP_TCPIP_HLEN;
+                UIP_TCP_BUF->flags = TCP_ACK | TCP_PSH;
+                goto tcp_send_noopts;
+              }
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
               /*
                * In the ESTABLISHED state, we call upon the application
                * to do the actual retransmit after which we jump into
@@ -1031,7 +1289,9 @@ uip_process(uint8_t flag)
               goto tcp_send_finack;
           }
         }
-      } else if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED) {
+      }
+      if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED &&
+         uip_tcp_window_open(uip_connr)) {
         /*
          * If there was no need for a retransmission, we poll the
          * application for new data.
@@ -1297,6 +1557,25 @@ uip_process(uint8_t flag)
          */
 
         PRINTF("Processing Routing header\n");
+#if UIP_CONF_IPV6_RPL && RPL_WITH_NON_STORING
+        if(UIP_ROUTING_BUF->routing_type == RPL_RH_TYPE_SRH &&
+           UIP_ROUTING_BUF->seg_left > 0) {
+          /* RPL source routing header: move on to the next hop. */
+          if(!rpl_process_srh_header()) {
+            UIP_STAT(++uip_stat.ip.drop);
+            goto drop;
+          }
+          if(UIP_IP_BUF->ttl <= 1) {
+            uip_icmp6_error_output(ICMP6_TIME_EXCEEDED,
+                                   ICMP6_TIME_EXCEED_TRANSIT, 0);
+            UIP_STAT(++uip_stat.ip.drop);
+            goto send;
+          }
+          UIP_IP_BUF->ttl = UIP_IP_BUF->ttl - 1;
+          UIP_STAT(++uip_stat.ip.forwarded);
+          goto send;
+        }
+#endif /* UIP_CONF_IPV6_RPL && RPL_WITH_NON_STORING */
         if(UIP_ROUTING_BUF->seg_left > 0) {
           uip_icmp6_error_output(ICMP6_PARAM_PROB, ICMP6_PARAMPROB_HEADER, UIP_IPH_LEN + uip_ext_len + 2);
           UIP_STAT(++uip_stat.ip.drop);
@@ -1466,22 +1745,19 @@ uip_process(uint8_t flag)
   }
 
   /* Demultiplex this UDP packet between the UDP "connections". */
+#if UIP_DEMUX_SIZE > 0
+  uip_udp_conn = udp_demux[DEMUX_HASH(UIP_UDP_BUF->destport)];
+  if(uip_udp_conn != NULL && udp_conn_match(uip_udp_conn)) {
+    goto udp_found;
+  }
+#endif /* UIP_DEMUX_SIZE > 0 */
   for(uip_udp_conn = &uip_udp_conns[0];
       uip_udp_conn < &uip_udp_conns[UIP_UDP_CONNS];
       ++uip_udp_conn) {
-    /* If the local UDP port is non-zero, the connection is considered
-       to be used. If so, the local port number is checked against the
-       destination port number in the received packet. If the two port
-       numbers match, the remote port number is checked if the
-       connection is bound to a remote port. Finally, if the
-       connection is bound to a remote IP address, the source IP
-       address of the packet is checked. */
-    if(uip_udp_conn->lport != 0 &&
-       UIP_UDP_BUF->destport == uip_udp_conn->lport &&
-       (uip_udp_conn->rport == 0 ||
-        UIP_UDP_BUF->srcport == uip_udp_conn->rport) &&
-       (uip_is_addr_unspecified(&uip_udp_conn->ripaddr) ||
-        uip_ipaddr_cmp(&UIP_IP_BUF->srcipaddr, &uip_udp_conn->ripaddr))) {
+    if(udp_conn_match(uip_udp_conn)) {
+#if UIP_DEMUX_SIZE > 0
+      udp_demux_add(uip_udp_conn);
+#endif /* UIP_DEMUX_SIZE > 0 */
       goto udp_found;
     }
   }
@@ -1569,12 +1845,20 @@ uip_process(uint8_t flag)
 
   /* Demultiplex this segment. */
   /* First check any active connections. */
+#if UIP_DEMUX_SIZE > 0
+  tmp16 = TCP_DEMUX_SLOT(UIP_TCP_BUF->destport, UIP_TCP_BUF->srcport,
+                         &UIP_IP_BUF->srcipaddr);
+  uip_connr = tcp_demux[tmp16];
+  if(uip_connr != NULL && tcp_conn_match(uip_connr)) {
+    goto found;
+  }
+#endif /* UIP_DEMUX_SIZE > 0 */
   for(uip_connr = &uip_conns[0]; uip_connr <= &uip_conns[UIP_CONNS - 1];
       ++uip_connr) {
-    if(uip_connr->tcpstateflags != UIP_CLOSED &&
-       UIP_TCP_BUF->destport == uip_connr->lport &&
-       UIP_TCP_BUF->srcport == uip_connr->rport &&
-       uip_ipaddr_cmp(&UIP_IP_BUF->srcipaddr, &uip_connr->ripaddr)) {
+    if(tcp_conn_match(uip_connr)) {
+#if UIP_DEMUX_SIZE > 0
+      tcp_demux[tmp16] = uip_connr;
+#endif /* UIP_DEMUX_SIZE > 0 */
       goto found;
     }
   }
@@ -1690,10 +1974,19 @@ uip_process(uint8_t flag)
   uip_connr->sa = 0;
   uip_connr->sv = 4;
   uip_connr->nrtx = 0;
+#if UIP_TCP_SEND_WINDOW > 1
+  uip_connr->sndwnd = 1;
+  uip_connr->rwnd = UIP_TCP_MSS;
+  uip_connr->close_pending = 0;
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
   uip_connr->lport = UIP_TCP_BUF->destport;
   uip_connr->rport = UIP_TCP_BUF->srcport;
   uip_ipaddr_copy(&uip_connr->ripaddr, &UIP_IP_BUF->srcipaddr);
   uip_connr->tcpstateflags = UIP_SYN_RCVD;
+#if UIP_DEMUX_SIZE > 0
+  tcp_demux[TCP_DEMUX_SLOT(uip_connr->lport, uip_connr->rport,
+                           &uip_connr->ripaddr)] = uip_connr;
+#endif /* UIP_DEMUX_SIZE > 0 */
 
   uip_connr->snd_nxt[0] = iss[0];
   uip_connr->snd_nxt[1] = iss[1];
@@ -1814,18 +2107,33 @@ uip_process(uint8_t flag)
      the outstanding data, calculate RTT estimations, and reset the
      retransmission timer. */
   if((UIP_TCP_BUF->flags & TCP_ACK) && uip_outstanding(uip_connr)) {
-    uip_add32(uip_connr->snd_nxt, uip_connr->len);
+#if UIP_TCP_SEND_WINDOW > 1
+    /* Buffered connections may have several segments in flight, of
+       which the incoming segment may acknowledge the oldest ones. */
+    if(uip_connr->segs != NULL) {
+      opt = ack_segs(uip_connr);
+    } else
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
+    {
+      uip_add32(uip_connr->snd_nxt, uip_connr->len);
+
+      opt = UIP_TCP_BUF->ackno[0] == uip_acc32[0] &&
+        UIP_TCP_BUF->ackno[1] == uip_acc32[1] &&
+        UIP_TCP_BUF->ackno[2] == uip_acc32[2] &&
+        UIP_TCP_BUF->ackno[3] == uip_acc32[3];
+      if(opt) {
+        /* Update sequence number. */
+        uip_connr->snd_nxt[0] = uip_acc32[0];
+        uip_connr->snd_nxt[1] = uip_acc32[1];
+        uip_connr->snd_nxt[2] = uip_acc32[2];
+        uip_connr->snd_nxt[3] = uip_acc32[3];
+
+        /* Reset length of outstanding data. */
+        uip_connr->len = 0;
+      }
+    }
 
-    if(UIP_TCP_BUF->ackno[0] == uip_acc32[0] &&
-       UIP_TCP_BUF->ackno[1] == uip_acc32[1] &&
-       UIP_TCP_BUF->ackno[2] == uip_acc32[2] &&
-       UIP_TCP_BUF->ackno[3] == uip_acc32[3]) {
-      /* Update sequence number. */
-      uip_connr->snd_nxt[0] = uip_acc32[0];
-      uip_connr->snd_nxt[1] = uip_acc32[1];
-      uip_connr->snd_nxt[2] = uip_acc32[2];
-      uip_connr->snd_nxt[3] = uip_acc32[3];
-   
+    if(opt) {
       /* Do RTT estimation, unless we have done retransmissions. */
       if(uip_connr->nrtx == 0) {
         signed char m;
@@ -1845,9 +2153,6 @@ uip_process(uint8_t flag)
       uip_flags = UIP_ACKDATA;
       /* Reset the retransmission timer. */
       uip_connr->timer = uip_connr->rto;
-
-      /* Reset length of outstanding data. */
-      uip_connr->len = 0;
     }
     
   }
@@ -2016,6 +2321,9 @@ uip_process(uint8_t flag)
          "persistent timer" and uses the retransmission mechanim.
       */
       tmp16 = ((uint16_t)UIP_TCP_BUF->wnd[0] << 8) + (uint16_t)UIP_TCP_BUF->wnd[1];
+#if UIP_TCP_SEND_WINDOW > 1
+      uip_connr->rwnd = tmp16;
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
       if(tmp16 > uip_connr->initialmss ||
          tmp16 == 0) {
         tmp16 = uip_connr->initialmss;
@@ -2051,6 +2359,25 @@ uip_process(uint8_t flag)
           goto tcp_send_nodata;
         }
 
+#if UIP_TCP_SEND_WINDOW > 1
+        /* The FIN must not be sent before the segments in flight have
+           been acknowledged. A close requested meanwhile is remembered,
+           and the FIN is sent when the ACK of the last segment comes. */
+        if((uip_flags & UIP_CLOSE) && uip_connr->segs != NULL) {
+          uip_connr->close_pending = 1;
+          uip_flags &= ~UIP_CLOSE;
+        }
+        if(uip_connr->close_pending) {
+          if(uip_connr->segs == NULL) {
+            uip_connr->close_pending = 0;
+            uip_flags |= UIP_CLOSE;
+          } else {
+            /* No new data after the close. */
+            uip_slen = 0;
+          }
+        }
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
+
         if(uip_flags & UIP_CLOSE) {
           uip_slen = 0;
           uip_connr->len = 1;
@@ -2061,6 +2388,20 @@ uip_process(uint8_t flag)
         }
 
         /* If uip_slen > 0, the application has data to be sent. */
+#if UIP_TCP_SEND_WINDOW > 1
+        if(uip_slen > 0 && BUFFERED(uip_connr)) {
+          /* Buffered connections send the data as a new segment after
+             the ones in flight, or drop it if the window is closed. */
+          if(queue_seg(uip_connr)) {
+            uip_connr->nrtx = 0;
+            uip_appdata = uip_sappdata;
+            uip_len = uip_slen + UIP_TCPIP_HLEN;
+            UIP_TCP_BUF->flags = TCP_ACK | TCP_PSH;
+            goto tcp_send_noopts;
+          }
+          uip_slen = 0;
+        } else
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
         if(uip_slen > 0) {
 
           /* If the connection has acknowledged data, the contents of
@@ -2205,10 +2546,24 @@ uip_process(uint8_t flag)
   UIP_TCP_BUF->ackno[2] = uip_connr->rcv_nxt[2];
   UIP_TCP_BUF->ackno[3] = uip_connr->rcv_nxt[3];
   
-  UIP_TCP_BUF->seqno[0] = uip_connr->snd_nxt[0];
-  UIP_TCP_BUF->seqno[1] = uip_connr->snd_nxt[1];
-  UIP_TCP_BUF->seqno[2] = uip_connr->snd_nxt[2];
-  UIP_TCP_BUF->seqno[3] = uip_connr->snd_nxt[3];
+#if UIP_TCP_SEND_WINDOW > 1
+  if(snd_offset > 0) {
+    uip_add32(uip_connr->snd_nxt, snd_offset);
+    memcpy(UIP_TCP_BUF->seqno, uip_acc32, 4);
+    snd_offset = 0;
+  } else
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
+  {
+    UIP_TCP_BUF->seqno[0] = uip_connr->snd_nxt[0];
+    UIP_TCP_BUF->seqno[1] = uip_connr->snd_nxt[1];
+    UIP_TCP_BUF->seqno[2] = uip_connr->snd_nxt[2];
+    UIP_TCP_BUF->seqno[3] = uip_connr->snd_nxt[3];
+  }
+#if UIP_TCP_SEND_WINDOW > 1
+  if(uip_connr->tcpstateflags == UIP_CLOSED) {
+    free_segs(uip_connr);
+  }
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
 
   UIP_IP_BUF->proto = UIP_PROTO_TCP;
   
@@ -2262,6 +2617,12 @@ uip_process(uint8_t flag)
   return;
 
  drop:
+#if UIP_TCP && UIP_TCP_SEND_WINDOW > 1
+  /* Release the segments of a connection that was closed or aborted. */
+  if(uip_conn != NULL && uip_conn->tcpstateflags == UIP_CLOSED) {
+    free_segs(uip_conn);
+  }
+#endif /* UIP_TCP && UIP_TCP_SEND_WINDOW > 1 */
   uip_len = 0;
   uip_ext_len = 0;
   uip_ext_bitmap = 0;
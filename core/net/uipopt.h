@@ -194,6 +194,13 @@
 #define UIP_CONF_IPV6_QUEUE_PKT       0
 #endif
 
+#ifndef UIP_CONF_IPV6_INPUT_BUFFERS
+/** Number of incoming packets queued for the tcpip process; packets
+    that arrive when all are used are dropped. With 0, packets are
+    handled as soon as they arrive (default: 0) */
+#define UIP_CONF_IPV6_INPUT_BUFFERS   0
+#endif
+
 #ifndef UIP_CONF_IPV6_CHECKS
 /** Do we do IPv6 consistency checks (highly recommended, default: yes) */
 #define UIP_CONF_IPV6_CHECKS          1
@@ -404,6 +411,36 @@
 #define UIP_RECEIVE_WINDOW (UIP_CONF_RECEIVE_WINDOW)
 #endif
 
+/**
+ * The largest number of unacknowledged segments a TCP connection may
+ * have in flight.
+ *
+ * With the default value of 1, uIP sends one segment at a time and
+ * asks the application to retransmit lost data. With a larger value,
+ * connections that enable it with uip_set_send_window() keep their
+ * unacknowledged segments in a shared pool and uIP retransmits them
+ * itself. Only the IPv6 stack supports more than one segment.
+ *
+ * \hideinitializer
+ */
+#if defined(UIP_CONF_TCP_SEND_WINDOW) && UIP_CONF_IPV6
+#define UIP_TCP_SEND_WINDOW (UIP_CONF_TCP_SEND_WINDOW)
+#else
+#define UIP_TCP_SEND_WINDOW 1
+#endif
+
+/**
+ * The number of segment buffers shared by the connections that have
+ * a send window of more than one segment.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_TCP_SEND_BUFFERS
+#define UIP_TCP_SEND_BUFFERS (UIP_CONF_TCP_SEND_BUFFERS)
+#else
+#define UIP_TCP_SEND_BUFFERS (UIP_TCP_SEND_WINDOW)
+#endif
+
 /**
  * How long a connection should stay in the TIME_WAIT state.
  *
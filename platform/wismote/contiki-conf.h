@@ -108,6 +108,10 @@ typedef unsigned short uip_stats_t;
 #define UIP_CONF_PINGADDRCONF      0
 /** Disable IP packet reassembly. */
 #define UIP_CONF_REASSEMBLY        0
+/** Aggregate the DAOs forwarded towards the RPL root. */
+#ifndef RPL_CONF_WITH_DAO_AGGREGATION
+#define RPL_CONF_WITH_DAO_AGGREGATION 1
+#endif
 /* ---- UDP ---- */
 /** Enable UDP compilation. */
 #define UIP_CONF_UDP               1
@@ -217,6 +221,32 @@ typedef unsigned short uip_stats_t;
 /* SPI bus - CC2520 pin configuration. */
 #define CC2520_CONF_SYMBOL_LOOP_COUNT 2604      /* 326us msp430X @ 16MHz */
 
+/* Frame filtering, auto-ACK and auto-CRC can be done by the CC2520,
+   which also does a CCA before each transmission. The chip only
+   understands 802.15.4 frames, so this is off by default and selects
+   framer_802154 when turned on. */
+#ifndef CC2520_CONF_AUTOACK
+#define CC2520_CONF_AUTOACK           0
+#endif
+#if CC2520_CONF_AUTOACK
+#ifndef NETSTACK_CONF_FRAMER
+#define NETSTACK_CONF_FRAMER          framer_802154
+#endif
+#define RDC_CONF_HARDWARE_ACK         1
+#define RDC_CONF_HARDWARE_CSMA        1
+#define NULLRDC_CONF_802154_AUTOACK_HW 1
+#endif /* CC2520_CONF_AUTOACK */
+
+/* Hooks of the channel hopping RDC (tschrdc). */
+#define TSCHRDC_CONF_RADIO_H          "dev/cc2520.h"
+#define TSCHRDC_CONF_SET_CHANNEL(c)   cc2520_set_channel(c)
+#define TSCHRDC_CONF_RADIO_BUSY()     cc2520_busy()
+
+/* Received frames are moved out of the CC2520 FIFO by the SPI DMA. */
+#ifndef CC2520_CONF_ASYNC_READ
+#define CC2520_CONF_ASYNC_READ        1
+#endif
+
 /* P1.6 - Input: FIFOP from CC2520 */
 #define CC2520_FIFOP_PORT(type)    P1##type
 #define CC2520_FIFOP_PIN           6
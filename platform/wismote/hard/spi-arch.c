@@ -43,15 +43,40 @@
 
 /* From MSP430-GCC */
 #include <signal.h>
+#include <stddef.h>
 
 /* From CONTIKI */
 #include "spi.h"
+#include "sys/energest.h"
 
 /* From platform */
 #include "contiki-conf.h"
 #include "spi-arch.h"
 
-unsigned char spi_busy = 0;
+/** Use the DMA controller for the asynchronous transfers. */
+#ifdef SPI_ARCH_CONF_DMA
+#define SPI_ARCH_DMA SPI_ARCH_CONF_DMA
+#else
+#define SPI_ARCH_DMA 1
+#endif
+
+/* DMA trigger sources of the USCI B0 on the MSP430F543x. */
+#define DMA_TRIGGER_UCB0RX 18
+#define DMA_TRIGGER_UCB0TX 19
+
+volatile unsigned char spi_busy = 0;
+
+static spi_callback_t callback;
+static void *callback_ptr;
+
+#if SPI_ARCH_DMA
+static unsigned char dummy_tx;
+static unsigned char dummy_rx;
+#else
+static const unsigned char *tx_ptr;
+static unsigned char *rx_ptr;
+static unsigned short left;
+#endif /* SPI_ARCH_DMA */
 
 /**
  * Initialize SPI bus.
@@ -73,10 +98,136 @@ spi_init(void)
   SPI_Px_DIR |= (SPI_MOSI | SPI_CLK);
   SPI_Px_DIR &= ~SPI_MISO;
 
-  /* We don't use SPI IT: UCB0IE |= UCTXIE | UCRXIE; */
+  /* The SPI IT is only enabled by the asynchronous transfers. */
 
   /* === Initialize USCI state machine === */
   UCB0CTL1 &= ~UCSWRST;
 }
 
+/**
+ * End an asynchronous transfer.
+ */
+static void
+transfer_done(void)
+{
+  spi_busy = 0;
+  if(callback != NULL) {
+    callback(callback_ptr);
+  }
+}
+
+/**
+ * Start an asynchronous transfer of len bytes.
+ *
+ * The chip select of the slave must be asserted by the caller, and is
+ * usually released by the callback. Returns 0 if a transfer is already
+ * running.
+ */
+int
+spi_transfer(const unsigned char *tx, unsigned char *rx, unsigned short len,
+             spi_callback_t cb, void *ptr)
+{
+  if(spi_busy) {
+    return 0;
+  }
+
+  callback = cb;
+  callback_ptr = ptr;
+  if(len == 0) {
+    transfer_done();
+    return 1;
+  }
+  spi_busy = 1;
+
+  /* Discard the byte received during the last write. */
+  (void)UCB0RXBUF;
+
+#if SPI_ARCH_DMA
+  /* Do not let read-modify-write instructions split a transfer. */
+  DMACTL4 = DMARMWDIS;
+  DMACTL0 = DMA_TRIGGER_UCB0RX | (DMA_TRIGGER_UCB0TX << 8);
+
+  /* Channel 0 has the highest priority: it reads the received bytes, so
+     that none is overwritten by the next one. */
+  DMA0SA = (unsigned int)&UCB0RXBUF;
+  DMA0DA = (unsigned int)(rx != NULL ? rx : &dummy_rx);
+  DMA0SZ = len;
+  DMA0CTL = DMADT_0 | (rx != NULL ? DMADSTINCR_3 : 0) |
+    DMASRCBYTE | DMADSTBYTE | DMAIE | DMAEN;
+
+  /* Channel 1 writes the next byte each time the transmit buffer is
+     free. */
+  dummy_tx = 0;
+  DMA1SA = (unsigned int)(tx != NULL ? tx : &dummy_tx);
+  DMA1DA = (unsigned int)&UCB0TXBUF;
+  DMA1SZ = len;
+  DMA1CTL = DMADT_0 | (tx != NULL ? DMASRCINCR_3 : 0) |
+    DMASRCBYTE | DMADSTBYTE | DMAEN;
+
+  /* The triggers are edge sensitive: the transmit flag is already set,
+     so toggle it to start the transfer. */
+  UCB0IFG &= ~UCTXIFG;
+  UCB0IFG |= UCTXIFG;
+#else /* SPI_ARCH_DMA */
+  /* One byte at a time, from the receive interrupt. */
+  tx_ptr = tx;
+  rx_ptr = rx;
+  left = len;
+  UCB0IE |= UCRXIE;
+  UCB0TXBUF = tx_ptr != NULL ? *tx_ptr++ : 0;
+#endif /* SPI_ARCH_DMA */
+
+  return 1;
+}
+
+#if SPI_ARCH_DMA
+#ifdef __IAR_SYSTEMS_ICC__
+#pragma vector=DMA_VECTOR
+__interrupt void
+#else
+interrupt(DMA_VECTOR)
+#endif
+spi_dma_interrupt(void)
+{
+  ENERGEST_ON(ENERGEST_TYPE_IRQ);
+
+  if(DMAIV == DMAIV_DMA0IFG) {
+    transfer_done();
+    LPM4_EXIT;
+  }
+
+  ENERGEST_OFF(ENERGEST_TYPE_IRQ);
+}
+#else /* SPI_ARCH_DMA */
+#ifdef __IAR_SYSTEMS_ICC__
+#pragma vector=USCI_B0_VECTOR
+__interrupt void
+#else
+interrupt(USCI_B0_VECTOR)
+#endif
+spi_rx_interrupt(void)
+{
+  unsigned char c;
+
+  ENERGEST_ON(ENERGEST_TYPE_IRQ);
+
+  /* Reading the receive buffer clears the interrupt flag. */
+  c = UCB0RXBUF;
+  if(spi_busy) {
+    if(rx_ptr != NULL) {
+      *rx_ptr++ = c;
+    }
+    if(--left > 0) {
+      UCB0TXBUF = tx_ptr != NULL ? *tx_ptr++ : 0;
+    } else {
+      UCB0IE &= ~UCRXIE;
+      transfer_done();
+      LPM4_EXIT;
+    }
+  }
+
+  ENERGEST_OFF(ENERGEST_TYPE_IRQ);
+}
+#endif /* SPI_ARCH_DMA */
+
 /** @} */
@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2012, LCIS/CTSYS.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+
+/**
+ * \file
+ *         Produce a delta between two versions of a file, for the delta
+ *         library (core/lib/delta.h) of the nodes.
+ *
+ *         Usage: mkdelta old new delta
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+unsigned short crc16_data(const unsigned char *data, int len,
+                          unsigned short acc);
+
+#define HASH_BITS   16
+#define HASH_SIZE   (1 << HASH_BITS)
+#define KEY_LEN     4
+#define MAX_CHAIN   256
+#define MAX_INSERT  128
+#define MAX_SHORT   0x3f
+
+#define OP_COPY     0x80
+#define OP_FILL     0xc0
+
+static uint8_t *out;
+static long out_len, out_size;
+
+static uint8_t insert_buf[MAX_INSERT];
+static int insert_len;
+
+static long cursor;
+static long n_copy, n_fill, n_insert;
+/*---------------------------------------------------------------------------*/
+static void
+emit(uint8_t b)
+{
+  if(out_len == out_size) {
+    out_size = out_size ? out_size * 2 : 4096;
+    out = realloc(out, out_size);
+    if(out == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+  out[out_len++] = b;
+}
+/*---------------------------------------------------------------------------*/
+static void
+emit_varint(uint32_t v)
+{
+  while(v >= 0x80) {
+    emit((v & 0x7f) | 0x80);
+    v >>= 7;
+  }
+  emit(v);
+}
+/*---------------------------------------------------------------------------*/
+static int
+varint_len(uint32_t v)
+{
+  int n;
+
+  for(n = 1; v >= 0x80; n++) {
+    v >>= 7;
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+zigzag(long offset)
+{
+  return offset < 0 ? ((uint32_t)(-offset) << 1) - 1 : (uint32_t)offset << 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+emit_op(uint8_t op, long len)
+{
+  if(len <= MAX_SHORT) {
+    emit(op | len);
+  } else {
+    emit(op);
+    emit_varint(len);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+op_cost(long len)
+{
+  return len <= MAX_SHORT ? 1 : 1 + varint_len(len);
+}
+/*---------------------------------------------------------------------------*/
+static void
+flush_insert(void)
+{
+  int i;
+
+  if(insert_len > 0) {
+    emit(insert_len - 1);
+    for(i = 0; i < insert_len; i++) {
+      emit(insert_buf[i]);
+    }
+    n_insert += insert_len;
+    insert_len = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+insert(uint8_t b)
+{
+  insert_buf[insert_len++] = b;
+  if(insert_len == MAX_INSERT) {
+    flush_insert();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+copy(long from, long len)
+{
+  flush_insert();
+  emit_op(OP_COPY, len);
+  emit_varint(zigzag(from - cursor));
+  cursor = from + len;
+  n_copy += len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+fill(uint8_t b, long len)
+{
+  flush_insert();
+  emit_op(OP_FILL, len);
+  emit(b);
+  n_fill += len;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t *
+read_file(const char *name, long *len)
+{
+  FILE *f;
+  uint8_t *buf;
+
+  f = fopen(name, "rb");
+  if(f == NULL) {
+    perror(name);
+    exit(1);
+  }
+  fseek(f, 0, SEEK_END);
+  *len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  buf = malloc(*len + 1);
+  if(buf == NULL || fread(buf, 1, *len, f) != (size_t)*len) {
+    perror(name);
+    exit(1);
+  }
+  fclose(f);
+  return buf;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned
+hash(const uint8_t *p)
+{
+  uint32_t v;
+
+  v = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+/*---------------------------------------------------------------------------*/
+static long
+match_len(const uint8_t *a, long alen, const uint8_t *b, long blen)
+{
+  long n;
+
+  for(n = 0; n < alen && n < blen && a[n] == b[n]; n++);
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static void
+put32(uint8_t *p, uint32_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char *argv[])
+{
+  uint8_t *old, *new;
+  long old_len, new_len;
+  long *head, *chain;
+  long i, j, c;
+  long best, best_len, len, run;
+  int depth;
+  uint8_t hdr[14];
+  FILE *f;
+
+  if(argc != 4) {
+    fprintf(stderr, "usage: %s old new delta\n", argv[0]);
+    return 1;
+  }
+  old = read_file(argv[1], &old_len);
+  new = read_file(argv[2], &new_len);
+
+  /* Chain the positions of the old file by the hash of the next
+     KEY_LEN bytes, most recent first. */
+  head = malloc(HASH_SIZE * sizeof(long));
+  chain = malloc((old_len + 1) * sizeof(long));
+  if(head == NULL || chain == NULL) {
+    perror("malloc");
+    return 1;
+  }
+  for(i = 0; i < HASH_SIZE; i++) {
+    head[i] = -1;
+  }
+  for(i = old_len - KEY_LEN; i >= 0; i--) {
+    j = hash(&old[i]);
+    chain[i] = head[j];
+    head[j] = i;
+  }
+
+  hdr[0] = 'D';
+  hdr[1] = 'L';
+  put32(&hdr[2], old_len);
+  hdr[6] = crc16_data(old, old_len, 0);
+  hdr[7] = crc16_data(old, old_len, 0) >> 8;
+  put32(&hdr[8], new_len);
+  hdr[12] = crc16_data(new, new_len, 0);
+  hdr[13] = crc16_data(new, new_len, 0) >> 8;
+  for(i = 0; i < (long)sizeof(hdr); i++) {
+    emit(hdr[i]);
+  }
+
+  for(i = 0; i < new_len;) {
+    /* The old data that follows the previous copy is the most likely
+       match, and the cheapest to encode. */
+    best = cursor;
+    best_len = cursor < old_len ?
+      match_len(&old[cursor], old_len - cursor, &new[i], new_len - i) : 0;
+    if(new_len - i >= KEY_LEN) {
+      depth = 0;
+      for(c = head[hash(&new[i])]; c >= 0 && depth < MAX_CHAIN;
+          c = chain[c], depth++) {
+        len = match_len(&old[c], old_len - c, &new[i], new_len - i);
+        if(len - varint_len(zigzag(c - cursor)) >
+           best_len - varint_len(zigzag(best - cursor))) {
+          best = c;
+          best_len = len;
+        }
+      }
+    }
+
+    for(run = 1; i + run < new_len && new[i + run] == new[i]; run++);
+
+    if(run > best_len && run > op_cost(run) + 1) {
+      fill(new[i], run);
+      i += run;
+    } else if(best_len > op_cost(best_len) +
+              varint_len(zigzag(best - cursor)) + (insert_len == 0)) {
+      copy(best, best_len);
+      i += best_len;
+    } else {
+      insert(new[i]);
+      i++;
+    }
+  }
+  flush_insert();
+
+  f = fopen(argv[3], "wb");
+  if(f == NULL || fwrite(out, 1, out_len, f) != (size_t)out_len) {
+    perror(argv[3]);
+    return 1;
+  }
+  fclose(f);
+
+  printf("%s: %ld bytes for %ld bytes (%ld copied, %ld filled, "
+         "%ld inserted), %ld chunks of 64 bytes\n",
+         argv[3], out_len, new_len, n_copy, n_fill, n_insert,
+         (out_len + 63) / 64);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/